@@ -19,7 +19,7 @@ PROFILE := -g -pg
 CC      := gcc
 MPICC   := mpicc
 CFLAGS  := -Wall -I$(INCLUDE_DIR)
-LDFLAGS := -L$(LIB_DIR) -lsc -lzmq
+LDFLAGS := -L$(LIB_DIR) -lsc -lzmq -lrt -lpthread
 
 ifneq (,$(findstring debug,$(TARGET)))
 	CFLAGS += $(DEBUG)
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sc.h>
+
+int main(int argc, char *argv[])
+{
+  session *s;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s Protocol_<role>.spr [-c conf] [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  session_init(&argc, &argv, &s, argv[1]);
+
+  int N = (argc > 2) ? atoi(argv[2]) : 1000; // Number of iterations
+
+  // Warm up the p2p connections.
+  sc_barrier(s);
+
+  int i;
+  long long barrier_start = sc_time();
+  for (i=0; i<N; i++) {
+    sc_barrier(s);
+  }
+  long long barrier_end = sc_time();
+
+  double elapsed = sc_time_diff(barrier_start, barrier_end);
+  printf("%s: %d roles, %d barriers, time elapsed: %f sec (%f usec/barrier)\n",
+         s->name, sc_nrank(s), N, elapsed, elapsed * 1e6 / N);
+
+  session_end(s);
+
+  return EXIT_SUCCESS;
+}
@@ -12,16 +12,19 @@ int main(int argc, char *argv[]) {
   send_int(count, W0, NULL);
   send_int(count, W1, NULL);
   int inside;
+  role *from;
   long num_in = 0;
   long num_total = 0;
   for (int i=0; i<count; ++i) {
-    recv_int(&inside, W0);
+    // One result from each worker, handled in order of arrival.
+    recv_int_any(&inside, &from, 2, W0, W1);
+    printf("Master received %d from %s\n", inside, (from == W0) ? "Worker0" : "Worker1");
     num_total++;
     if (inside) {
       num_in++;
     }
-    recv_int(&inside, W1);
-    printf("Master received %d\n", inside);
+    recv_int_any(&inside, &from, 2, W0, W1);
+    printf("Master received %d from %s\n", inside, (from == W0) ? "Worker0" : "Worker1");
     num_total++;
     if (inside) {
       num_in++;
@@ -4,14 +4,33 @@
  * \file
  * Header file for connection manager component.
  *
+ * Connection configurations are written as text (connmgr_write), or
+ * in a binary format (connmgr_write_bin) that a role maps into memory
+ * and reads only its own connections from (connmgr_map).
  */
 
-#define MAX_NR_OF_ROLES 100 // Maximum number of endpoint roles.
-#define MAX_HOSTNAME_LENGTH 256
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONNMGR_ARENA_SIZE 4096 // Size (bytes) of the first block of a string arena
+
+// Options of connmgr_init (traffic edges required).
+#define CONNMGR_TOPOLOGY 0x1 // Place communicating roles on the same host
+#define CONNMGR_PRUNE    0x2 // Connect only roles that communicate
+
+#define CONNMGR_REC_WEIGHT 10 // Traffic weight of interactions in a rec loop (per level)
+#define CONNMGR_SWEEPS          8 // Most sweeps of moves refining a topology placement
+#define CONNMGR_SWAP_CANDIDATES 4 // Roles willing to move the other way tried per swap
 
 #define CONNMGR_TYPE_P2P 1
 #define CONNMGR_TYPE_GRP 2
 
+#define CONNMGR_BIN_MAGIC   0x46435353 // "SSCF"
+#define CONNMGR_BIN_VERSION 1
+
+// Flags of binary configurations.
+#define CONNMGR_BIN_ALLPAIRS 0x1 // Every pair of roles is connected
+
 // A connection record.
 typedef struct {
   int type;
@@ -21,64 +40,200 @@ typedef struct {
   unsigned port;
 } conn_rec;
 
+// Traffic between a pair of roles (indices in the roles array, from < to).
+typedef struct {
+  int from;
+  int to;
+  double weight;
+} traffic_edge;
+
 // A role-host map.
 typedef struct {
   char *role;
   char *host;
 } host_map;
 
+/**
+ * Binary connection configuration (native byte order).
+ *
+ * Sections are at the given offsets (bytes) from the start of the
+ * file, and strings are offsets into the string table. Point-to-point
+ * connections come first, and the index lists the point-to-point
+ * connections of each role, so that a role reads its own rows, and
+ * the broadcast rows (one per role), only.
+ */
+typedef struct {
+  uint32_t magic;       // CONNMGR_BIN_MAGIC
+  uint32_t version;     // CONNMGR_BIN_VERSION
+  uint32_t flags;       // CONNMGR_BIN_*
+  uint32_t nroles;
+  uint32_t nconns;
+  uint32_t nlinks;      // Number of point-to-point connections (first in conns)
+  uint32_t roles_off;   // connmgr_bin_role[nroles], sorted by role name
+  uint32_t conns_off;   // connmgr_bin_conn[nconns]
+  uint32_t index_off;   // uint32_t index[nroles + 1] into rows, then uint32_t rows[index[nroles]]
+  uint32_t strings_off; // NUL-terminated strings
+  uint32_t size;        // Size of the file
+} connmgr_bin_header;
+
+typedef struct {
+  uint32_t role;
+  uint32_t host;
+} connmgr_bin_role;
+
+typedef struct {
+  uint32_t type;
+  uint32_t from;
+  uint32_t to;
+  uint32_t host;
+  uint32_t port;
+} connmgr_bin_conn;
+
+// A binary connection configuration mapped into memory.
+typedef struct {
+  void *addr;
+  size_t size;
+  const connmgr_bin_header *header;
+  const connmgr_bin_role *roles;
+  const connmgr_bin_conn *conns;
+  const uint32_t *index;
+  const uint32_t *rows;
+  const char *strings;
+} conn_config;
+
+// A string arena, holding the strings of a configuration
+// in blocks that are freed together.
+typedef struct connmgr_arena {
+  struct connmgr_arena *prev; // Previous (full) block
+  size_t size;                // Bytes in data
+  size_t used;
+  char data[];
+} connmgr_arena;
+
+
+/**
+ * \brief Copy a string into a string arena.
+ *
+ * @param[in,out] strings String arena (NULL if empty)
+ * @param[in]     str     String to copy
+ *
+ * \returns Copy of str, valid until the arena is freed.
+ */
+char *connmgr_strdup(connmgr_arena **strings, const char *str);
+
+
+/**
+ * \brief Free a string arena and all strings in it.
+ *
+ * @param[in] strings String arena (NULL if empty)
+ */
+void connmgr_arena_free(connmgr_arena *strings);
+
+
 /**
  * \brief Load a hosts file.
  *
- * @param[in]  hostsfile Hosts file path
- * @param[out] hosts     Array to hold list of hosts
+ * @param[in]     hostsfile Hosts file path
+ * @param[out]    hosts     Array to hold list of hosts
+ * @param[in,out] strings   String arena to hold the hosts
  *
  * \returns Number of hosts loaded.
  */
-int connmgr_load_hosts(const char *hostfile, char ***hosts);
+int connmgr_load_hosts(const char *hostfile, char ***hosts, connmgr_arena **strings);
 
 
 /**
  * \brief Load roles in session from file.
  *
- * @param[in]  scribble global Scribble file path
- * @param[out] roles    Array to hold list of roles
+ * @param[in]     scribble global Scribble file path
+ * @param[out]    roles    Array to hold list of roles
+ * @param[in,out] strings  String arena to hold the roles
  *
  * \returns Number of roles loaded.
  */
-int connmgr_load_roles(const char *scribble, char ***roles);
+int connmgr_load_roles(const char *scribble, char ***roles, connmgr_arena **strings);
 
 
 /**
- * \brief Create a connection record array using given parameters.
+ * \brief Estimate the traffic between roles of a global Scribble.
  *
- * @param[out] conns       Connection record array
- * @param[out] role_hosts  Role-to-host mapping
+ * Each interaction counts once per receiver, interactions inside rec
+ * loops count CONNMGR_REC_WEIGHT times more (per level of nesting),
+ * and interactions in one of n choice branches count 1/n.
+ *
+ * @param[in]  scribble    global Scribble file path
  * @param[in]  roles       Roles array
  * @param[in]  roles_count Number of items in roles array
- * @param[in]  hosts       Hosts array
- * @param[in]  hosts_count Number of items in hosts array
- * @param[in[  start_port  Lowest port number used in the connectoin records
- * 
+ * @param[out] traffic     Traffic edge array, one per pair of roles that
+ *                         interact, sorted by roles
+ *
+ * \returns Number of items in traffic edge array.
+ */
+int connmgr_load_traffic(const char *scribble, char **roles, int roles_count, traffic_edge **traffic);
+
+
+/**
+ * \brief Estimate the traffic between roles placed on different hosts.
+ *
+ * @param[in] role_hosts Role-to-host mapping (in the order of the roles array)
+ * @param[in] traffic    Traffic edge array (cf. connmgr_load_traffic)
+ * @param[in] ntraffic   Number of items in traffic edge array
+ *
+ * \returns Sum of traffic between roles on different hosts.
+ */
+double connmgr_cross_traffic(const host_map role_hosts[], const traffic_edge traffic[], int ntraffic);
+
+
+/**
+ * \brief Create a connection record array using given parameters.
+ *
+ * Roles are placed on hosts round-robin, or with CONNMGR_TOPOLOGY so
+ * that heavily communicating roles share a host (and talk through
+ * shared memory), at most as many roles per host as round-robin
+ * placement. Every pair of roles is connected, or with CONNMGR_PRUNE
+ * only pairs that communicate (the pairs of traffic), plus the first
+ * role with each group of roles that does not communicate with its
+ * group, so that every role is reachable; collectives between roles
+ * not connected are forwarded by the roles in between.
+ *
+ * Records share the strings of each role and host, held in strings.
+ *
+ * @param[out]    conns       Connection record array
+ * @param[out]    role_hosts  Role-to-host mapping
+ * @param[in]     roles       Roles array
+ * @param[in]     roles_count Number of items in roles array
+ * @param[in]     hosts       Hosts array
+ * @param[in]     hosts_count Number of items in hosts array
+ * @param[in]     start_port  Lowest port number used in the connectoin records
+ * @param[in]     traffic     Traffic edge array (cf. connmgr_load_traffic), NULL if no flags
+ * @param[in]     ntraffic    Number of items in traffic edge array
+ * @param[in]     flags       CONNMGR_TOPOLOGY and/or CONNMGR_PRUNE, or 0
+ * @param[in,out] strings     String arena to hold the strings of the records
+ *
  * \returns Number of items in connection record array.
  */
 int connmgr_init(conn_rec **conns, host_map **role_hosts,
                  char **roles, int roles_count,
                  char **hosts, int hosts_count,
-                 int start_port);
+                 int start_port, const traffic_edge traffic[], int ntraffic, int flags,
+                 connmgr_arena **strings);
 
 
 /**
  * \brief Read a connection record file.
  *
- * @param[in]  infile      Input file path
- * @param[out] conns       Connection record array to write to
- * @param[out] role_hosts  Role-to-host mapping
- * @param[out] nr_of_roles Number of roles 
+ * Records share the strings of each role and host, held in strings.
+ *
+ * @param[in]     infile      Input file path
+ * @param[out]    conns       Connection record array to write to
+ * @param[out]    role_hosts  Role-to-host mapping
+ * @param[out]    nr_of_roles Number of roles
+ * @param[in,out] strings     String arena to hold the strings of the records
  *
  * \returns Number of items in the connection record array.
  */
-int connmgr_read(const char *infile, conn_rec **conns, host_map **role_hosts, int *nr_of_roles);
+int connmgr_read(const char *infile, conn_rec **conns, host_map **role_hosts, int *nr_of_roles,
+                 connmgr_arena **strings);
 
 
 /**
@@ -93,4 +248,70 @@ int connmgr_read(const char *infile, conn_rec **conns, host_map **role_hosts, in
 void connmgr_write(const char *outfile, const conn_rec conns[], int nr_of_conns,
                                         const host_map role_hosts[], int nr_of_roles);
 
+
+
+/**
+ * \brief Write a connection record array to file, in binary format.
+ *
+ * @param[in] outfile     Output file path
+ * @param[in] conns       Connection record array
+ * @param[in] nr_of_conns Number of items in connection record array
+ * @param[in] role_hosts  Role-to-host mapping
+ * @param[in] nr_of_roles Number of roles in connection record
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int connmgr_write_bin(const char *outfile, const conn_rec conns[], int nr_of_conns,
+                                           const host_map role_hosts[], int nr_of_roles);
+
+
+/**
+ * \brief Map a binary connection configuration file into memory.
+ *
+ * @param[in]  infile Input file path
+ * @param[out] config Mapped configuration
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (EINVAL if infile is not a binary configuration)
+ */
+int connmgr_map(const char *infile, conn_config *config);
+
+
+/**
+ * \brief Get the connection records of a role from a mapped
+ * configuration: the point-to-point connections of the role, and
+ * the broadcast connections of all roles.
+ *
+ * Strings of the records point into the mapping.
+ *
+ * @param[in]  config Mapped configuration
+ * @param[in]  role   Name of the role
+ * @param[out] conns  Connection record array
+ *
+ * \returns Number of items in the connection record array.
+ */
+int connmgr_map_rows(const conn_config *config, const char *role, conn_rec **conns);
+
+
+/**
+ * \brief Get the point-to-point connection records of all roles from
+ * a mapped configuration, unless every pair of roles is connected.
+ *
+ * Strings of the records point into the mapping.
+ *
+ * @param[in]  config Mapped configuration
+ * @param[out] conns  Connection record array (NULL if every pair is connected)
+ *
+ * \returns Number of items in the connection record array.
+ */
+int connmgr_map_links(const conn_config *config, conn_rec **conns);
+
+
+/**
+ * \brief Unmap a configuration mapped with connmgr_map.
+ *
+ * @param[in,out] config Mapped configuration
+ */
+void connmgr_unmap(conn_config *config);
+
 #endif // __CONNMGR_H__
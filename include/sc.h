@@ -6,6 +6,8 @@
  * toplevel wrapper header.
  */
 
+#include <sc/async.h>
+#include <sc/collectives.h>
 #include <sc/primitives.h>
 #include <sc/session.h>
 #include <sc/types.h>
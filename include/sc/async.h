@@ -0,0 +1,233 @@
+#ifndef SC__ASYNC_H__
+#define SC__ASYNC_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * non-blocking communication primitives module.
+ *
+ * Non-blocking primitives post an operation and return a request
+ * handle immediately, the operation is completed by sc_test() or
+ * the sc_wait*() functions. Requests on the same endpoint complete
+ * in the order they were posted, and blocking primitives on an
+ * endpoint complete outstanding requests on that endpoint first.
+ *
+ * The integer primitives documented below are one instance of the
+ * typed non-blocking family, which is generated for every element
+ * type in SC_PRIMITIVE_TYPES (eg. isend_double_array, irecv_int64).
+ */
+
+#include "sc/primitives.h"
+#include "sc/types.h"
+
+#define SC_REQ_SEND 1
+#define SC_REQ_RECV 2
+
+
+/**
+ * Request handle of a non-blocking operation.
+ */
+typedef struct sc_request_t
+{
+  int kind;   // SC_REQ_SEND or SC_REQ_RECV
+  int active; // Posted and not yet returned by sc_test/sc_wait*
+  int done;   // Message transferred
+  int rc;     // Result of the operation
+
+  role *r;
+  struct role_endpoint *ep;
+
+  void *buf;        // Receive buffer
+  size_t *count;    // Number of elements in receive buffer (updated on completion)
+  size_t nelem;     // Storage for count of scalar receives
+  size_t elem_size;
+  int type;
+
+  void *msg; // Outgoing message
+
+  struct sc_request_t *next; // Next request posted on the same endpoint
+} sc_request;
+
+
+/**
+ * \brief Send an integer (non-blocking).
+ *
+ * The value is copied, it can be reused as soon as isend_int returns.
+ *
+ * @param[in]  val   Value to send
+ * @param[in]  r     Role to send to
+ * @param[in]  label Message label (can be null)
+ * @param[out] req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int isend_int(int val, role *r, const char *label, sc_request *req);
+
+
+/**
+ * \brief Send an integer array (non-blocking).
+ *
+ * The array is copied, it can be reused as soon as isend_int_array returns.
+ *
+ * @param[in]  arr   Array to send
+ * @param[in]  count Number of elements in array
+ * @param[in]  r     Role to send to
+ * @param[in]  label Message label (can be null)
+ * @param[out] req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int isend_int_array(const int arr[], size_t count, role *r, const char *label, sc_request *req);
+
+
+/**
+ * \brief Receive an integer (non-blocking).
+ *
+ * dst must not be accessed until the request completes.
+ *
+ * @param[out] dst Pointer to variable storing received integer
+ * @param[in]  r   Role to receive from
+ * @param[out] req Request handle
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int irecv_int(int *dst, role *r, sc_request *req);
+
+
+/**
+ * \brief Receive an integer array (non-blocking).
+ *
+ * arr and count must not be accessed until the request completes.
+ *
+ * @param[out]    arr   Pointer to array storing received integers
+ * @param[in,out] count Pointer to variable storing number of elements in array
+ * @param[in]     r     Role to receive from
+ * @param[out]    req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int irecv_int_array(int *arr, size_t *count, role *r, sc_request *req);
+
+
+/**
+ * \brief Post a send of a typed array (non-blocking).
+ *
+ * @param[in]  buf       Array to send (copied)
+ * @param[in]  count     Number of elements in array
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Element type (SC_TYPE_*)
+ * @param[in]  r         Role to send to
+ * @param[in]  label     Message label (can be null)
+ * @param[out] req       Request handle
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_isend(const void *buf, size_t count, size_t elem_size, int type,
+             role *r, const char *label, sc_request *req);
+
+
+/**
+ * \brief Post a receive of a typed array (non-blocking).
+ *
+ * @param[out]    buf       Array to receive into
+ * @param[in,out] count     Pointer to variable storing number of elements in array
+ *                          (null for a single element)
+ * @param[in]     elem_size Size of an element in bytes
+ * @param[in]     type      Element type (SC_TYPE_*)
+ * @param[in]     r         Role to receive from
+ * @param[out]    req       Request handle
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_irecv(void *buf, size_t *count, size_t elem_size, int type,
+             role *r, sc_request *req);
+
+
+/**
+ * \brief Test for completion of a request.
+ *
+ * @param[in,out] req  Request handle
+ * @param[out]    flag 1 if the request completed, 0 otherwise
+ *
+ * \returns Result of the operation if completed (0 if successful,
+ *          -1 otherwise), 0 if not completed.
+ */
+int sc_test(sc_request *req, int *flag);
+
+
+/**
+ * \brief Wait for completion of a request.
+ *
+ * @param[in,out] req Request handle
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_wait(sc_request *req);
+
+
+/**
+ * \brief Cancel a request.
+ *
+ * An unfinished request is removed from its endpoint and its result
+ * is -1. A message already sent or received is not recalled, a message
+ * that arrives later is left to the next receive on the endpoint.
+ * The request handle (and receive buffer) can be reused afterwards.
+ *
+ * @param[in,out] req Request handle
+ */
+void sc_cancel(sc_request *req);
+
+
+/**
+ * \brief Wait for completion of all requests.
+ *
+ * If waiting fails, the unfinished requests are cancelled (see sc_cancel).
+ *
+ * @param[in]     n    Number of requests
+ * @param[in,out] reqs Request handles
+ *
+ * \returns 0 if all requests are successful, -1 otherwise
+ */
+int sc_waitall(int n, sc_request reqs[]);
+
+
+/**
+ * \brief Wait for completion of any request.
+ *
+ * If waiting fails, the unfinished requests are cancelled (see sc_cancel).
+ *
+ * @param[in]     n     Number of requests
+ * @param[in,out] reqs  Request handles
+ * @param[out]    index Index of the completed request
+ *                      (-1 if there are no active requests)
+ *
+ * \returns Result of the completed request (0 if successful, -1 otherwise)
+ */
+int sc_waitany(int n, sc_request reqs[], int *index);
+
+
+/**
+ * \brief Complete outstanding requests on an endpoint.
+ *
+ * Used by the blocking primitives to keep messages in order.
+ *
+ * @param[in,out] ep   Endpoint
+ * @param[in]     kind Requests to complete (SC_REQ_SEND and/or SC_REQ_RECV)
+ */
+void sc_async_flush(struct role_endpoint *ep, int kind);
+
+
+/**
+ * Declare the typed non-blocking family of an element type
+ * (see the integer primitives for documentation).
+ */
+#define SC_DECLARE_ASYNC_PRIMITIVES(name, ctype, sctype)                                      \
+  int isend_##name(ctype val, role *r, const char *label, sc_request *req);                   \
+  int isend_##name##_array(const ctype arr[], size_t count, role *r, const char *label,       \
+                           sc_request *req);                                                  \
+  int irecv_##name(ctype *dst, role *r, sc_request *req);                                     \
+  int irecv_##name##_array(ctype *arr, size_t *count, role *r, sc_request *req);
+
+SC_PRIMITIVE_TYPES(SC_DECLARE_ASYNC_PRIMITIVES)
+
+
+#endif // SC__ASYNC_H__
@@ -0,0 +1,434 @@
+#ifndef SC__COLLECTIVES_H__
+#define SC__COLLECTIVES_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * collective operations module.
+ *
+ * Collective operations involve every role of a session (this role
+ * and _Others) and must be called by all of them in the same order.
+ * Roles are ranked by name, and the algorithms run over the p2p
+ * endpoints between ranks instead of the _Others PUB/SUB sockets,
+ * so that no single role sends every copy of a message. When some
+ * roles are not connected (see session_init), messages are forwarded
+ * along a spanning tree of the connections instead.
+ *
+ * The integer collectives documented below are one instance of the
+ * typed collective family, which is generated for every element
+ * type in SC_PRIMITIVE_TYPES (eg. coll_bcast_double_array).
+ */
+
+#include "sc/primitives.h"
+#include "sc/types.h"
+
+#define SC_COLL_AUTO 0 // Choose by message size and number of roles
+#define SC_COLL_TREE 1 // Binomial tree
+#define SC_COLL_RING 2 // Pipelined ring
+#define SC_COLL_PUB  3 // PUB/SUB fan-out from the root (as bcast_<type>)
+#define SC_COLL_SPAN 4 // Spanning tree of the connections (used when roles are not all connected)
+
+#define SC_OP_SUM  1
+#define SC_OP_PROD 2
+#define SC_OP_MIN  3
+#define SC_OP_MAX  4
+#define SC_OP_USER 5 // User-defined (sc_op_fn)
+
+#define SC_BCAST_RING_MIN_SIZE  (256 * 1024) // Smallest broadcast (bytes) sent around the ring
+#define SC_BCAST_RING_MIN_ROLES 4            // Smallest number of roles to use the ring
+#define SC_BCAST_SEGMENT_SIZE   (64 * 1024)  // Size (bytes) of pipelined ring segments
+
+
+/**
+ * User-defined reduction operator, combines count elements of in
+ * into inout (inout[i] = inout[i] op in[i]). The operator must be
+ * associative and commutative.
+ */
+typedef void (sc_op_fn)(void *inout, const void *in, size_t count, int type);
+
+
+/**
+ * \brief Get the number of ranks (roles) in a session.
+ *
+ * @param[in] s Session
+ *
+ * \returns Number of ranks.
+ */
+int sc_nrank(session *s);
+
+
+/**
+ * \brief Get the rank of this role in a session.
+ *
+ * @param[in] s Session
+ *
+ * \returns Rank of this role.
+ */
+int sc_rank(session *s);
+
+
+/**
+ * \brief Get the rank of a role in a session.
+ *
+ * @param[in] s    Session
+ * @param[in] name Role name
+ *
+ * \returns Rank of role, -1 if not found.
+ */
+int sc_rank_of(session *s, const char *name);
+
+
+/**
+ * \brief Get the role of a rank in a session.
+ *
+ * @param[in] s    Session
+ * @param[in] rank Rank
+ *
+ * \returns Role of rank, null for the rank of this role.
+ */
+role *sc_rank_role(session *s, int rank);
+
+
+/**
+ * \brief Broadcast an integer from a root role (collective).
+ *
+ * @param[in,out] val  Value to send (at root) or to receive into
+ * @param[in]     root Name of the root role
+ * @param[in]     s    Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_bcast_int(int *val, const char *root, session *s);
+
+
+/**
+ * \brief Broadcast an integer array from a root role (collective).
+ *
+ * @param[in,out] arr   Array to send (at root) or to receive into
+ * @param[in]     count Number of elements in array (same at all roles)
+ * @param[in]     root  Name of the root role
+ * @param[in]     s     Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_bcast_int_array(int *arr, size_t count, const char *root, session *s);
+
+
+/**
+ * \brief Broadcast a typed array from a root role (generic form of
+ * coll_bcast_<type>_array).
+ *
+ * Uses a binomial tree, or a pipelined ring for large messages
+ * between many roles.
+ *
+ * @param[in,out] buf       Array to send (at root) or to receive into
+ * @param[in]     count     Number of elements in array (same at all roles)
+ * @param[in]     elem_size Size of an element in bytes
+ * @param[in]     type      Element type (SC_TYPE_*)
+ * @param[in]     root      Name of the root role
+ * @param[in]     s         Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_bcast(void *buf, size_t count, size_t elem_size, int type,
+             const char *root, session *s);
+
+
+/**
+ * \brief Broadcast a typed array with a given algorithm.
+ *
+ * @param[in,out] buf       Array to send (at root) or to receive into
+ * @param[in]     count     Number of elements in array (same at all roles)
+ * @param[in]     elem_size Size of an element in bytes
+ * @param[in]     type      Element type (SC_TYPE_*)
+ * @param[in]     root      Name of the root role
+ * @param[in]     s         Session
+ * @param[in]     alg       Algorithm (SC_COLL_*, same at all roles)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_bcast_alg(void *buf, size_t count, size_t elem_size, int type,
+                 const char *root, session *s, int alg);
+
+
+/**
+ * \brief Reduce integers to a root role (collective).
+ *
+ * @param[in]  val    Value to contribute
+ * @param[out] result Pointer to variable storing result (at root, can be null elsewhere)
+ * @param[in]  op     Reduction operator (SC_OP_SUM, SC_OP_PROD, SC_OP_MIN or SC_OP_MAX,
+ *                    SC_OP_USER needs sc_reduce or sc_allreduce)
+ * @param[in]  root   Name of the root role
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_reduce_int(int val, int *result, int op, const char *root, session *s);
+
+
+/**
+ * \brief Reduce integer arrays element-wise to a root role (collective).
+ *
+ * @param[in]  arr    Array to contribute
+ * @param[out] result Array storing result (at root, can be null elsewhere)
+ * @param[in]  count  Number of elements in arrays (same at all roles)
+ * @param[in]  op     Reduction operator (SC_OP_SUM, SC_OP_PROD, SC_OP_MIN or SC_OP_MAX,
+ *                    SC_OP_USER needs sc_reduce or sc_allreduce)
+ * @param[in]  root   Name of the root role
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_reduce_int_array(const int arr[], int *result, size_t count, int op,
+                          const char *root, session *s);
+
+
+/**
+ * \brief Reduce integers at all roles (collective).
+ *
+ * @param[in]  val    Value to contribute
+ * @param[out] result Pointer to variable storing result
+ * @param[in]  op     Reduction operator (SC_OP_SUM, SC_OP_PROD, SC_OP_MIN or SC_OP_MAX,
+ *                    SC_OP_USER needs sc_reduce or sc_allreduce)
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_allreduce_int(int val, int *result, int op, session *s);
+
+
+/**
+ * \brief Reduce integer arrays element-wise at all roles (collective).
+ *
+ * @param[in]  arr    Array to contribute
+ * @param[out] result Array storing result (can be arr)
+ * @param[in]  count  Number of elements in arrays (same at all roles)
+ * @param[in]  op     Reduction operator (SC_OP_SUM, SC_OP_PROD, SC_OP_MIN or SC_OP_MAX,
+ *                    SC_OP_USER needs sc_reduce or sc_allreduce)
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_allreduce_int_array(const int arr[], int *result, size_t count, int op, session *s);
+
+
+/**
+ * \brief Reduce typed arrays to a root role (generic form of
+ * coll_reduce_<type>_array).
+ *
+ * Partial results are combined along a binomial tree.
+ *
+ * @param[in]  buf       Array to contribute
+ * @param[out] result    Array storing result (at root, can be null elsewhere)
+ * @param[in]  count     Number of elements in arrays (same at all roles)
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Element type (SC_TYPE_*)
+ * @param[in]  op        Reduction operator (SC_OP_*)
+ * @param[in]  fn        User-defined operator (if op is SC_OP_USER, EINVAL if null)
+ * @param[in]  root      Name of the root role
+ * @param[in]  s         Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_reduce(const void *buf, void *result, size_t count, size_t elem_size, int type,
+              int op, sc_op_fn *fn, const char *root, session *s);
+
+
+/**
+ * \brief Reduce typed arrays at all roles (generic form of
+ * coll_allreduce_<type>_array).
+ *
+ * Uses recursive doubling if the number of roles is a power of two,
+ * otherwise a reduction to the first rank followed by a broadcast.
+ *
+ * @param[in]  buf       Array to contribute
+ * @param[out] result    Array storing result (can be buf)
+ * @param[in]  count     Number of elements in arrays (same at all roles)
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Element type (SC_TYPE_*)
+ * @param[in]  op        Reduction operator (SC_OP_*)
+ * @param[in]  fn        User-defined operator (if op is SC_OP_USER, EINVAL if null)
+ * @param[in]  s         Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_allreduce(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                 int op, sc_op_fn *fn, session *s);
+
+
+/**
+ * \brief Scatter blocks of an integer array from a root role (collective).
+ *
+ * Rank i receives block i (elements [i*count, (i+1)*count)) of arr.
+ *
+ * @param[in]  arr    Array to scatter (at root, can be null elsewhere)
+ * @param[out] result Array storing received block
+ * @param[in]  count  Number of elements per block (same at all roles)
+ * @param[in]  root   Name of the root role
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_scatter_int_array(const int arr[], int *result, size_t count,
+                           const char *root, session *s);
+
+
+/**
+ * \brief Gather integer arrays at a root role (collective).
+ *
+ * The array of rank i is stored as block i of result.
+ *
+ * @param[in]  arr    Array to contribute
+ * @param[out] result Array storing gathered blocks (at root, can be null elsewhere)
+ * @param[in]  count  Number of elements per block (same at all roles)
+ * @param[in]  root   Name of the root role
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_gather_int_array(const int arr[], int *result, size_t count,
+                          const char *root, session *s);
+
+
+/**
+ * \brief Gather integer arrays at all roles (collective).
+ *
+ * @param[in]  arr    Array to contribute
+ * @param[out] result Array storing gathered blocks
+ * @param[in]  count  Number of elements per block (same at all roles)
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_allgather_int_array(const int arr[], int *result, size_t count, session *s);
+
+
+/**
+ * \brief Exchange blocks of integer arrays between all roles (collective).
+ *
+ * Block j of arr at rank i is stored as block i of result at rank j.
+ *
+ * @param[in]  arr    Array of blocks to send
+ * @param[out] result Array storing received blocks
+ * @param[in]  count  Number of elements per block (same at all roles)
+ * @param[in]  s      Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int coll_alltoall_int_array(const int arr[], int *result, size_t count, session *s);
+
+
+/**
+ * \brief Scatter blocks of a typed array (generic form of coll_scatter_<type>_array).
+ *
+ * @param[in]  buf       Array to scatter (at root, can be null elsewhere)
+ * @param[out] result    Array storing received block
+ * @param[in]  count     Number of elements per block (same at all roles)
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Element type (SC_TYPE_*)
+ * @param[in]  root      Name of the root role
+ * @param[in]  s         Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_scatter(const void *buf, void *result, size_t count, size_t elem_size, int type,
+               const char *root, session *s);
+
+
+/**
+ * \brief Gather typed arrays (generic form of coll_gather_<type>_array).
+ *
+ * @param[in]  buf       Array to contribute
+ * @param[out] result    Array storing gathered blocks (at root, can be null elsewhere)
+ * @param[in]  count     Number of elements per block (same at all roles)
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Element type (SC_TYPE_*)
+ * @param[in]  root      Name of the root role
+ * @param[in]  s         Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_gather(const void *buf, void *result, size_t count, size_t elem_size, int type,
+              const char *root, session *s);
+
+
+/**
+ * \brief Gather typed arrays at all roles (generic form of coll_allgather_<type>_array).
+ *
+ * @param[in]  buf       Array to contribute
+ * @param[out] result    Array storing gathered blocks
+ * @param[in]  count     Number of elements per block (same at all roles)
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Element type (SC_TYPE_*)
+ * @param[in]  s         Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_allgather(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                 session *s);
+
+
+/**
+ * \brief Exchange blocks of typed arrays between all roles (generic
+ * form of coll_alltoall_<type>_array).
+ *
+ * @param[in]  buf       Array of blocks to send
+ * @param[out] result    Array storing received blocks
+ * @param[in]  count     Number of elements per block (same at all roles)
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Element type (SC_TYPE_*)
+ * @param[in]  s         Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_alltoall(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                session *s);
+
+
+/**
+ * \brief Barrier synchronisation of all roles (collective).
+ *
+ * Dissemination barrier: in round k every rank notifies rank + 2^k
+ * and waits for rank - 2^k (mod number of ranks), so all roles leave
+ * after ceil(log2(number of ranks)) rounds.
+ *
+ * @param[in] s Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_barrier(session *s);
+
+
+/**
+ * \brief Release the collective state of a session.
+ *
+ * @param[in,out] s Session
+ */
+void sc_coll_free(session *s);
+
+
+/**
+ * Declare the typed collective family of an element type
+ * (see the integer collectives for documentation).
+ */
+#define SC_DECLARE_COLL_PRIMITIVES(name, ctype, sctype)                                       \
+  int coll_bcast_##name(ctype *val, const char *root, session *s);                            \
+  int coll_bcast_##name##_array(ctype *arr, size_t count, const char *root, session *s);      \
+  int coll_reduce_##name(ctype val, ctype *result, int op, const char *root, session *s);     \
+  int coll_reduce_##name##_array(const ctype arr[], ctype *result, size_t count, int op,      \
+                                 const char *root, session *s);                               \
+  int coll_allreduce_##name(ctype val, ctype *result, int op, session *s);                    \
+  int coll_allreduce_##name##_array(const ctype arr[], ctype *result, size_t count, int op,   \
+                                    session *s);                                              \
+  int coll_scatter_##name##_array(const ctype arr[], ctype *result, size_t count,             \
+                                  const char *root, session *s);                              \
+  int coll_gather_##name##_array(const ctype arr[], ctype *result, size_t count,              \
+                                 const char *root, session *s);                               \
+  int coll_allgather_##name##_array(const ctype arr[], ctype *result, size_t count,           \
+                                    session *s);                                              \
+  int coll_alltoall_##name##_array(const ctype arr[], ctype *result, size_t count,            \
+                                   session *s);
+
+SC_PRIMITIVE_TYPES(SC_DECLARE_COLL_PRIMITIVES)
+
+
+#endif // SC__COLLECTIVES_H__
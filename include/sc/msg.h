@@ -0,0 +1,287 @@
+#ifndef SC__MSG_H__
+#define SC__MSG_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * message encoding module.
+ *
+ * Every message is a single frame holding a fixed header (label
+ * identifier, element type, element count and sequence number)
+ * followed by the payload. Zero-copy payloads cannot be prefixed
+ * in place and follow the header in a second frame. Scatter/gather
+ * messages carry one frame per segment after the header frame.
+ *
+ * Frames go through the transport of an endpoint (see sc/transport.h),
+ * a ZeroMQ socket or eg. a shared memory channel between co-located
+ * roles.
+ */
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <zmq.h>
+
+#include "sc/types.h"
+
+#define SC_MSG_SPLIT 0x1 // Payload follows in a separate frame
+#define SC_MSG_IOV   0x2 // Segments follow in separate frames (count = number of segments)
+
+#define SC_POLLIN  0x1
+#define SC_POLLOUT 0x2
+
+
+/**
+ * Message header (wire format).
+ */
+typedef struct {
+  uint32_t label; // Label identifier (SC_LABEL_NONE if unlabelled)
+  uint16_t type;  // Element type (SC_TYPE_*)
+  uint16_t flags; // SC_MSG_* flags
+  uint32_t count; // Number of elements in payload
+  uint32_t seq;   // Sequence number (per endpoint)
+} sc_msg_hdr;
+
+
+/**
+ * A received message.
+ */
+typedef struct {
+  zmq_msg_t msg;
+  sc_msg_hdr hdr;
+  size_t offset; // Offset of payload in msg
+  size_t size;   // Size of payload
+  int ready;     // Received ahead and not yet consumed
+} sc_msg;
+
+
+/**
+ * \brief Send a message (payload is copied).
+ *
+ * @param[in] ep    Endpoint to send to
+ * @param[in] label Message label identifier
+ * @param[in] type  Element type of payload
+ * @param[in] buf   Payload
+ * @param[in] count Number of elements in payload
+ * @param[in] size  Size of payload
+ * @param[in] flags ZeroMQ send flags
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_send(struct role_endpoint *ep, sc_label_t label, int type,
+                const void *buf, size_t count, size_t size, int flags);
+
+
+/**
+ * \brief Prepare a message (payload is copied) for sc_msg_send_built.
+ *
+ * @param[out] msg   Message to initialise
+ * @param[in]  ep    Endpoint the message will be sent to
+ * @param[in]  label Message label identifier
+ * @param[in]  type  Element type of payload
+ * @param[in]  buf   Payload
+ * @param[in]  count Number of elements in payload
+ * @param[in]  size  Size of payload
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_build(zmq_msg_t *msg, struct role_endpoint *ep, sc_label_t label, int type,
+                 const void *buf, size_t count, size_t size);
+
+
+/**
+ * \brief Send a message prepared by sc_msg_build.
+ *
+ * On failure (eg. EAGAIN with ZMQ_DONTWAIT) the message is left
+ * intact and can be sent again.
+ *
+ * @param[in] ep    Endpoint to send to
+ * @param[in] msg   Prepared message
+ * @param[in] flags ZeroMQ send flags
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_send_built(struct role_endpoint *ep, zmq_msg_t *msg, int flags);
+
+
+/**
+ * \brief Send a message without copying the payload.
+ *
+ * buf is released also if the message cannot be sent.
+ *
+ * @param[in] ep    Endpoint to send to
+ * @param[in] label Message label identifier
+ * @param[in] type  Element type of payload
+ * @param[in] buf   Payload (released through ffn, or free() if null)
+ * @param[in] count Number of elements in payload
+ * @param[in] size  Size of payload
+ * @param[in] ffn   Deallocation callback
+ * @param[in] hint  Hint passed to ffn
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_send_nocopy(struct role_endpoint *ep, sc_label_t label, int type,
+                       void *buf, size_t count, size_t size,
+                       sc_free_fn *ffn, void *hint);
+
+
+/**
+ * \brief Send a scatter/gather message (segments are copied).
+ *
+ * @param[in] ep     Endpoint to send to
+ * @param[in] label  Message label identifier
+ * @param[in] iov    Segments
+ * @param[in] iovcnt Number of segments
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_send_iov(struct role_endpoint *ep, sc_label_t label,
+                    const struct iovec iov[], int iovcnt);
+
+
+/**
+ * \brief Send a scatter/gather message without copying the segments.
+ *
+ * @param[in] ep     Endpoint to send to
+ * @param[in] label  Message label identifier
+ * @param[in] iov    Segments (each released through ffn, or free() if null)
+ * @param[in] iovcnt Number of segments
+ * @param[in] ffn    Deallocation callback
+ * @param[in] hint   Hint passed to ffn
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_send_iov_nocopy(struct role_endpoint *ep, sc_label_t label,
+                           const struct iovec iov[], int iovcnt,
+                           sc_free_fn *ffn, void *hint);
+
+
+/**
+ * \brief Receive a message.
+ *
+ * A message received ahead (by sc_msg_peek) is returned first.
+ * The message must be closed with sc_msg_close().
+ *
+ * @param[in]  ep    Endpoint to receive from
+ * @param[out] m     Received message
+ * @param[in]  flags ZeroMQ receive flags (eg. ZMQ_DONTWAIT)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_recv(struct role_endpoint *ep, sc_msg *m, int flags);
+
+
+/**
+ * \brief Receive the next segment of a scatter/gather message.
+ *
+ * @param[in]  ep    Endpoint to receive from
+ * @param[out] frame Initialised message to receive the segment into
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_msg_recv_segment(struct role_endpoint *ep, zmq_msg_t *frame);
+
+
+/**
+ * \brief Reject a scatter/gather message received where a plain
+ * message is expected, draining its segments from the endpoint.
+ *
+ * @param[in] ep   Endpoint the message was received from
+ * @param[in] m    Received message
+ * @param[in] func Caller (for error messages)
+ *
+ * \returns 0 if the message is not segmented, -1 otherwise and set errno
+ *          (EPROTO once the segments are drained)
+ */
+int sc_msg_reject_iov(struct role_endpoint *ep, const sc_msg *m, const char *func);
+
+
+/**
+ * \brief Check element type and count of a received message.
+ *
+ * @param[in] m         Received message
+ * @param[in] type      Expected element type
+ * @param[in] elem_size Size of an element in bytes
+ * @param[in] func      Caller (for error messages)
+ *
+ * \returns 1 if the message matches, 0 otherwise.
+ */
+int sc_msg_check_type(const sc_msg *m, int type, size_t elem_size, const char *func);
+
+
+/**
+ * \brief Copy the payload of a received message into an array.
+ *
+ * @param[in]     m         Received message
+ * @param[out]    buf       Array to copy to
+ * @param[in,out] count     Pointer to variable storing number of elements in array
+ * @param[in]     elem_size Size of an element in bytes
+ * @param[in]     type      Expected element type
+ * @param[in]     func      Caller (for error messages)
+ *
+ * \returns 0 if successful (a payload larger than the array is
+ *          truncated), -1 otherwise and set errno (EPROTO if the
+ *          message type or size does not match)
+ */
+int sc_msg_unpack(sc_msg *m, void *buf, size_t *count, size_t elem_size, int type, const char *func);
+
+
+/**
+ * \brief Account for a message received on an ordered (p2p) endpoint.
+ *
+ * @param[in,out] ep Endpoint the message is received from
+ * @param[in]     m  Received message
+ */
+void sc_msg_sequence(struct role_endpoint *ep, const sc_msg *m);
+
+
+/**
+ * \brief Wait for endpoints to become ready.
+ *
+ * @param[in]  eps     Endpoints to poll
+ * @param[in]  events  Events (SC_POLLIN, SC_POLLOUT) to poll for each endpoint
+ * @param[out] revents Events ready for each endpoint
+ * @param[in]  n       Number of endpoints
+ * @param[in]  timeout Timeout (-1 to wait indefinitely, see zmq_poll)
+ *
+ * \returns Number of endpoints ready, -1 otherwise and set errno
+ */
+int sc_msg_poll(struct role_endpoint *eps[], const short events[], short revents[], int n, long timeout);
+
+
+/**
+ * \brief Receive a message ahead, leaving it for the next sc_msg_recv.
+ *
+ * @param[in] ep Endpoint to receive from
+ *
+ * \returns Message received ahead, or null and set errno.
+ */
+sc_msg *sc_msg_peek(struct role_endpoint *ep);
+
+
+/**
+ * \brief Get the payload of a received message.
+ *
+ * @param[in] m Received message
+ *
+ * \returns Pointer to payload.
+ */
+void *sc_msg_data(sc_msg *m);
+
+
+/**
+ * \brief Release a received message.
+ *
+ * @param[in,out] m Received message
+ */
+void sc_msg_close(sc_msg *m);
+
+
+/**
+ * \brief Release a message received ahead on an endpoint.
+ *
+ * @param[in,out] ep Endpoint to cleanup
+ */
+void sc_msg_drop_pending(struct role_endpoint *ep);
+
+
+#endif // SC__MSG_H__
@@ -4,9 +4,15 @@
  * \file
  * Session C runtime library (libsc)
  * communication primitives module.
+ *
+ * The integer primitives documented below are one instance of the
+ * typed primitive family, which is generated for every element type
+ * in SC_PRIMITIVE_TYPES (eg. send_double_array, brecv_int64).
  */
 
 #include <stdarg.h>
+#include <stdint.h>
+#include <sys/uio.h>
 
 #include "sc/types.h"
 
@@ -37,6 +43,28 @@ int send_int(int val, role *r, const char *label);
 int send_int_array(const int arr[], size_t count, role *r, const char *label);
 
 
+/**
+ * \brief Send an integer array without copying (zero-copy).
+ *
+ * The buffer is handed over to the runtime and must not be modified
+ * until ffn is called. If ffn is NULL, ownership of the buffer
+ * (allocated with malloc) is transferred and the runtime frees it.
+ * The buffer is released in the same way if the send fails.
+ *
+ * @param[in] arr   Array to send
+ * @param[in] count Number of elements in array
+ * @param[in] r     Role to send to
+ * @param[in] label Message label (can be null)
+ * @param[in] ffn   Deallocation callback (can be null)
+ * @param[in] hint  Hint passed to ffn
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_int_array_nocopy(int arr[], size_t count, role *r, const char *label,
+                          sc_free_fn *ffn, void *hint);
+
+
 /**
  * \brief Send an integer to multiple roles.
  *
@@ -50,14 +78,34 @@ int send_int_array(const int arr[], size_t count, role *r, const char *label);
  */
 int vsend_int(int val, int nr_of_roles, ...);
 
+/**
+ * \brief Receive a message label identifier.
+ *
+ * The labelled message is kept for the receive following the label.
+ *
+ * @param[out] label Variable to save message label identifier to
+ *                   (compare with SC_LABEL_* from scribble-tool --labels,
+ *                   a switch with case SC_LABEL_x: is a choice to the type checker)
+ * @param[in]  r     Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int probe_label_id(sc_label_t *label, role *r);
+
+
 /**
  * \brief Receive a message label.
  *
+ * The label is copied, use probe_label_id to avoid the allocation.
+ *
  * @param[out] label Variable to save message label to
+ *                   (free after use, NULL on error)
  * @param[in]  r     Role to receive from
  *
  * \returns 0 if successful, -1 otherwise and set errno
- *          (See man page of zmq_recv)
+ *          (EPROTO if the label is not in the protocol,
+ *          see man page of zmq_recv otherwise)
  */
 int probe_label(char **label, role *r);
 
@@ -90,6 +138,83 @@ int recv_int(int *dst, role *r);
 int recv_int_array(int *arr, size_t *count, role *r);
 
 
+/**
+ * \brief Receive an integer array in place (borrowed, no copy).
+ *
+ * The received elements are accessed through view->data as
+ * (const int *) and remain valid until sc_view_release() is called.
+ *
+ * @param[out] view Message view to fill in
+ * @param[in]  r    Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_int_array_view(sc_view *view, role *r);
+
+
+/**
+ * \brief Receive an integer array (allocated by the runtime).
+ *
+ * The array is sized from the received message and must be
+ * deallocated by the caller with free().
+ *
+ * @param[out] arr   Pointer to newly allocated array
+ * @param[out] count Pointer to variable storing number of elements in array
+ * @param[in]  r     Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_int_array_alloc(int **arr, size_t *count, role *r);
+
+
+/**
+ * \brief Receive an integer from whichever role sends first.
+ *
+ * A group role (eg. _Others) stands for all of its connected member roles.
+ * n consecutive calls with the same n roles receive one integer from
+ * each role, in order of arrival (see sc_recv_any).
+ *
+ * @param[out] dst         Pointer to variable storing received integer
+ * @param[out] from        Pointer to variable storing the sending role
+ * @param[in]  nr_of_roles Number of roles to receive from
+ * @param[in]  ...         Variable number (subject to nr_of_roles)
+ *                         of role variables
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_poll)
+ */
+int recv_int_any(int *dst, role **from, int nr_of_roles, ...);
+
+
+/**
+ * \brief Receive an integer array from whichever role sends first.
+ *
+ * n consecutive calls with the same n roles receive one array from
+ * each role, in order of arrival (see sc_recv_any).
+ *
+ * @param[out]    arr         Pointer to array storing received integers
+ * @param[in,out] count       Pointer to variable storing number of elements in array
+ * @param[out]    from        Pointer to variable storing the sending role
+ * @param[in]     nr_of_roles Number of roles to receive from
+ * @param[in]     ...         Variable number (subject to nr_of_roles)
+ *                            of role variables
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_poll)
+ */
+int recv_int_array_any(int *arr, size_t *count, role **from, int nr_of_roles, ...);
+
+
+/**
+ * \brief Release a message view obtained by a *_view receive.
+ *
+ * @param[in,out] view Message view to release
+ */
+void sc_view_release(sc_view *view);
+
+
 /**
  * \breif Broadcast an integer.
  *
@@ -115,6 +240,22 @@ int bcast_int(int val, session *s);
 int bcast_int_array(const int arr[], size_t count, session *s);
 
 
+/**
+ * \brief Broadcast an integer array without copying (zero-copy).
+ *
+ * @param[in] arr   Array to send (see send_int_array_nocopy)
+ * @param[in] count Number of elements in array
+ * @param[in] s     Session to broadcast to
+ * @param[in] ffn   Deallocation callback (can be null)
+ * @param[in] hint  Hint passed to ffn
+ * 
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int bcast_int_array_nocopy(int arr[], size_t count, session *s,
+                           sc_free_fn *ffn, void *hint);
+
+
 /**
  * \brief Receive a broadcast integer.
  *
@@ -140,14 +281,376 @@ int brecv_int(int *dst, session *s);
 int brecv_int_array(int *arr, size_t *count, session *s);
 
 
+/**
+ * \brief Receive a broadcast integer array in place (borrowed, no copy).
+ *
+ * @param[out] view Message view to fill in (see recv_int_array_view)
+ * @param[in]  s    Session to receive broadcast from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int brecv_int_array_view(sc_view *view, session *s);
+
+
+/**
+ * \brief Receive a broadcast integer array (allocated by the runtime).
+ *
+ * @param[out] arr   Pointer to newly allocated array (see recv_int_array_alloc)
+ * @param[out] count Pointer to variable storing number of elements in array
+ * @param[in]  s     Session to receive broadcast from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int brecv_int_array_alloc(int **arr, size_t *count, session *s);
+
+
+/**
+ * \brief Send a typed array (generic form of send_<type>_array).
+ *
+ * @param[in] buf       Array to send
+ * @param[in] count     Number of elements in array
+ * @param[in] elem_size Size of an element in bytes
+ * @param[in] type      Element type (SC_TYPE_*)
+ * @param[in] r         Role to send to
+ * @param[in] label     Message label (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int sc_send(const void *buf, size_t count, size_t elem_size, int type,
+            role *r, const char *label);
+
+
+/**
+ * \brief Send a typed array without copying (generic form of send_<type>_array_nocopy).
+ *
+ * @param[in] buf       Array to send (see send_int_array_nocopy)
+ * @param[in] count     Number of elements in array
+ * @param[in] elem_size Size of an element in bytes
+ * @param[in] type      Element type (SC_TYPE_*)
+ * @param[in] r         Role to send to
+ * @param[in] label     Message label (can be null)
+ * @param[in] ffn       Deallocation callback (can be null)
+ * @param[in] hint      Hint passed to ffn
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int sc_send_nocopy(void *buf, size_t count, size_t elem_size, int type,
+                   role *r, const char *label, sc_free_fn *ffn, void *hint);
+
+
+/**
+ * \brief Send a typed array to multiple roles (generic form of vsend_<type>).
+ *
+ * @param[in] buf         Array to send
+ * @param[in] count       Number of elements in array
+ * @param[in] elem_size   Size of an element in bytes
+ * @param[in] type        Element type (SC_TYPE_*)
+ * @param[in] nr_of_roles Number of roles to send to
+ * @param[in] roles       Variable argument list of role variables
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int sc_vsend(const void *buf, size_t count, size_t elem_size, int type,
+             int nr_of_roles, va_list roles);
+
+
+/**
+ * \brief Receive a typed array (generic form of recv_<type>_array).
+ *
+ * @param[out]    buf       Pointer to array storing received value
+ * @param[in,out] count     Pointer to variable storing number of elements in array
+ * @param[in]     elem_size Size of an element in bytes
+ * @param[in]     type      Expected element type (SC_TYPE_*)
+ * @param[in]     r         Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int sc_recv(void *buf, size_t *count, size_t elem_size, int type, role *r);
+
+
+/**
+ * \brief Receive a typed array from whichever of a set of roles sends
+ * first (generic form of recv_<type>_array_any).
+ *
+ * Receives from the same set of roles form a run, in which each role
+ * is received from once: roles already received from in the current
+ * run are not polled. A run ends when all its roles have been received
+ * from, or when a receive from any of a different set of roles starts
+ * a new run. So a role that sends faster than the others cannot supply
+ * two messages of one run.
+ *
+ * @param[out]    buf       Pointer to array storing received value
+ * @param[in,out] count     Pointer to variable storing number of elements in array
+ * @param[in]     elem_size Size of an element in bytes
+ * @param[in]     type      Expected element type (SC_TYPE_*)
+ * @param[out]    from      Pointer to variable storing the sending role
+ * @param[in]     nroles    Number of roles to receive from
+ * @param[in]     roles     Roles to receive from (group roles stand for their
+ *                          connected members)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (ENOTCONN if none of the roles is connected, see man page of zmq_poll)
+ */
+int sc_recv_any(void *buf, size_t *count, size_t elem_size, int type,
+                role **from, int nroles, role *roles[]);
+
+
+/**
+ * \brief Receive a typed array from whichever of a set of roles sends
+ * first (variable argument form of sc_recv_any).
+ *
+ * @param[out]    buf         Pointer to array storing received value
+ * @param[in,out] count       Pointer to variable storing number of elements in array
+ * @param[in]     elem_size   Size of an element in bytes
+ * @param[in]     type        Expected element type (SC_TYPE_*)
+ * @param[out]    from        Pointer to variable storing the sending role
+ * @param[in]     nr_of_roles Number of roles to receive from
+ * @param[in]     roles       Variable argument list of role variables
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_poll)
+ */
+int sc_vrecv_any(void *buf, size_t *count, size_t elem_size, int type,
+                 role **from, int nr_of_roles, va_list roles);
+
+
+/**
+ * \brief Release the receive-from-any state of a session.
+ *
+ * @param[in,out] s Session
+ */
+void sc_recv_any_free(session *s);
+
+
+/**
+ * \brief Receive a typed array in place (generic form of recv_<type>_array_view).
+ *
+ * @param[out] view      Message view to fill in
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Expected element type (SC_TYPE_*)
+ * @param[in]  r         Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (EPROTO if the message type or size does not match,
+ *          see man page of zmq_recv otherwise)
+ */
+int sc_recv_view(sc_view *view, size_t elem_size, int type, role *r);
+
+
+/**
+ * \brief Receive a typed array (generic form of recv_<type>_array_alloc).
+ *
+ * @param[out] buf       Pointer to newly allocated array
+ * @param[out] count     Pointer to variable storing number of elements in array
+ * @param[in]  elem_size Size of an element in bytes
+ * @param[in]  type      Expected element type (SC_TYPE_*)
+ * @param[in]  r         Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (EPROTO if the message type or size does not match,
+ *          see man page of zmq_recv otherwise)
+ */
+int sc_recv_alloc(void **buf, size_t *count, size_t elem_size, int type, role *r);
+
+
+/**
+ * \brief Send a fixed-layout struct.
+ *
+ * The struct is sent as-is (no serialisation), so both endpoints
+ * must share its layout (ie. same definition, compiler and ABI).
+ *
+ * @param[in] ptr   Struct to send
+ * @param[in] size  Size of struct (sizeof)
+ * @param[in] r     Role to send to
+ * @param[in] label Message label (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_struct(const void *ptr, size_t size, role *r, const char *label);
+
+
+/**
+ * \brief Send an array of fixed-layout structs.
+ *
+ * @param[in] arr   Array to send
+ * @param[in] size  Size of struct (sizeof)
+ * @param[in] count Number of elements in array
+ * @param[in] r     Role to send to
+ * @param[in] label Message label (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_struct_array(const void *arr, size_t size, size_t count, role *r, const char *label);
+
+
+/**
+ * \brief Receive a fixed-layout struct (pre-allocated).
+ *
+ * @param[out] dst  Pointer to struct storing received value
+ * @param[in]  size Size of struct (sizeof)
+ * @param[in]  r    Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_struct(void *dst, size_t size, role *r);
+
+
+/**
+ * \brief Receive an array of fixed-layout structs (pre-allocated).
+ *
+ * @param[out]    arr   Pointer to array storing received value
+ * @param[in]     size  Size of struct (sizeof)
+ * @param[in,out] count Pointer to variable storing number of elements in array
+ * @param[in]     r     Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_struct_array(void *arr, size_t size, size_t *count, role *r);
+
+
+/**
+ * \brief Broadcast a fixed-layout struct.
+ *
+ * @param[in] ptr  Struct to send
+ * @param[in] size Size of struct (sizeof)
+ * @param[in] s    Session to broadcast to
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int bcast_struct(const void *ptr, size_t size, session *s);
+
+
+/**
+ * \brief Receive a broadcast fixed-layout struct.
+ *
+ * @param[out] dst  Pointer to struct storing received value
+ * @param[in]  size Size of struct (sizeof)
+ * @param[in]  s    Session to receive broadcast from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int brecv_struct(void *dst, size_t size, session *s);
+
+
+/**
+ * \brief Send a message made of multiple segments (scatter/gather).
+ *
+ * Each segment travels as a separate frame of one message,
+ * without being concatenated into a staging buffer.
+ *
+ * @param[in] iov    Segments to send
+ * @param[in] iovcnt Number of segments
+ * @param[in] r      Role to send to
+ * @param[in] label  Message label (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_iov(const struct iovec iov[], int iovcnt, role *r, const char *label);
+
+
+/**
+ * \brief Send a message made of multiple segments without copying (zero-copy).
+ *
+ * Segments must not be modified until ffn is called for each of them.
+ * If ffn is NULL, ownership of every segment (allocated with malloc)
+ * is transferred and the runtime frees it.
+ *
+ * @param[in] iov    Segments to send
+ * @param[in] iovcnt Number of segments
+ * @param[in] r      Role to send to
+ * @param[in] label  Message label (can be null)
+ * @param[in] ffn    Deallocation callback, called once per segment (can be null)
+ * @param[in] hint   Hint passed to ffn
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_iov_nocopy(const struct iovec iov[], int iovcnt, role *r, const char *label,
+                    sc_free_fn *ffn, void *hint);
+
+
+/**
+ * \brief Receive a message made of multiple segments (pre-allocated).
+ *
+ * Each received segment is copied into the corresponding
+ * buffer, and its length updated to the size received.
+ *
+ * @param[in,out] iov    Segments to receive into
+ * @param[in,out] iovcnt Pointer to variable storing number of segments
+ * @param[in]     r      Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_iov(struct iovec iov[], int *iovcnt, role *r);
+
+
+/**
+ * Element types of the typed primitive family.
+ *
+ * X(name, C type, SC_TYPE_*)
+ */
+#define SC_PRIMITIVE_TYPES(X)           \
+  X(int,    int,     SC_TYPE_INT)       \
+  X(double, double,  SC_TYPE_DOUBLE)    \
+  X(float,  float,   SC_TYPE_FLOAT)     \
+  X(int64,  int64_t, SC_TYPE_INT64)     \
+  X(uint8,  uint8_t, SC_TYPE_UINT8)
+
+
+/**
+ * Declare the typed primitive family of an element type
+ * (see the integer primitives for documentation).
+ */
+#define SC_DECLARE_PRIMITIVES(name, ctype, sctype)                                         \
+  int send_##name(ctype val, role *r, const char *label);                                  \
+  int send_##name##_array(const ctype arr[], size_t count, role *r, const char *label);    \
+  int send_##name##_array_nocopy(ctype arr[], size_t count, role *r, const char *label,    \
+                                 sc_free_fn *ffn, void *hint);                             \
+  int vsend_##name(ctype val, int nr_of_roles, ...);                                       \
+  int recv_##name(ctype *dst, role *r);                                                    \
+  int recv_##name##_array(ctype *arr, size_t *count, role *r);                             \
+  int recv_##name##_array_view(sc_view *view, role *r);                                    \
+  int recv_##name##_array_alloc(ctype **arr, size_t *count, role *r);                      \
+  int recv_##name##_any(ctype *dst, role **from, int nr_of_roles, ...);                    \
+  int recv_##name##_array_any(ctype *arr, size_t *count, role **from, int nr_of_roles, ...); \
+  int bcast_##name(ctype val, session *s);                                                 \
+  int bcast_##name##_array(const ctype arr[], size_t count, session *s);                   \
+  int bcast_##name##_array_nocopy(ctype arr[], size_t count, session *s,                   \
+                                  sc_free_fn *ffn, void *hint);                            \
+  int brecv_##name(ctype *dst, session *s);                                                \
+  int brecv_##name##_array(ctype *arr, size_t *count, session *s);                         \
+  int brecv_##name##_array_view(sc_view *view, session *s);                                \
+  int brecv_##name##_array_alloc(ctype **arr, size_t *count, session *s);
+
+SC_PRIMITIVE_TYPES(SC_DECLARE_PRIMITIVES)
+
+
 /**
  * \brief Barrier synchronisation.
  *
+ * Forwards to sc_barrier() on the session of grp_role, which
+ * synchronises all roles of the session over the p2p endpoints
+ * (the group subscriptions are left untouched). at_rolename is
+ * ignored, the barrier has no central coordinator.
+ *
  * @param[in] grp_role    Group role to perform barrier synchronisation on
- * @param[in] at_rolename Role name (string) to act as central coordinator
+ * @param[in] at_rolename Role name (string), ignored (kept for compatibility)
  *
  * \returns 0 if successful, -1 otherwise and set errno
- *          (See man page of zmq_recv)
  */
 int barrier(role *grp_role, char *at_rolename);
 
@@ -0,0 +1,39 @@
+#ifndef SC__RAWTCP_H__
+#define SC__RAWTCP_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * raw TCP transport module.
+ *
+ * A raw TCP channel connects two roles with a plain TCP connection
+ * (TCP_NODELAY, non-blocking) instead of a ZeroMQ socket. Frames are
+ * prefixed with their length, the frames of a multipart message are
+ * written with a single writev, and as many frames as are available
+ * are read in one go. The sockets of all channels of a ZeroMQ context
+ * are registered with one epoll instance (edge-triggered), which
+ * blocking operations wait on, and which sc_msg_poll waits on along
+ * with ZeroMQ sockets (SC_TRANSPORT_LOOP). Blocking sends receive
+ * ahead while waiting, so that two roles sending to each other
+ * cannot deadlock.
+ *
+ * There is no I/O thread to write in the background, so ZMQ_DONTWAIT
+ * sends only fail with EAGAIN if the connection is not writable when
+ * a message is started. A message that was started is written
+ * completely, waiting for the peer to read the rest if the kernel
+ * buffer fills up (large messages or a slow peer).
+ *
+ * The binding side accepts a single connection on first use, the
+ * connecting side retries until the binding side is listening.
+ * Frames are limited to UINT32_MAX bytes (length prefix).
+ * Endpoints use the channel through sc_transport_rawtcp (see
+ * sc/transport.h), selected with a rawtcp: host prefix.
+ */
+
+#include "sc/transport.h"
+#include "sc/types.h"
+
+#define SC_RAWTCP_BATCH   32          // Largest number of frames written at once
+#define SC_RAWTCP_BUFSIZE (64 * 1024) // Initial size (bytes) of the receive buffer
+
+
+#endif // SC__RAWTCP_H__
@@ -11,9 +11,19 @@
 
 #include "sc/types.h"
 
+#define SC_LINGER_MS        10000 // Longest wait (ms) for unsent messages when a session terminates
+#define SC_READY_INTERVAL_MS 10    // Interval (ms) between group probes of the readiness handshake
+
 /**
  * \brief Initialise a sesssion.
  *
+ * With the -r (--ready) command line option, session_init returns
+ * only when all endpoints are connected (see session_ready).
+ * Connections generated from a hosts file (-s) and global protocol
+ * (-p) link only the roles that interact in the protocol.
+ * A connection configuration (-c) is either text, or binary (as
+ * written by connmgr), of which only the rows of this role are read.
+ *
  * @param[in,out] argc     Command line argument count
  * @param[in,out] argv     Command line argument list
  * @param[out]    s        Pointer to session varible to create
@@ -23,6 +33,38 @@
 void session_init(int *argc, char ***argv, session **s, const char *scribble);
 
 
+/**
+ * \brief Initialise a session of a role running as a thread.
+ *
+ * All roles of the protocol run as threads of the same process and
+ * are connected through inproc endpoints of one shared ZeroMQ context,
+ * no connection configuration is needed. Messages are not copied
+ * between threads by the transport: with the *_nocopy sends and *_view
+ * receives, only a pointer to the data is passed.
+ *
+ * @param[out] s        Pointer to session varible to create
+ * @param[in]  scribble Endpoint Scribble file path for this session
+ *                      (Must be constant string)
+ */
+void session_init_inproc(session **s, const char *scribble);
+
+
+/**
+ * \brief Wait until all endpoints of a session are connected.
+ *
+ * Readiness handshake: every p2p connection exchanges a hello message,
+ * then every role publishes probes on its broadcast socket until each
+ * peer acknowledges one over p2p, so that broadcasts are not lost to
+ * late subscriptions. The setup time of each peer is reported on stderr.
+ * Must be called by all roles before any other communication.
+ *
+ * @param[in] s Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int session_ready(session *s);
+
+
 /**
  * \brief Create a role group.
  *
@@ -39,11 +81,47 @@ role *session_group(session *s, const char *name, int nrole, ...);
 /**
  * \brief Terminate a session.
  *
+ * Outstanding non-blocking sends are completed, then the sockets are
+ * closed and kept until their queued messages are delivered (for at
+ * most SC_LINGER_MS).
+ *
  * @param[in] s Session to terminate
  */
 void session_end(session *s);
 
 
+/**
+ * \brief Terminate a session once all roles have reached termination.
+ *
+ * Performs a barrier (sc_barrier) before session_end, so that no role
+ * closes its sockets while others may still send to it.
+ *
+ * @param[in] s Session to terminate
+ */
+void session_end_sync(session *s);
+
+
+/**
+ * \brief Get the identifier of a message label.
+ *
+ * @param[in] label Message label
+ *
+ * \returns Label identifier as sent on the wire (SC_LABEL_NONE if label is null).
+ */
+sc_label_t sc_label_id(const char *label);
+
+
+/**
+ * \brief Get a message label interned in a session.
+ *
+ * @param[in] s  Session holding the label table
+ * @param[in] id Label identifier
+ *
+ * \returns Interned label (owned by the session), or null if not found.
+ */
+const char *sc_label_name(const session *s, sc_label_t id);
+
+
 /**
  * \brief Dump content of an established session.
  *  
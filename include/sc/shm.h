@@ -0,0 +1,109 @@
+#ifndef SC__SHM_H__
+#define SC__SHM_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * shared memory transport module.
+ *
+ * A shared memory channel connects two co-located roles through a
+ * POSIX shared memory region holding two lock-free single-producer,
+ * single-consumer ring buffers, one per direction. Frames are copied
+ * into the ring by the sender and out of it by the receiver, without
+ * going through the kernel.
+ *
+ * The region is created by the connecting side of the p2p connection,
+ * which sends its name as the only message over the ZeroMQ socket of
+ * the endpoint. The binding side attaches on first use, and removes
+ * the name so that nothing is left behind once both sides are done.
+ *
+ * Endpoints use the channel through sc_transport_shm (see
+ * sc/transport.h), selected with a shm: host prefix.
+ */
+
+#include <zmq.h>
+
+#include "sc/types.h"
+
+#define SC_SHM_RING_SIZE (1024 * 1024) // Capacity (bytes) of each direction of a channel, power of 2
+
+
+/**
+ * \brief Create the shared memory channel of an endpoint
+ * (connecting side).
+ *
+ * @param[in,out] ep Endpoint (connected ZeroMQ socket)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_shm_create(struct role_endpoint *ep);
+
+
+/**
+ * \brief Prepare to attach to the shared memory channel of an
+ * endpoint (binding side), the channel is attached on first use.
+ *
+ * @param[in,out] ep Endpoint (bound ZeroMQ socket)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_shm_accept(struct role_endpoint *ep);
+
+
+/**
+ * \brief Send a frame through the shared memory channel of an endpoint.
+ *
+ * Follows zmq_msg_send: ZMQ_DONTWAIT fails with EAGAIN if the frame
+ * does not fit. Frames larger than half the ring are sent in chunks,
+ * and cannot be in the ring at once: for these ZMQ_DONTWAIT only
+ * applies to the first chunk, the others wait for space.
+ * The frame is copied and left to the caller to close.
+ * While waiting for space, frames from the peer are received ahead,
+ * so that two roles sending to each other cannot deadlock.
+ *
+ * @param[in,out] ep    Endpoint
+ * @param[in]     frame Frame to send
+ * @param[in]     flags ZeroMQ send flags
+ *
+ * \returns Size of the frame if successful, -1 otherwise and set errno
+ */
+int sc_shm_send(struct role_endpoint *ep, zmq_msg_t *frame, int flags);
+
+
+/**
+ * \brief Receive a frame from the shared memory channel of an endpoint.
+ *
+ * Follows zmq_msg_recv: ZMQ_DONTWAIT fails with EAGAIN if no frame
+ * is available.
+ *
+ * @param[in,out] ep    Endpoint
+ * @param[out]    frame Initialised frame to receive into
+ * @param[in]     flags ZeroMQ receive flags
+ *
+ * \returns Size of the frame if successful, -1 otherwise and set errno
+ */
+int sc_shm_recv(struct role_endpoint *ep, zmq_msg_t *frame, int flags);
+
+
+/**
+ * \brief Check readiness of the shared memory channel of an endpoint.
+ *
+ * @param[in,out] ep     Endpoint
+ * @param[in]     events Events to check (SC_POLLIN and/or SC_POLLOUT)
+ *
+ * \returns Events ready
+ */
+short sc_shm_poll(struct role_endpoint *ep, short events);
+
+
+/**
+ * \brief Release the shared memory channel of an endpoint.
+ *
+ * The region name is unlinked on both sides, what a binding side yet
+ * to attach was sent is dropped.
+ *
+ * @param[in,out] ep Endpoint
+ */
+void sc_shm_close(struct role_endpoint *ep);
+
+
+#endif // SC__SHM_H__
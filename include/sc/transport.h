@@ -0,0 +1,115 @@
+#ifndef SC__TRANSPORT_H__
+#define SC__TRANSPORT_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * transport module.
+ *
+ * Every endpoint carries its frames through a transport, a table of
+ * operations (connection setup, send, receive, poll and close) used
+ * by the message layer instead of calling ZeroMQ directly. Transports
+ * are chosen per connection from the host of the connection
+ * configuration, prefixed with the name of the transport
+ * (eg. shm:localhost), ZeroMQ otherwise.
+ */
+
+#include <zmq.h>
+
+#include "sc/types.h"
+
+// Transport capabilities.
+#define SC_TRANSPORT_WAIT   0x1 // Endpoints can be waited on with zmq_poll (see pollitem)
+#define SC_TRANSPORT_NOCOPY 0x2 // Zero-copy frames are passed to the peer without copying
+#define SC_TRANSPORT_LOCAL  0x4 // Peers on the same host only
+#define SC_TRANSPORT_LOOP   0x8 // pollitem is an event loop shared by endpoints, poll tells which is ready
+
+
+/**
+ * A transport.
+ *
+ * Send and receive follow zmq_msg_send and zmq_msg_recv, and poll
+ * checks readiness without blocking (SC_POLLIN and/or SC_POLLOUT).
+ */
+struct sc_transport
+{
+  const char *name; // Host prefix in connection configuration
+  int caps;         // SC_TRANSPORT_* capabilities
+
+  int (*bind)(struct role_endpoint *ep, void *ctx);    // Listen on ep->uri
+  int (*connect)(struct role_endpoint *ep, void *ctx); // Connect to ep->uri
+  int (*send)(struct role_endpoint *ep, zmq_msg_t *frame, int flags);
+  int (*recv)(struct role_endpoint *ep, zmq_msg_t *frame, int flags);
+  short (*poll)(struct role_endpoint *ep, short events);
+  int (*pollitem)(struct role_endpoint *ep, zmq_pollitem_t *item); // SC_TRANSPORT_WAIT only, -1 if not connected
+  int (*close)(struct role_endpoint *ep);
+};
+
+extern const struct sc_transport sc_transport_zmq;    // ZeroMQ PAIR socket (tcp:// or ipc://)
+extern const struct sc_transport sc_transport_inproc; // ZeroMQ PAIR socket (inproc://)
+extern const struct sc_transport sc_transport_shm;    // Shared memory channel (see sc/shm.h)
+extern const struct sc_transport sc_transport_rawtcp; // Plain TCP connection (see sc/rawtcp.h)
+
+
+/**
+ * \brief Find the transport of a connection.
+ *
+ * @param[in] host Host of the connection (connection configuration)
+ *
+ * \returns Transport named by the host prefix, sc_transport_zmq if none
+ */
+const struct sc_transport *sc_transport_find(const char *host);
+
+
+/**
+ * \brief Back off while busy-polling endpoints that cannot be waited
+ * on (transports without SC_TRANSPORT_WAIT).
+ *
+ * Yields the processor at first, then sleeps briefly.
+ *
+ * @param[in,out] spins Number of times waited so far (0 initially)
+ */
+void sc_transport_wait(int *spins);
+
+
+/**
+ * \brief Create and bind the ZeroMQ socket of an endpoint.
+ *
+ * For transports layered on a ZeroMQ socket.
+ *
+ * @param[in,out] ep   Endpoint (ep->uri to bind to)
+ * @param[in]     ctx  ZeroMQ context
+ * @param[in]     type ZeroMQ socket type
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_transport_zmq_bind(struct role_endpoint *ep, void *ctx, int type);
+
+
+/**
+ * \brief Connect the ZeroMQ socket of an endpoint (created first
+ * if the endpoint has none).
+ *
+ * inproc:// connections are retried until the peer has bound.
+ * For transports layered on a ZeroMQ socket.
+ *
+ * @param[in,out] ep   Endpoint (ep->uri to connect to)
+ * @param[in]     ctx  ZeroMQ context
+ * @param[in]     type ZeroMQ socket type
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_transport_zmq_connect(struct role_endpoint *ep, void *ctx, int type);
+
+
+/**
+ * \brief Close the ZeroMQ socket of an endpoint, keeping it until its
+ * queued messages are delivered for at most SC_LINGER_MS.
+ *
+ * @param[in,out] ep Endpoint
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ */
+int sc_transport_zmq_close(struct role_endpoint *ep);
+
+
+#endif // SC__TRANSPORT_H__
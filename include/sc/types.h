@@ -6,16 +6,74 @@
  * type definitions.
  */
 
+#include <stddef.h>
+
 #define SESSION_ROLE_P2P     0
 #define SESSION_ROLE_GRP     1
 #define SESSION_ROLE_INDEXED 2
 
+// Element types of a message.
+#define SC_TYPE_NONE   0
+#define SC_TYPE_INT    1
+#define SC_TYPE_DOUBLE 2
+#define SC_TYPE_FLOAT  3
+#define SC_TYPE_INT64  4
+#define SC_TYPE_UINT8  5
+#define SC_TYPE_STRUCT 6
+
+
+/**
+ * Deallocation callback of a zero-copy buffer.
+ *
+ * Invoked by the runtime (possibly from a ZeroMQ I/O thread)
+ * once the buffer is no longer referenced (cf. zmq_free_fn).
+ */
+typedef void (sc_free_fn)(void *data, void *hint);
+
+
+/**
+ * A received message borrowed from the runtime.
+ *
+ * data points directly into the receive buffer of the
+ * message and stays valid until released with sc_view_release().
+ */
+typedef struct {
+  void *data;
+  size_t size;  // Size of data in bytes
+  size_t count; // Number of elements in data
+
+  void *msg;    // Underlying message (zmq_msg_t)
+} sc_view;
+
+
+/**
+ * A message label identifier.
+ *
+ * Labels are sent as fixed-width identifiers derived from the
+ * message operator (see sc_label_id() and scribble-tool --labels).
+ */
+typedef unsigned int sc_label_t;
+
+#define SC_LABEL_NONE 0 // Unlabelled message
+
+
+struct sc_transport;
 
 struct role_endpoint
 {
   char *name;
   void *ptr;
   char uri[6+255+7]; // tcp:// + FQDN + :port + \0
+
+  void *pending; // Message received ahead (by probe_label)
+  unsigned int seq_out; // Sequence number of next message sent
+  unsigned int seq_in;  // Sequence number of next message expected
+
+  void *sendq; // Outstanding non-blocking sends (in order)
+  void *recvq; // Outstanding non-blocking receives (in order)
+
+  const struct sc_transport *transport; // Transport of frames (sc/transport.h)
+  void *chan; // State of the transport (eg. shared memory channel), NULL for ZeroMQ
 };
 
 struct role_group
@@ -50,6 +108,25 @@ struct role_t
 
 typedef struct role_t role;
 
+
+/**
+ * An interned message label.
+ */
+struct session_label
+{
+  sc_label_t id;
+  char *name;
+};
+
+/**
+ * A point-to-point connection between two roles of a session.
+ */
+struct session_link
+{
+  char *from;
+  char *to;
+};
+
 /**
  * An endpoint session.
  *
@@ -65,8 +142,32 @@ struct session_t
   // Lookup function.
   role *(*r)(struct session_t *, char *);
 
+  // Role lookup table (hashed role names, open addressing).
+  unsigned int nslot;
+  role **role_table;
+
+  // Group role of all other roles (_Others).
+  role *others;
+
+  // Point-to-point connections between all roles of the session
+  // (not only this role), the communication graph of the protocol.
+  // NULL if every pair of roles is connected.
+  unsigned int nlink;
+  struct session_link *links;
+
+  // Ranks for collective operations (built on first use).
+  void *comm;
+
+  // Current run of receives from any role (see sc_recv_any).
+  void *any;
+
+  // Interned message labels (sorted by id).
+  unsigned int nlabel;
+  struct session_label *labels;
+
   // Extra data.
   void *ctx;
+  int inproc; // Roles are threads of this process (shared ctx)
 };
 
 typedef struct session_t session;
@@ -219,6 +219,29 @@ st_node *st_node_init(st_node *node, int type);
 st_node *st_node_append(st_node *node, st_node *child);
 
 
+/**
+ * \brief Append the receives of a run of receives from any role.
+ *
+ * At runtime, a run of nrole consecutive receives from any of the
+ * same nrole roles receives exactly one message from each role, in
+ * order of arrival. Receives from different roles can be reordered,
+ * so a complete run is appended as one receive from each role (in
+ * the order of roles). An incomplete run does not have a session
+ * type and is appended as a receive from __ANY__, which matches no
+ * protocol.
+ *
+ * @param[in,out] node    Parent node.
+ * @param[in]     roles   Roles of the run.
+ * @param[in]     nrole   Number of roles of the run.
+ * @param[in]     payload Payload type of the receives.
+ * @param[in]     nrecv   Number of receives in the run.
+ *
+ * \returns 1 if the run is complete, 0 otherwise.
+ */
+int st_node_append_recv_any(st_node *node, const char *roles[], int nrole,
+                            const char *payload, int nrecv);
+
+
 /**
  * \brief Print a st_tree with meta information.
  * 
@@ -275,6 +298,19 @@ int st_node_compare_r(st_node *node, st_node *other);
 int st_node_compare_msgsig(const st_node_msgsig_t msgsig, const st_node_msgsig_t other);
 
 
+/**
+ * \brief Compute the identifier of a message operator (label).
+ *
+ * The identifier is a 32-bit FNV-1a hash of the operator, so all
+ * endpoints derive the same identifier independently.
+ *
+ * @param[in] op Message operator.
+ *
+ * \returns Identifier of the operator (never 0).
+ */
+unsigned int st_node_msgsig_id(const char *op);
+
+
 /**
  * \brief Compare two st_nodes.
  *
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <connmgr.h>
+#include <sc/utils.h>
+
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <roles> <hosts> [neighbours]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int R = atoi(argv[1]); // Number of roles
+  int H = atoi(argv[2]); // Number of hosts
+  int K = (argc > 3) ? atoi(argv[3]) : 0; // Roles each role talks to (0: all)
+  printf("roles: %d, hosts: %d, neighbours: %d\n", R, H, K);
+
+  char **roles = (char **)malloc(sizeof(char *) * R);
+  char **hosts = (char **)malloc(sizeof(char *) * H);
+  traffic_edge *traffic = NULL;
+  int ntraffic = 0;
+  int flags = 0;
+  int i, k;
+
+  for (i=0; i<R; i++) {
+    roles[i] = (char *)malloc(16);
+    sprintf(roles[i], "W%d", i);
+  }
+  for (i=0; i<H; i++) {
+    hosts[i] = (char *)malloc(16);
+    sprintf(hosts[i], "node%d", i);
+  }
+
+  // Worker array: each role talks to the next K roles (wrapping around).
+  if (K > 0) {
+    traffic = (traffic_edge *)malloc(sizeof(traffic_edge) * ((size_t)R * K + 1));
+    for (i=0; i<R; i++) {
+      for (k=1; k<=K && 2*k<=R; k++) {
+        if (2*k == R && i >= k) continue; // Pair listed from its other end.
+        traffic[ntraffic].from   = (i < (i + k) % R) ? i : (i + k) % R;
+        traffic[ntraffic].to     = (i < (i + k) % R) ? (i + k) % R : i;
+        traffic[ntraffic].weight = 1.0;
+        ntraffic++;
+      }
+    }
+    flags = CONNMGR_PRUNE;
+  }
+
+  conn_rec *conns;
+  host_map *role_hosts;
+  connmgr_arena *strings = NULL;
+
+  long long start_time = sc_time();
+  int nconns = connmgr_init(&conns, &role_hosts, roles, R, hosts, H, 6666, traffic, ntraffic, flags, &strings);
+  long long end_time = sc_time();
+
+  printf("%d connections, connmgr_init time elapsed: %f sec\n", nconns, sc_time_diff(start_time, end_time));
+
+  start_time = sc_time();
+  connmgr_write("genconf.conf", conns, nconns, role_hosts, R);
+  end_time = sc_time();
+
+  printf("connmgr_write time elapsed: %f sec\n", sc_time_diff(start_time, end_time));
+
+  start_time = sc_time();
+  connmgr_write_bin("genconf.bin", conns, nconns, role_hosts, R);
+  end_time = sc_time();
+
+  printf("connmgr_write_bin time elapsed: %f sec\n", sc_time_diff(start_time, end_time));
+
+  // What each role does at session_init: read the whole text
+  // configuration, or map the binary one and take its own rows.
+  conn_rec *rows;
+  host_map *rows_hosts;
+  connmgr_arena *rows_strings = NULL;
+  conn_config config;
+  int nrows, nroles;
+
+  start_time = sc_time();
+  nrows = connmgr_read("genconf.conf", &rows, &rows_hosts, &nroles, &rows_strings);
+  end_time = sc_time();
+
+  printf("%d rows, connmgr_read time elapsed: %f sec\n", nrows, sc_time_diff(start_time, end_time));
+  free(rows);
+  free(rows_hosts);
+  connmgr_arena_free(rows_strings);
+
+  start_time = sc_time();
+  if (connmgr_map("genconf.bin", &config) != 0) {
+    perror("connmgr_map");
+    return EXIT_FAILURE;
+  }
+  nrows = connmgr_map_rows(&config, roles[R / 2], &rows);
+  end_time = sc_time();
+
+  printf("%d rows of %s, connmgr_map time elapsed: %f sec\n", nrows, roles[R / 2], sc_time_diff(start_time, end_time));
+  free(rows);
+  connmgr_unmap(&config);
+
+  for (i=0; i<R; i++) free(roles[i]);
+  for (i=0; i<H; i++) free(hosts[i]);
+  free(roles);
+  free(hosts);
+  free(traffic);
+  free(conns);
+  free(role_hosts);
+  connmgr_arena_free(strings);
+
+  return EXIT_SUCCESS;
+}
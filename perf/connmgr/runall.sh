@@ -0,0 +1,13 @@
+#!/bin/sh
+
+echo All pairs, 1k roles
+echo
+./genconf 1000 16
+echo
+echo Worker array, 1k roles
+echo
+./genconf 1000 16 2
+echo
+echo Worker array, 10k roles
+echo
+./genconf 10000 16 2
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+# Both roles as threads of one process.
+./sc_inproc $*
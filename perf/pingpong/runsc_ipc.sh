@@ -1,4 +1,4 @@
 #!/bin/sh
 
-./a -p Pingpong.spr -s hostfile $* &
-./b -p Pingpong.spr -s hostfile $*
+./a -c connection_ipc.conf $* &
+./b -c connection_ipc.conf $*
@@ -0,0 +1,5 @@
+#!/bin/sh
+
+# p2p connection over a plain TCP connection (no ZeroMQ).
+./a -c connection_rawtcp.conf $* &
+./b -c connection_rawtcp.conf $*
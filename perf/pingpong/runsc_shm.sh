@@ -0,0 +1,5 @@
+#!/bin/sh
+
+# Roles on the same host are connected through shared memory by connmgr.
+./a -p Pingpong.spr -s hostfile $* &
+./b -p Pingpong.spr -s hostfile $*
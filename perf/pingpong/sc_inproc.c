@@ -0,0 +1,72 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sc.h>
+
+static int M; // Number of integers per message
+static int N; // Number of iterations
+
+
+// Release a received message once it has been sent on.
+static void release_view(void *data, void *hint)
+{
+  sc_view_release((sc_view *)hint);
+  free(hint);
+}
+
+
+static void *run(void *arg)
+{
+  session *s;
+
+  session_init_inproc(&s, (const char *)arg);
+
+  int initiator = (strcmp(s->name, "A") == 0);
+  role *peer = s->r(s, initiator ? "B" : "A");
+
+  long long start_time = sc_time();
+
+  if (initiator) {
+    int *val = (int *)calloc(M, sizeof(int));
+    send_int_array_nocopy(val, (size_t)M, peer, NULL, NULL, NULL);
+  }
+
+  // Bounce the received array back without copying (only the pointer is passed).
+  int i;
+  for (i=0; i<N; i++) {
+    sc_view *view = (sc_view *)malloc(sizeof(sc_view));
+    recv_int_array_view(view, peer);
+    if (initiator && i == N-1) {
+      release_view(view->data, view);
+    } else {
+      send_int_array_nocopy((int *)view->data, view->count, peer, NULL, release_view, view);
+    }
+  }
+
+  long long end_time = sc_time();
+
+  printf("%s: Time elapsed: %f sec\n", s->name, sc_time_diff(start_time, end_time));
+
+  session_end(s);
+
+  return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3) return EXIT_FAILURE;
+  M = atoi(argv[1]);
+  N = atoi(argv[2]);
+  printf("M: %d, N: %d\n", M, N);
+
+  pthread_t a, b;
+  pthread_create(&b, NULL, run, "Pingpong_B.spr");
+  pthread_create(&a, NULL, run, "Pingpong_A.spr");
+  pthread_join(a, NULL);
+  pthread_join(b, NULL);
+
+  return EXIT_SUCCESS;
+}
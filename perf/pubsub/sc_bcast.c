@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sc.h>
+
+#ifndef PROTOCOL_FILE
+#define PROTOCOL_FILE "Bcast_P0.spr"
+#endif
+
+
+int main(int argc, char *argv[])
+{
+  session *s;
+
+  session_init(&argc, &argv, &s, PROTOCOL_FILE);
+
+  if (argc < 3) return EXIT_FAILURE;
+  int M = atoi(argv[1]); // Number of integers per broadcast
+  int N = atoi(argv[2]); // Number of iterations
+  printf("M: %d, N: %d\n", M, N);
+
+  const int algs[] = { SC_COLL_PUB, SC_COLL_TREE, SC_COLL_RING, SC_COLL_AUTO };
+  const char *alg_names[] = { "pub", "tree", "ring", "auto" };
+
+  int *val = (int *)calloc(M, sizeof(int));
+
+  // Warm up the p2p connections, and give SUB sockets
+  // time to subscribe (PUB drops messages until then).
+  coll_bcast_int_array(val, M, "P0", s);
+  sleep(1);
+
+  int a, i;
+  for (a=0; a<4; a++) {
+    coll_bcast_int_array(val, M, "P0", s);
+
+    long long start_time = sc_time();
+    for (i=0; i<N; i++) {
+      sc_bcast_alg(val, M, sizeof(int), SC_TYPE_INT, "P0", s, algs[a]);
+    }
+    long long end_time = sc_time();
+
+    printf("%s: %s bcast time elapsed: %f sec\n", s->name, alg_names[a], sc_time_diff(start_time, end_time));
+  }
+
+  free(val);
+  session_end(s);
+
+  return EXIT_SUCCESS;
+}
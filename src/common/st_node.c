@@ -194,6 +194,42 @@ st_node *st_node_append(st_node *node, st_node *child)
 }
 
 
+/**
+ * \brief Helper function to create a receive node.
+ *
+ */
+static st_node *_recv_node(const char *from, const char *payload)
+{
+  st_node *node = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_RECV);
+  node->interaction->from = strdup(from);
+  node->interaction->nto = 0;
+  node->interaction->to = NULL;
+  node->interaction->msgsig.op = NULL;
+  node->interaction->msgsig.payload = strdup(payload);
+
+  return node;
+}
+
+
+int st_node_append_recv_any(st_node *node, const char *roles[], int nrole,
+                            const char *payload, int nrecv)
+{
+  int i;
+  assert(node != NULL);
+
+  if (nrole <= 0 || nrecv != nrole) {
+    st_node_append(node, _recv_node("__ANY__", payload));
+    return 0;
+  }
+
+  for (i=0; i<nrole; ++i) {
+    st_node_append(node, _recv_node(roles[i], payload));
+  }
+
+  return 1;
+}
+
+
 void st_tree_print(const st_tree *tree)
 {
   int i;
@@ -580,6 +616,19 @@ int st_node_compare_msgsig(const st_node_msgsig_t msgsig, const st_node_msgsig_t
 }
 
 
+unsigned int st_node_msgsig_id(const char *op)
+{
+  unsigned int id = 2166136261u; // FNV-1a offset basis
+  assert(op != NULL);
+  while (*op != '\0') {
+    id ^= (unsigned char)*op++;
+    id = (id * 16777619u) & 0xffffffffu; // FNV-1a prime
+  }
+
+  return (id == 0) ? 1 : id; // 0 is reserved for unlabelled messages
+}
+
+
 int st_node_compare(st_node *node, st_node *other)
 {
   int identical = 1;
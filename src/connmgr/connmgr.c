@@ -6,11 +6,16 @@
  *
  */
 
-#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "connmgr.h"
 #include "st_node.h"
@@ -18,34 +23,152 @@
 extern int yyparse(st_tree *t);
 extern FILE *yyin;
 
+// A hashed table of names (open addressing), from name to value.
+typedef struct {
+  unsigned int nslot;  // Number of slots (power of 2)
+  unsigned int count;  // Number of names
+  const char **names;  // Name in each slot (NULL if empty)
+  int *values;
+} name_table;
+
+// A hashed table of pairs of indices (open addressing), from pair to value.
+typedef struct {
+  unsigned int nslot;  // Number of slots (power of 2)
+  unsigned int count;  // Number of pairs
+  uint64_t *keys;      // Pair in each slot (0 if empty, cf. pair_key)
+  double *values;
+} pair_table;
+
+// A role of a cluster of roles to place on one host.
+typedef struct {
+  int size;    // Number of roles in the cluster
+  int cluster;
+  int role;
+} cluster_role;
+
+// A move of a role that reduces the cross-host traffic.
+typedef struct {
+  int from;    // Host of the role
+  int to;      // Host the role talks to most
+  double gain;
+  int role;
+} role_move;
+
+// Placement of roles on hosts, refined by moving roles (cf. place_roles).
+typedef struct {
+  int *placement;     // Host of each role
+  int *load;          // Number of roles on each host
+  int *adj_off;       // Peers of role r are adj[adj_off[r]..adj_off[r+1]-1]
+  int *adj;
+  double *adj_w;      // Traffic with each peer
+  pair_table sums;    // Traffic between each role and the roles on each host
+  pair_table weights; // Traffic between each pair of roles (lower index first)
+} placement_state;
+
+
+/**
+ * Copy a string into a string arena.
+ */
+char *connmgr_strdup(connmgr_arena **strings, const char *str)
+{
+  size_t len = strlen(str) + 1;
+  size_t size;
+  connmgr_arena *block = *strings;
+
+  if (block == NULL || block->used + len > block->size) {
+    // Blocks double in size, so there are few of them.
+    size = (block == NULL) ? CONNMGR_ARENA_SIZE : 2 * block->size;
+    while (size < len) {
+      size *= 2;
+    }
+    block = (connmgr_arena *)malloc(sizeof(connmgr_arena) + size);
+    block->prev = *strings;
+    block->size = size;
+    block->used = 0;
+    *strings = block;
+  }
+
+  memcpy(block->data + block->used, str, len);
+  block->used += len;
+
+  return block->data + block->used - len;
+}
+
+
+/**
+ * Free all blocks of a string arena.
+ */
+void connmgr_arena_free(connmgr_arena *strings)
+{
+  connmgr_arena *prev;
+
+  while (strings != NULL) {
+    prev = strings->prev;
+    free(strings);
+    strings = prev;
+  }
+}
+
+
+/**
+ * Read a whitespace separated token of any length into buf
+ * (grown as needed), returns its length or -1 at end of file.
+ */
+static int read_token(FILE *fp, char **buf, size_t *size)
+{
+  int c;
+  size_t len = 0;
+
+  while ((c = getc(fp)) != EOF && isspace(c));
+  if (c == EOF) return -1;
+
+  do {
+    if (len + 1 >= *size) {
+      *size = (*size == 0) ? 64 : 2 * *size;
+      *buf = (char *)realloc(*buf, *size);
+    }
+    (*buf)[len++] = c;
+  } while ((c = getc(fp)) != EOF && !isspace(c));
+  (*buf)[len] = '\0';
+
+  return len;
+}
+
 
 /**
  * Load a hosts file (ie. sequential list of hosts) into memory.
  */
-int connmgr_load_hosts(const char *hostsfile, char ***hosts)
+int connmgr_load_hosts(const char *hostsfile, char ***hosts, connmgr_arena **strings)
 {
 #ifdef __DEBUG__
   fprintf(stderr, "%s(%s)\n", __FUNCTION__, hostsfile);
 #endif
   FILE *hosts_fp;
   int host_idx = 0;
-  char buf[MAX_HOSTNAME_LENGTH]; // XXX: Potential buffer overflow.
+  int nslot = 16;
+  char *buf = NULL;
+  size_t size = 0;
 
-  *hosts = malloc(sizeof(char *) * MAX_NR_OF_ROLES);
+  *hosts = NULL;
 
   if ((hosts_fp = fopen(hostsfile, "r")) == NULL) {
     perror(__FUNCTION__);
     return 0;
   }
-  while (fscanf(hosts_fp, "%s", buf) != EOF && host_idx < MAX_NR_OF_ROLES) {
-    (*hosts)[host_idx] = malloc(sizeof(char) * MAX_HOSTNAME_LENGTH); // XXX
-    strncpy((*hosts)[host_idx], buf, MAX_HOSTNAME_LENGTH-1);
+  *hosts = malloc(sizeof(char *) * nslot);
+  while (read_token(hosts_fp, &buf, &size) >= 0) {
+    if (host_idx == nslot) {
+      nslot *= 2;
+      *hosts = realloc(*hosts, sizeof(char *) * nslot);
+    }
+    (*hosts)[host_idx] = connmgr_strdup(strings, buf);
 #ifdef __DEBUG__
     fprintf(stderr, "%s: host#%d %s\n", __FUNCTION__, host_idx, (*hosts)[host_idx]);
 #endif
     host_idx++;
   }
   fclose(hosts_fp);
+  free(buf);
 
   return host_idx;
 }
@@ -55,13 +178,12 @@ int connmgr_load_hosts(const char *hostsfile, char ***hosts)
  * Load and parse a global Scribble to extract the roles into memory.
  *
  */
-int connmgr_load_roles(const char *scribble, char ***roles)
+int connmgr_load_roles(const char *scribble, char ***roles, connmgr_arena **strings)
 {
 #ifdef __DEBUG__
   fprintf(stderr, "%s(%s)\n", __FUNCTION__, scribble);
 #endif
-  // XXX Size of roles[] is MAX_NR_OF_ROLES
-  *roles = malloc(sizeof(char *) * MAX_NR_OF_ROLES);
+  *roles = NULL;
   st_tree *tree = st_tree_init((st_tree *)malloc(sizeof(st_tree)));
   if ((yyin = fopen(scribble, "r")) == NULL) {
     perror(__FUNCTION__);
@@ -80,9 +202,9 @@ int connmgr_load_roles(const char *scribble, char ***roles)
   }
 
   int i;
+  *roles = malloc(sizeof(char *) * (tree->info->nrole + 1));
   for (i=0; i<tree->info->nrole; ++i) {
-    (*roles)[i] = (char *)calloc(sizeof(char), strlen(tree->info->roles[i])+1);
-    strcpy((*roles)[i], tree->info->roles[i]);
+    (*roles)[i] = connmgr_strdup(strings, tree->info->roles[i]);
   }
 
   free(tree);
@@ -91,126 +213,842 @@ int connmgr_load_roles(const char *scribble, char ***roles)
 
 
 /**
- * Initialise Connection manager with given roles and hosts list.
+ * Slot of a name in a name table, or the empty slot to insert it at.
  */
-int connmgr_init(conn_rec **conns, host_map **role_hosts,
-                 char **roles, int roles_count,
-                 char **hosts, int hosts_count,
-                 int start_port)
+static unsigned int name_slot(const name_table *table, const char *name)
+{
+  unsigned int slot;
+  unsigned int mask = table->nslot - 1;
+
+  // Linear probing from the hashed name.
+  for (slot = st_node_msgsig_id(name) & mask; table->names[slot] != NULL; slot = (slot+1) & mask) {
+    if (strcmp(table->names[slot], name) == 0) break;
+  }
+
+  return slot;
+}
+
+
+/**
+ * Initialise a name table for count names (grown as needed).
+ */
+static void name_table_init(name_table *table, int count)
+{
+  // At most half full, so probe sequences stay short.
+  table->nslot = 4;
+  while (table->nslot < 2 * count) {
+    table->nslot <<= 1;
+  }
+  table->count  = 0;
+  table->names  = (const char **)calloc(table->nslot, sizeof(char *));
+  table->values = (int *)malloc(sizeof(int) * table->nslot);
+}
+
+
+/**
+ * Slot of a name in a name table, added with value if not found.
+ * Names are not copied.
+ */
+static unsigned int name_table_add(name_table *table, const char *name, int value)
+{
+  name_table old = *table;
+  unsigned int slot = name_slot(table, name);
+  unsigned int old_slot;
+
+  if (table->names[slot] != NULL) return slot;
+
+  if (2 * (table->count + 1) > table->nslot) { // Rehash into twice the slots.
+    name_table_init(table, table->nslot);
+    for (old_slot=0; old_slot<old.nslot; ++old_slot) {
+      if (old.names[old_slot] == NULL) continue;
+      slot = name_slot(table, old.names[old_slot]);
+      table->names[slot]  = old.names[old_slot];
+      table->values[slot] = old.values[old_slot];
+    }
+    table->count = old.count;
+    free(old.names);
+    free(old.values);
+    slot = name_slot(table, name);
+  }
+
+  table->names[slot]  = name;
+  table->values[slot] = value;
+  table->count++;
+
+  return slot;
+}
+
+
+/**
+ * Value of a name in a name table, added with value if not found.
+ * Names are not copied.
+ */
+static int *name_table_get(name_table *table, const char *name, int value)
+{
+  return &table->values[name_table_add(table, name, value)];
+}
+
+
+/**
+ * Copy of a string in a string arena, shared by equal strings
+ * (interned in table).
+ */
+static char *intern(name_table *table, const char *str, connmgr_arena **strings)
+{
+  unsigned int slot = name_slot(table, str);
+
+  if (table->names[slot] == NULL) {
+    slot = name_table_add(table, connmgr_strdup(strings, str), 0);
+  }
+
+  return (char *)table->names[slot];
+}
+
+
+/**
+ * Free a name table (not the names).
+ */
+static void name_table_free(name_table *table)
+{
+  free(table->names);
+  free(table->values);
+}
+
+
+/**
+ * Index of a role in a table of roles (-1 if not found).
+ */
+static int role_index(const name_table *role_table, const char *role)
+{
+  unsigned int slot = name_slot(role_table, role);
+
+  return (role_table->names[slot] == NULL) ? -1 : role_table->values[slot];
+}
+
+
+/**
+ * Add the interactions under a node to a growing array of ntraffic
+ * traffic edges (one per interaction), each weighted by weight.
+ */
+static void count_traffic(const st_node *node, double weight, traffic_edge **traffic, int *ntraffic, int *nslot,
+                          const name_table *role_table)
+{
+  int from_idx, to_idx, i;
+
+  if (node == NULL) return;
+
+  switch (node->type) {
+    case ST_NODE_SENDRECV:
+      from_idx = role_index(role_table,
+          (ST_ROLE_PARAMETRISED == node->interaction->from_type) ? node->interaction->p_from->name : node->interaction->from);
+      for (i=0; i<node->interaction->nto; ++i) {
+        to_idx = role_index(role_table,
+            (ST_ROLE_PARAMETRISED == node->interaction->to_type) ? node->interaction->p_to[i]->name : node->interaction->to[i]);
+        if (from_idx < 0 || to_idx < 0 || from_idx == to_idx) continue;
+        if (*ntraffic == *nslot) {
+          *nslot *= 2;
+          *traffic = (traffic_edge *)realloc(*traffic, sizeof(traffic_edge) * (*nslot));
+        }
+        (*traffic)[*ntraffic].from   = (from_idx < to_idx) ? from_idx : to_idx;
+        (*traffic)[*ntraffic].to     = (from_idx < to_idx) ? to_idx : from_idx;
+        (*traffic)[*ntraffic].weight = weight;
+        (*ntraffic)++;
+      }
+      return;
+    case ST_NODE_RECUR: // Loop bodies are assumed to run many times.
+      weight *= CONNMGR_REC_WEIGHT;
+      break;
+    case ST_NODE_CHOICE: // Only one branch is taken.
+      if (node->nchild > 0) weight /= node->nchild;
+      break;
+  }
+
+  for (i=0; i<node->nchild; ++i) {
+    count_traffic(node->children[i], weight, traffic, ntraffic, nslot, role_table);
+  }
+}
+
+
+/**
+ * Compare traffic edges by roles.
+ */
+static int compare_edges(const void *a, const void *b)
+{
+  const traffic_edge *ea = (const traffic_edge *)a;
+  const traffic_edge *eb = (const traffic_edge *)b;
+
+  if (ea->from != eb->from) return ea->from - eb->from;
+  return ea->to - eb->to;
+}
+
+
+/**
+ * Estimate the traffic between each pair of roles of a global Scribble.
+ *
+ */
+int connmgr_load_traffic(const char *scribble, char **roles, int roles_count, traffic_edge **traffic)
 {
 #ifdef __DEBUG__
-  fprintf(stderr, "%s(%d roles, %d hosts)\n", __FUNCTION__, roles_count, hosts_count);
+  fprintf(stderr, "%s(%s)\n", __FUNCTION__, scribble);
 #endif
+  int ntraffic = 0;
+  int nslot = roles_count + 1;
+  int k, nedges;
+  *traffic = (traffic_edge *)malloc(sizeof(traffic_edge) * nslot);
+  st_tree *tree = st_tree_init((st_tree *)malloc(sizeof(st_tree)));
+  if ((yyin = fopen(scribble, "r")) == NULL) {
+    perror(__FUNCTION__);
+    return 0;
+  }
+  yyparse(tree);
+  fclose(yyin);
 
-  if (hosts_count == 0) {
-    fprintf(stderr, "%s: Warning: No hosts defined, defaulting to localhost for all processes\n", __FUNCTION__);
-    hosts = (char **)malloc(sizeof(char *) * roles_count);
-    int host_idx;
-    for (host_idx=0; host_idx<roles_count; ++host_idx) {
-      hosts[host_idx] = "localhost";
+  name_table role_table;
+  int role_idx;
+  name_table_init(&role_table, roles_count);
+  for (role_idx=0; role_idx<roles_count; ++role_idx) {
+    name_table_get(&role_table, roles[role_idx], role_idx);
+  }
+
+  count_traffic(tree->root, 1.0, traffic, &ntraffic, &nslot, &role_table);
+
+  // One edge per pair of roles, with the traffic of all its interactions.
+  qsort(*traffic, ntraffic, sizeof(traffic_edge), compare_edges);
+  for (k=0, nedges=0; k<ntraffic; ++k) {
+    if (nedges > 0 && compare_edges(&(*traffic)[nedges-1], &(*traffic)[k]) == 0) {
+      (*traffic)[nedges-1].weight += (*traffic)[k].weight;
+    } else {
+      (*traffic)[nedges++] = (*traffic)[k];
     }
-    hosts_count = roles_count;
   }
 
+  name_table_free(&role_table);
+  free(tree);
+  return nedges;
+}
+
 
-  // Allocate memory for conn_rec.
-  int nr_of_connections = (roles_count*(roles_count-1))/2; // N * (N-1) / 2
-  *conns = (conn_rec *)malloc(sizeof(conn_rec) * (nr_of_connections + roles_count));
-  conn_rec *cr = *conns; // Alias.
+/**
+ * Traffic between roles placed on different hosts.
+ */
+double connmgr_cross_traffic(const host_map role_hosts[], const traffic_edge traffic[], int ntraffic)
+{
+  int k;
+  double cross = 0.0;
 
-  // Create a map of role to host.
-  *role_hosts = (host_map *)malloc(sizeof(host_map) * roles_count);
-  host_map *rh = *role_hosts;
+  for (k=0; k<ntraffic; ++k) {
+    if (strcmp(role_hosts[traffic[k].from].host, role_hosts[traffic[k].to].host) != 0) {
+      cross += traffic[k].weight;
+    }
+  }
 
-  if (roles_count > hosts_count) {
-    fprintf(stderr, "Warning: Number of hosts is less than number of roles.");
+  return cross;
+}
+
+
+/**
+ * Slot of a pair in a pair table, or the empty slot to insert it at.
+ */
+static unsigned int pair_slot(const pair_table *table, uint64_t key)
+{
+  unsigned int slot;
+  unsigned int mask = table->nslot - 1;
+
+  // Linear probing from the hashed pair (Fibonacci hashing).
+  for (slot = (unsigned int)((key * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+       table->keys[slot] != 0 && table->keys[slot] != key; slot = (slot+1) & mask);
+
+  return slot;
+}
+
+
+/**
+ * Key of a pair of indices in a pair table (never 0).
+ */
+static uint64_t pair_key(int x, int y)
+{
+  return ((uint64_t)(uint32_t)x << 32 | (uint32_t)y) + 1;
+}
+
+
+/**
+ * Initialise a pair table for count pairs (grown as needed).
+ */
+static void pair_table_init(pair_table *table, size_t count)
+{
+  // At most half full, so probe sequences stay short.
+  table->nslot = 4;
+  while (table->nslot < 2 * count) {
+    table->nslot <<= 1;
+  }
+  table->count  = 0;
+  table->keys   = (uint64_t *)calloc(table->nslot, sizeof(uint64_t));
+  table->values = (double *)malloc(sizeof(double) * table->nslot);
+}
+
+
+/**
+ * Value of a pair in a pair table (0 if not found).
+ */
+static double pair_table_find(const pair_table *table, int x, int y)
+{
+  unsigned int slot = pair_slot(table, pair_key(x, y));
+
+  return (table->keys[slot] == 0) ? 0.0 : table->values[slot];
+}
+
+
+/**
+ * Add to the value of a pair in a pair table (added as 0 if not found).
+ */
+static void pair_table_add(pair_table *table, int x, int y, double value)
+{
+  pair_table old = *table;
+  uint64_t key = pair_key(x, y);
+  unsigned int slot = pair_slot(table, key);
+  unsigned int old_slot;
+
+  if (table->keys[slot] == 0) {
+    if (2 * (table->count + 1) > table->nslot) { // Rehash into twice the slots.
+      pair_table_init(table, table->nslot);
+      for (old_slot=0; old_slot<old.nslot; ++old_slot) {
+        if (old.keys[old_slot] == 0) continue;
+        slot = pair_slot(table, old.keys[old_slot]);
+        table->keys[slot]   = old.keys[old_slot];
+        table->values[slot] = old.values[old_slot];
+      }
+      table->count = old.count;
+      free(old.keys);
+      free(old.values);
+      slot = pair_slot(table, key);
+    }
+    table->keys[slot]   = key;
+    table->values[slot] = 0.0;
+    table->count++;
+  }
+
+  table->values[slot] += value;
+}
+
+
+/**
+ * Free a pair table.
+ */
+static void pair_table_free(pair_table *table)
+{
+  free(table->keys);
+  free(table->values);
+}
+
+
+/**
+ * Compare traffic edges, heaviest first.
+ */
+static int compare_edge_weights(const void *a, const void *b)
+{
+  const traffic_edge *ea = (const traffic_edge *)a;
+  const traffic_edge *eb = (const traffic_edge *)b;
+
+  if (ea->weight != eb->weight) return (ea->weight > eb->weight) ? -1 : 1;
+  if (ea->from != eb->from) return ea->from - eb->from;
+  return ea->to - eb->to;
+}
+
+
+/**
+ * Compare roles of clusters, largest cluster first, then by cluster.
+ */
+static int compare_cluster_roles(const void *a, const void *b)
+{
+  const cluster_role *ca = (const cluster_role *)a;
+  const cluster_role *cb = (const cluster_role *)b;
+
+  if (ca->size != cb->size) return cb->size - ca->size;
+  if (ca->cluster != cb->cluster) return ca->cluster - cb->cluster;
+  return ca->role - cb->role;
+}
+
+
+/**
+ * Compare role moves by hosts, then largest gain first.
+ */
+static int compare_moves(const void *a, const void *b)
+{
+  const role_move *ma = (const role_move *)a;
+  const role_move *mb = (const role_move *)b;
+
+  if (ma->from != mb->from) return ma->from - mb->from;
+  if (ma->to != mb->to) return ma->to - mb->to;
+  if (ma->gain != mb->gain) return (ma->gain > mb->gain) ? -1 : 1;
+  return ma->role - mb->role;
+}
+
+
+/**
+ * Cluster of a role (root of its tree of merged clusters).
+ */
+static int cluster_of(int *cluster, int role_idx)
+{
+  while (cluster[role_idx] != role_idx) {
+    cluster[role_idx] = cluster[cluster[role_idx]]; // Halve the path.
+    role_idx = cluster[role_idx];
+  }
+
+  return role_idx;
+}
+
+
+/**
+ * Whether a host has fewer roles than another (lower index if equal).
+ */
+static int host_before(const int *load, int host_idx, int host2_idx)
+{
+  return load[host_idx] < load[host2_idx] || (load[host_idx] == load[host2_idx] && host_idx < host2_idx);
+}
+
+
+/**
+ * Move a host down a heap of hosts (least loaded first) after its
+ * load grew, pos is the position of each host in the heap.
+ */
+static void sift_host(int *heap, int *pos, const int *load, int hosts_count, int host_idx)
+{
+  int i = pos[host_idx];
+  int child;
+
+  while ((child = 2 * i + 1) < hosts_count) {
+    if (child + 1 < hosts_count && host_before(load, heap[child + 1], heap[child])) child++;
+    if (!host_before(load, heap[child], host_idx)) break;
+    heap[i] = heap[child];
+    pos[heap[i]] = i;
+    i = child;
+  }
+  heap[i] = host_idx;
+  pos[host_idx] = i;
+}
+
+
+/**
+ * Reduction of the cross-host traffic if a role moved to a host.
+ */
+static double move_gain(const placement_state *ps, int role_idx, int host_idx)
+{
+  return pair_table_find(&ps->sums, role_idx, host_idx)
+       - pair_table_find(&ps->sums, role_idx, ps->placement[role_idx]);
+}
+
+
+/**
+ * Reduction of the cross-host traffic if two roles swapped hosts.
+ */
+static double swap_gain(const placement_state *ps, int role_idx, int role2_idx)
+{
+  double w = (role_idx < role2_idx) ? pair_table_find(&ps->weights, role_idx, role2_idx)
+                                    : pair_table_find(&ps->weights, role2_idx, role_idx);
+
+  return move_gain(ps, role_idx, ps->placement[role2_idx])
+       + move_gain(ps, role2_idx, ps->placement[role_idx]) - 2 * w;
+}
+
+
+/**
+ * Move a role to a host, updating the traffic between its peers and each host.
+ */
+static void move_role(placement_state *ps, int role_idx, int host_idx)
+{
+  int k;
+
+  for (k=ps->adj_off[role_idx]; k<ps->adj_off[role_idx + 1]; ++k) {
+    pair_table_add(&ps->sums, ps->adj[k], ps->placement[role_idx], -ps->adj_w[k]);
+    pair_table_add(&ps->sums, ps->adj[k], host_idx, ps->adj_w[k]);
+  }
+  ps->load[ps->placement[role_idx]]--;
+  ps->load[host_idx]++;
+  ps->placement[role_idx] = host_idx;
+}
+
+
+/**
+ * Place roles on hosts (host index of each role in placement) so that
+ * heavily communicating roles share a host, with at most as many roles
+ * per host as round-robin placement would give.
+ *
+ * Roles are first merged into clusters along the heaviest edges, the
+ * clusters are packed onto hosts, then for a few sweeps roles move or
+ * swap to the host they talk to most while that reduces the cross-host
+ * traffic. The traffic between each role and each host is kept up to
+ * date, so a move or swap is costed in constant time.
+ */
+static void place_roles(int *placement, int roles_count, int hosts_count, const traffic_edge *traffic, int ntraffic)
+{
+  int capacity = (roles_count + hosts_count - 1) / hosts_count;
+  int *cluster = (int *)malloc(sizeof(int) * (roles_count + 1));
+  int *size = (int *)malloc(sizeof(int) * (roles_count + 1));
+  int *heap = (int *)malloc(sizeof(int) * (hosts_count + 1));
+  int *pos = (int *)malloc(sizeof(int) * (hosts_count + 1));
+  traffic_edge *edges = (traffic_edge *)malloc(sizeof(traffic_edge) * (ntraffic + 1));
+  cluster_role *members = (cluster_role *)malloc(sizeof(cluster_role) * (roles_count + 1));
+  role_move *moves = (role_move *)malloc(sizeof(role_move) * (2 * (size_t)ntraffic + 1));
+  int *cursor = (int *)malloc(sizeof(int) * (roles_count + 2 * (size_t)ntraffic + 1)); // Next move of each group
+  int *seen = (int *)malloc(sizeof(int) * (hosts_count + 1)); // Last role with a move to each host
+  role_move *stays = (role_move *)malloc(sizeof(role_move) * (roles_count + 1));
+  int *stay_off = (int *)malloc(sizeof(int) * (hosts_count + 1));
+  int *stay_next = (int *)malloc(sizeof(int) * (hosts_count + 1));
+  char *moved = (char *)malloc(roles_count + 1);
+  int role_idx, role2_idx, host_idx, i, j, k, a, b, lo, hi, mid;
+  int nmoves, sweep, improved;
+  double gain, best;
+  placement_state ps;
+
+  ps.placement = placement;
+  ps.load      = (int *)calloc(hosts_count, sizeof(int));
+  ps.adj_off   = (int *)calloc(roles_count + 1, sizeof(int));
+  ps.adj       = (int *)malloc(sizeof(int) * (2 * (size_t)ntraffic + 1));
+  ps.adj_w     = (double *)malloc(sizeof(double) * (2 * (size_t)ntraffic + 1));
+  pair_table_init(&ps.sums, 2 * (size_t)ntraffic);
+  pair_table_init(&ps.weights, ntraffic);
+
+  for (role_idx=0; role_idx<roles_count; ++role_idx) {
+    cluster[role_idx] = role_idx;
+    size[role_idx] = 1;
   }
 
-  int role_idx, host_idx;
+  // Merge clusters along the heaviest edges that still fit on a host
+  // (clusters only grow, so an edge that does not fit never will).
+  if (ntraffic > 0) {
+    memcpy(edges, traffic, sizeof(traffic_edge) * ntraffic);
+    qsort(edges, ntraffic, sizeof(traffic_edge), compare_edge_weights);
+  }
+  for (k=0; k<ntraffic; ++k) {
+    a = cluster_of(cluster, edges[k].from);
+    b = cluster_of(cluster, edges[k].to);
+    if (a == b || size[a] + size[b] > capacity) continue;
+    if (size[a] < size[b]) {
+      i = a;
+      a = b;
+      b = i;
+    }
+    cluster[b] = a;
+    size[a] += size[b];
+  }
+
+  // Pack the largest clusters first, each on the least loaded host
+  // (split onto the next least loaded hosts if it does not fit).
   for (role_idx=0; role_idx<roles_count; ++role_idx) {
-    rh[role_idx].role = (char *)calloc(sizeof(char), (strlen(roles[role_idx]) + 1));
-    strcpy(rh[role_idx].role, roles[role_idx]);
-
-    host_idx = role_idx % hosts_count; // Reuse hosts from beginning
-    rh[role_idx].host = (char *)calloc(sizeof(char), (strlen(hosts[host_idx]) + 1));
-    strcpy(rh[role_idx].host, hosts[host_idx]);
-  }
-
-  unsigned port_nr;
-  int conn_idx, conn2_idx, map_idx, role2_idx;
-  char *from_host = NULL;
-  for (role_idx=0, conn_idx=0; role_idx<roles_count; ++role_idx) {
-    for (role2_idx=role_idx+1; role2_idx<roles_count; ++role2_idx) {
-      assert(conn_idx<nr_of_connections);
-      cr[conn_idx].type = CONNMGR_TYPE_P2P;
-      // Set from-role.
-      cr[conn_idx].from = (char *)calloc(sizeof(char), (strlen(roles[role_idx]) + 1));
-      strcpy(cr[conn_idx].from, roles[role_idx]);
-
-      // Set to-role.
-      cr[conn_idx].to = (char *)calloc(sizeof(char), (strlen(roles[role2_idx]) + 1));
-      strcpy(cr[conn_idx].to, roles[role2_idx]);
-
-      // Lookup host from role_hosts map.
-      for (map_idx=0; map_idx<roles_count; ++map_idx) {
-        if (strcmp(cr[conn_idx].from, rh[map_idx].role) == 0) {
-          from_host = (char *)calloc(sizeof(char), (strlen(rh[map_idx].host) + 1));
-          strcpy(from_host, rh[map_idx].host);
-        }
-        if (strcmp(cr[conn_idx].to, rh[map_idx].role) == 0) {
-          cr[conn_idx].host = (char *)calloc(sizeof(char), (strlen(rh[map_idx].host) + 1));
-          strcpy(cr[conn_idx].host, rh[map_idx].host);
+    members[role_idx].cluster = cluster_of(cluster, role_idx);
+    members[role_idx].size    = size[members[role_idx].cluster];
+    members[role_idx].role    = role_idx;
+  }
+  qsort(members, roles_count, sizeof(cluster_role), compare_cluster_roles);
+  for (host_idx=0; host_idx<hosts_count; ++host_idx) {
+    heap[host_idx] = host_idx;
+    pos[host_idx] = host_idx;
+  }
+  for (i=0, host_idx=0; i<roles_count; ++i) {
+    if (i == 0 || members[i].cluster != members[i-1].cluster || ps.load[host_idx] >= capacity) {
+      host_idx = heap[0];
+    }
+    placement[members[i].role] = host_idx;
+    ps.load[host_idx]++;
+    sift_host(heap, pos, ps.load, hosts_count, host_idx);
+  }
+
+  // Peers of each role, and the traffic between each role and each host.
+  for (k=0; k<ntraffic; ++k) {
+    ps.adj_off[traffic[k].from + 1]++;
+    ps.adj_off[traffic[k].to + 1]++;
+  }
+  for (role_idx=0; role_idx<roles_count; ++role_idx) {
+    ps.adj_off[role_idx + 1] += ps.adj_off[role_idx];
+    cursor[role_idx] = ps.adj_off[role_idx];
+  }
+  for (k=0; k<ntraffic; ++k) {
+    a = traffic[k].from;
+    b = traffic[k].to;
+    ps.adj[cursor[a]] = b;
+    ps.adj_w[cursor[a]++] = traffic[k].weight;
+    ps.adj[cursor[b]] = a;
+    ps.adj_w[cursor[b]++] = traffic[k].weight;
+    pair_table_add(&ps.weights, (a < b) ? a : b, (a < b) ? b : a, traffic[k].weight);
+    pair_table_add(&ps.sums, a, placement[b], traffic[k].weight);
+    pair_table_add(&ps.sums, b, placement[a], traffic[k].weight);
+  }
+
+  for (sweep=0; sweep<CONNMGR_SWEEPS; ++sweep) {
+    // Moves of roles to hosts they talk to more than to their own,
+    // grouped by hosts, and the roles of each host, those that talk
+    // least to it first (the gain of staying is minus that traffic).
+    nmoves = 0;
+    for (host_idx=0; host_idx<hosts_count; ++host_idx) {
+      seen[host_idx] = -1;
+    }
+    for (role_idx=0; role_idx<roles_count; ++role_idx) {
+      moved[role_idx] = 0;
+      for (k=ps.adj_off[role_idx]; k<ps.adj_off[role_idx + 1]; ++k) {
+        host_idx = placement[ps.adj[k]];
+        if (host_idx == placement[role_idx] || seen[host_idx] == role_idx) continue;
+        seen[host_idx] = role_idx;
+        if ((gain = move_gain(&ps, role_idx, host_idx)) > 1e-9) {
+          moves[nmoves].from = placement[role_idx];
+          moves[nmoves].to   = host_idx;
+          moves[nmoves].gain = gain;
+          moves[nmoves].role = role_idx;
+          nmoves++;
         }
       }
+      stays[role_idx].from = stays[role_idx].to = placement[role_idx];
+      stays[role_idx].gain = -pair_table_find(&ps.sums, role_idx, placement[role_idx]);
+      stays[role_idx].role = role_idx;
+    }
+    qsort(moves, nmoves, sizeof(role_move), compare_moves);
+    for (k=0; k<nmoves; ++k) {
+      cursor[k] = k;
+    }
+    qsort(stays, roles_count, sizeof(role_move), compare_moves);
+    for (host_idx=0, i=0; host_idx<hosts_count; ++host_idx) {
+      stay_off[host_idx] = stay_next[host_idx] = i;
+      i += ps.load[host_idx];
+    }
+    stay_off[hosts_count] = roles_count;
 
+    improved = 0;
+    for (k=0; k<nmoves; ++k) {
+      role_idx = moves[k].role;
+      host_idx = moves[k].to;
+      if (moved[role_idx] || move_gain(&ps, role_idx, host_idx) <= 1e-9) continue;
 
-      if (strcmp(from_host, cr[conn_idx].host) == 0) {
-        cr[conn_idx].host = (char *)realloc(cr[conn_idx].host, sizeof(char) * (strlen(cr[conn_idx].host) + 4));
-        sprintf(cr[conn_idx].host, "ipc:%s", from_host);
+      if (ps.load[host_idx] < capacity) { // Room to move.
+        move_role(&ps, role_idx, host_idx);
+        moved[role_idx] = 1;
+        improved = 1;
+        continue;
       }
-      // Find next unoccupied port.
-      port_nr = -1;
-      for (conn2_idx=0; conn2_idx<conn_idx; ++conn2_idx) {
-        if (strcmp(cr[conn2_idx].host, cr[conn_idx].host) == 0) {
-          port_nr = cr[conn2_idx].port;
+
+      // Swap with one of the roles most willing to move the other way,
+      // a peer on the host, or one of the roles that talk least to it.
+      best = 1e-9;
+      role2_idx = -1;
+      lo = 0;
+      hi = nmoves;
+      while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (moves[mid].from < host_idx || (moves[mid].from == host_idx && moves[mid].to < moves[k].from)) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
         }
       }
-      cr[conn_idx].port = (port_nr==-1 ? start_port : port_nr+1);
+      if (lo < nmoves && moves[lo].from == host_idx && moves[lo].to == moves[k].from) {
+        i = cursor[lo];
+        while (i < nmoves && moves[i].from == host_idx && moves[i].to == moves[k].from && moved[moves[i].role]) i++;
+        cursor[lo] = i;
+        for (j=0; j<CONNMGR_SWAP_CANDIDATES && i < nmoves
+                  && moves[i].from == host_idx && moves[i].to == moves[k].from; ++i) {
+          if (moved[moves[i].role]) continue;
+          if ((gain = swap_gain(&ps, role_idx, moves[i].role)) > best) {
+            best = gain;
+            role2_idx = moves[i].role;
+          }
+          j++;
+        }
+      }
+      for (i=ps.adj_off[role_idx]; i<ps.adj_off[role_idx + 1]; ++i) {
+        if (placement[ps.adj[i]] == host_idx && !moved[ps.adj[i]]
+            && (gain = swap_gain(&ps, role_idx, ps.adj[i])) > best) {
+          best = gain;
+          role2_idx = ps.adj[i];
+        }
+      }
+      i = stay_next[host_idx];
+      while (i < stay_off[host_idx + 1] && moved[stays[i].role]) i++;
+      stay_next[host_idx] = i;
+      for (j=0; j<CONNMGR_SWAP_CANDIDATES && i < stay_off[host_idx + 1]; ++i) {
+        if (moved[stays[i].role]) continue;
+        if ((gain = swap_gain(&ps, role_idx, stays[i].role)) > best) {
+          best = gain;
+          role2_idx = stays[i].role;
+        }
+        j++;
+      }
 
-      ++conn_idx;
+      if (role2_idx >= 0) {
+        move_role(&ps, role2_idx, placement[role_idx]);
+        move_role(&ps, role_idx, host_idx);
+        moved[role_idx] = moved[role2_idx] = 1;
+        improved = 1;
+      }
     }
+    if (!improved) break;
   }
 
-  // Broadcast role generation
+  free(cluster);
+  free(size);
+  free(heap);
+  free(pos);
+  free(edges);
+  free(members);
+  free(moves);
+  free(cursor);
+  free(seen);
+  free(stays);
+  free(stay_off);
+  free(stay_next);
+  free(moved);
+  free(ps.load);
+  free(ps.adj_off);
+  free(ps.adj);
+  free(ps.adj_w);
+  pair_table_free(&ps.sums);
+  pair_table_free(&ps.weights);
+}
+
+
+/**
+ * Append a connection record to a growing array of nconns records.
+ */
+static conn_rec *add_conn(conn_rec **conns, int *nconns, int *nslot,
+                          int type, char *from, char *to, char *host, name_table *ports, int start_port)
+{
+  conn_rec *cr;
+
+  if (*nconns == *nslot) {
+    *nslot *= 2;
+    *conns = (conn_rec *)realloc(*conns, sizeof(conn_rec) * (*nslot));
+  }
+
+  cr = &(*conns)[(*nconns)++];
+  cr->type = type;
+  cr->from = from;
+  cr->to   = to;
+  cr->host = host;
+
+  // Next unoccupied port.
+  cr->port = ++(*name_table_get(ports, host, start_port - 1));
+
+  return cr;
+}
+
+
+/**
+ * Append the point-to-point connection record of a pair of roles, to the
+ * host of the second role (shared memory if both are on the same host).
+ */
+static void add_link(conn_rec **conns, int *nconns, int *nslot, const host_map *rh, char **shm_hosts,
+                     int role_idx, int role2_idx, name_table *ports, int start_port)
+{
+  add_conn(conns, nconns, nslot, CONNMGR_TYPE_P2P, rh[role_idx].role, rh[role2_idx].role,
+      (rh[role_idx].host == rh[role2_idx].host) ? shm_hosts[role2_idx] : rh[role2_idx].host,
+      ports, start_port);
+}
+
+
+/**
+ * Initialise Connection manager with given roles and hosts list.
+ */
+int connmgr_init(conn_rec **conns, host_map **role_hosts,
+                 char **roles, int roles_count,
+                 char **hosts, int hosts_count,
+                 int start_port, const traffic_edge traffic[], int ntraffic, int flags,
+                 connmgr_arena **strings)
+{
+#ifdef __DEBUG__
+  fprintf(stderr, "%s(%d roles, %d hosts)\n", __FUNCTION__, roles_count, hosts_count);
+#endif
+  char *localhost[] = { "localhost" };
+
+  if (hosts_count == 0) {
+    fprintf(stderr, "%s: Warning: No hosts defined, defaulting to localhost for all processes\n", __FUNCTION__);
+    hosts = localhost;
+    hosts_count = 1;
+  } else if (roles_count > hosts_count) {
+    fprintf(stderr, "Warning: Number of hosts is less than number of roles.");
+  }
+
+  // Create a map of role to host.
+  *role_hosts = (host_map *)malloc(sizeof(host_map) * (roles_count + 1));
+  host_map *rh = *role_hosts;
+
+  int *placement = (int *)malloc(sizeof(int) * (roles_count + 1));
+  int role_idx;
   for (role_idx=0; role_idx<roles_count; ++role_idx) {
-    cr[conn_idx].type = CONNMGR_TYPE_GRP;
-    cr[conn_idx].from = (char *)calloc(sizeof(char), (strlen(roles[role_idx]) + 1));
-    strcpy(cr[conn_idx].from, roles[role_idx]);
-
-    cr[conn_idx].to = (char *)calloc(sizeof(char), (strlen(roles[role_idx]) + 1));
-    strcpy(cr[conn_idx].to, roles[role_idx]);
-
-    // Lookup host from role_hosts map.
-    for (map_idx=0; map_idx<roles_count; ++map_idx) {
-      if (strcmp(cr[conn_idx].to, rh[map_idx].role) == 0) {
-        cr[conn_idx].host = (char *)calloc(sizeof(char), (strlen(rh[map_idx].host) + 1));
-        strcpy(cr[conn_idx].host, rh[map_idx].host);
-      }
+    placement[role_idx] = role_idx % hosts_count; // Reuse hosts from beginning
+  }
+  if (flags & CONNMGR_TOPOLOGY) {
+    place_roles(placement, roles_count, hosts_count, traffic, ntraffic);
+  }
+
+  // Strings of the records, one copy of each role and host,
+  // so that roles on the same host have the same host string.
+  name_table names;
+  char **shm_hosts = (char **)malloc(sizeof(char *) * (roles_count + 1));
+  char *buf = NULL;
+  size_t size = 0;
+  name_table_init(&names, roles_count + hosts_count);
+
+  for (role_idx=0; role_idx<roles_count; ++role_idx) {
+    rh[role_idx].role = intern(&names, roles[role_idx], strings);
+    rh[role_idx].host = intern(&names, hosts[placement[role_idx]], strings);
+
+    if (size < strlen(rh[role_idx].host) + 5) {
+      size = strlen(rh[role_idx].host) + 5;
+      buf = (char *)realloc(buf, size);
     }
+    sprintf(buf, "shm:%s", rh[role_idx].host);
+    shm_hosts[role_idx] = intern(&names, buf, strings);
+  }
 
-    // Find next unoccupied port.
-    port_nr = -1;
-    for (conn2_idx=0; conn2_idx<conn_idx; ++conn2_idx) {
-      if (strcmp(cr[conn2_idx].host, cr[conn_idx].host) == 0) {
-        port_nr = cr[conn2_idx].port;
+  free(placement);
+  free(buf);
+
+  // Last port used on each host (keys are host fields of the records).
+  name_table ports;
+  int nconns = 0;
+  int nslot = 2 * roles_count + 1;
+  int role2_idx, k;
+  name_table_init(&ports, 2 * hosts_count);
+  *conns = (conn_rec *)malloc(sizeof(conn_rec) * nslot);
+
+  if (flags & CONNMGR_PRUNE) { // Only roles that interact.
+    int *group = (int *)malloc(sizeof(int) * (roles_count + 1)); // Lowest role of each group is its root
+    for (role_idx=0; role_idx<roles_count; ++role_idx) {
+      group[role_idx] = role_idx;
+    }
+    for (k=0; k<ntraffic; ++k) {
+      add_link(conns, &nconns, &nslot, rh, shm_hosts, traffic[k].from, traffic[k].to, &ports, start_port);
+      role_idx  = cluster_of(group, traffic[k].from);
+      role2_idx = cluster_of(group, traffic[k].to);
+      if (role_idx < role2_idx) group[role2_idx] = role_idx;
+      if (role2_idx < role_idx) group[role_idx] = role2_idx;
+    }
+    // Collectives involve all roles, so link the first role to each
+    // group of roles that does not interact with its own.
+    for (role_idx=1; role_idx<roles_count; ++role_idx) {
+      if (cluster_of(group, role_idx) != role_idx) continue;
+      add_link(conns, &nconns, &nslot, rh, shm_hosts, 0, role_idx, &ports, start_port);
+      group[role_idx] = 0;
+    }
+    free(group);
+  } else {
+    for (role_idx=0; role_idx<roles_count; ++role_idx) {
+      for (role2_idx=role_idx+1; role2_idx<roles_count; ++role2_idx) {
+        add_link(conns, &nconns, &nslot, rh, shm_hosts, role_idx, role2_idx, &ports, start_port);
       }
     }
-    cr[conn_idx].port = (port_nr==-1 ? start_port : port_nr+1);
+  }
 
-    ++conn_idx;
+  // Broadcast role generation
+  for (role_idx=0; role_idx<roles_count; ++role_idx) {
+    add_conn(conns, &nconns, &nslot, CONNMGR_TYPE_GRP, rh[role_idx].role, rh[role_idx].role,
+        rh[role_idx].host, &ports, start_port);
   }
 
-  return nr_of_connections + roles_count;
+  *conns = (conn_rec *)realloc(*conns, sizeof(conn_rec) * (nconns + 1));
+
+  free(shm_hosts);
+  name_table_free(&names);
+  name_table_free(&ports);
+
+  return nconns;
 }
 
 
@@ -255,55 +1093,413 @@ void connmgr_write(const char *outfile, const conn_rec conns[], int nconns,
 /**
  * Read from file the connection record array.
  */
-int connmgr_read(const char *infile, conn_rec **conns, host_map **role_hosts, int *nr_of_roles)
+int connmgr_read(const char *infile, conn_rec **conns, host_map **role_hosts, int *nr_of_roles,
+                 connmgr_arena **strings)
 {
   FILE *in_fp;
   int conn_idx, role_idx;
   int nr_of_conns = 0;
+  char *buf = NULL;
+  size_t size = 0;
+  name_table names;
 
   conn_rec *cr;
   host_map *rh;
 
+  *nr_of_roles = 0;
   if ((in_fp = fopen(infile, "r")) == NULL) {
     perror(__FUNCTION__);
     return 0;
   }
 
-  if (EOF == fscanf(in_fp, "%d %d", nr_of_roles, &nr_of_conns)) {
-    perror("fscanf");
+  if (2 != fscanf(in_fp, "%d %d", nr_of_roles, &nr_of_conns)) {
+    fprintf(stderr, "%s: %s: Missing number of roles and connections\n", __FUNCTION__, infile);
+    *nr_of_roles = nr_of_conns = 0;
   }
-  *conns      = malloc(sizeof(conn_rec) * nr_of_conns);
-  *role_hosts = malloc(sizeof(host_map) * (*nr_of_roles));
+  *conns      = malloc(sizeof(conn_rec) * (nr_of_conns + 1));
+  *role_hosts = malloc(sizeof(host_map) * (*nr_of_roles + 1));
   cr = *conns;
   rh = *role_hosts;
 
+  // One copy of each role and host (records repeat them).
+  name_table_init(&names, 2 * (*nr_of_roles));
+
   for (role_idx=0; role_idx<*nr_of_roles; ++role_idx) {
-    rh[role_idx].role = malloc(sizeof(char) * MAX_HOSTNAME_LENGTH);
-    rh[role_idx].host = malloc(sizeof(char) * MAX_HOSTNAME_LENGTH);
-    if (EOF == fscanf(in_fp, "%s %s", rh[role_idx].role, rh[role_idx].host)) {
-      perror("fscanf");
-    }
+    if (read_token(in_fp, &buf, &size) < 0) break;
+    rh[role_idx].role = intern(&names, buf, strings);
+    if (read_token(in_fp, &buf, &size) < 0) break;
+    rh[role_idx].host = intern(&names, buf, strings);
 #ifdef __DEBUG__
     fprintf(stderr, "%s: #%d %s %s\n",
                       __FUNCTION__, role_idx, rh[role_idx].role, rh[role_idx].host);
 #endif
   }
+  if (role_idx < *nr_of_roles) {
+    fprintf(stderr, "%s: %s: Expecting %d roles, found %d\n", __FUNCTION__, infile, *nr_of_roles, role_idx);
+    *nr_of_roles = role_idx;
+    nr_of_conns = 0;
+  }
 
   for (conn_idx=0; conn_idx<nr_of_conns; ++conn_idx) {
-    cr[conn_idx].from = malloc(sizeof(char) * MAX_HOSTNAME_LENGTH);
-    cr[conn_idx].to   = malloc(sizeof(char) * MAX_HOSTNAME_LENGTH);
-    cr[conn_idx].host = malloc(sizeof(char) * MAX_HOSTNAME_LENGTH);
-    if (EOF == fscanf(in_fp, "%d %s %s %s %u\n", &cr[conn_idx].type, cr[conn_idx].from, cr[conn_idx].to, cr[conn_idx].host, &cr[conn_idx].port)) {
-      perror("fscanf");
-    }
+    if (1 != fscanf(in_fp, "%d", &cr[conn_idx].type)) break;
+    if (read_token(in_fp, &buf, &size) < 0) break;
+    cr[conn_idx].from = intern(&names, buf, strings);
+    if (read_token(in_fp, &buf, &size) < 0) break;
+    cr[conn_idx].to = intern(&names, buf, strings);
+    if (read_token(in_fp, &buf, &size) < 0) break;
+    cr[conn_idx].host = intern(&names, buf, strings);
+    if (1 != fscanf(in_fp, "%u", &cr[conn_idx].port)) break;
 #ifdef __DEBUG__
     fprintf(stderr, "%s: #%d %s->%s %s:%u\n",
                       __FUNCTION__, conn_idx, cr[conn_idx].from, cr[conn_idx].to, cr[conn_idx].host, cr[conn_idx].port);
 #endif
   }
+  if (conn_idx < nr_of_conns) {
+    fprintf(stderr, "%s: %s: Expecting %d connections, found %d\n", __FUNCTION__, infile, nr_of_conns, conn_idx);
+  }
 
   fclose(in_fp);
+  free(buf);
+  name_table_free(&names);
 
   return conn_idx;
 }
 
+
+/**
+ * Compare role-host maps by role.
+ */
+static int compare_roles(const void *a, const void *b)
+{
+  return strcmp(((const host_map *)a)->role, ((const host_map *)b)->role);
+}
+
+
+/**
+ * Compare integers.
+ */
+static int compare_ints(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+
+/**
+ * Offset of a string in a string table (added once).
+ */
+static uint32_t bin_string(name_table *offsets, const char *str, char **strings, size_t *used, size_t *size)
+{
+  size_t len;
+  unsigned int slot = name_slot(offsets, str);
+
+  if (offsets->names[slot] != NULL) return offsets->values[slot];
+
+  len = strlen(str) + 1;
+  while (*used + len > *size) {
+    *size = (*size == 0) ? CONNMGR_ARENA_SIZE : 2 * *size;
+    *strings = (char *)realloc(*strings, *size);
+  }
+  memcpy(*strings + *used, str, len);
+  name_table_add(offsets, str, *used);
+  *used += len;
+
+  return *used - len;
+}
+
+
+/**
+ * Write connection record array to file, in binary format.
+ */
+int connmgr_write_bin(const char *outfile, const conn_rec conns[], int nconns,
+                                           const host_map role_hosts[], int nroles)
+{
+#ifdef __DEBUG__
+  fprintf(stderr, "%s(%s, %d connections, %d roles)\n", __FUNCTION__, outfile, nconns, nroles);
+#endif
+  FILE *out_fp;
+  connmgr_bin_header header;
+  host_map *sorted = (host_map *)malloc(sizeof(host_map) * (nroles + 1));
+  connmgr_bin_role *roles = (connmgr_bin_role *)malloc(sizeof(connmgr_bin_role) * (nroles + 1));
+  connmgr_bin_conn *bconns = (connmgr_bin_conn *)malloc(sizeof(connmgr_bin_conn) * (nconns + 1));
+  int *from = (int *)malloc(sizeof(int) * (nconns + 1)); // Position of the roles of each link
+  int *to   = (int *)malloc(sizeof(int) * (nconns + 1));
+  uint32_t *index = (uint32_t *)calloc(nroles + 2, sizeof(uint32_t));
+  uint32_t *rows;
+  int *peers;
+  name_table offsets;   // Offset of each string in the string table
+  name_table positions; // Position of each role in roles
+  char *strings = NULL;
+  size_t used = 0;
+  size_t size = 0;
+  size_t total;
+  int role_idx, conn_idx, pass, nlinks, npeers, k, rc = 0;
+
+  name_table_init(&offsets, 2 * nroles);
+  name_table_init(&positions, nroles);
+
+  // Roles sorted by name, so that a role can be found by bisection.
+  memcpy(sorted, role_hosts, sizeof(host_map) * nroles);
+  qsort(sorted, nroles, sizeof(host_map), compare_roles);
+  for (role_idx=0; role_idx<nroles; ++role_idx) {
+    roles[role_idx].role = bin_string(&offsets, sorted[role_idx].role, &strings, &used, &size);
+    roles[role_idx].host = bin_string(&offsets, sorted[role_idx].host, &strings, &used, &size);
+    name_table_get(&positions, sorted[role_idx].role, role_idx);
+  }
+
+  // Point-to-point connections first, then the others.
+  for (pass=0, k=0, nlinks=0; pass<2; ++pass) {
+    for (conn_idx=0; conn_idx<nconns; ++conn_idx) {
+      if ((conns[conn_idx].type == CONNMGR_TYPE_P2P) != (pass == 0)) continue;
+      bconns[k].type = conns[conn_idx].type;
+      bconns[k].from = bin_string(&offsets, conns[conn_idx].from, &strings, &used, &size);
+      bconns[k].to   = bin_string(&offsets, conns[conn_idx].to, &strings, &used, &size);
+      bconns[k].host = bin_string(&offsets, conns[conn_idx].host, &strings, &used, &size);
+      bconns[k].port = conns[conn_idx].port;
+      if (pass == 0) {
+        from[k] = role_index(&positions, conns[conn_idx].from);
+        to[k]   = role_index(&positions, conns[conn_idx].to);
+        if (from[k] >= 0) index[from[k] + 2]++;
+        if (to[k] >= 0 && to[k] != from[k]) index[to[k] + 2]++;
+        nlinks++;
+      }
+      k++;
+    }
+  }
+
+  // Links of each role (index[r+1] counts placed rows of role r until done).
+  for (role_idx=0; role_idx<nroles; ++role_idx) {
+    index[role_idx + 2] += index[role_idx + 1];
+  }
+  rows = (uint32_t *)malloc(sizeof(uint32_t) * (index[nroles + 1] + 1));
+  for (conn_idx=0; conn_idx<nlinks; ++conn_idx) {
+    if (from[conn_idx] >= 0) rows[index[from[conn_idx] + 1]++] = conn_idx;
+    if (to[conn_idx] >= 0 && to[conn_idx] != from[conn_idx]) rows[index[to[conn_idx] + 1]++] = conn_idx;
+  }
+
+  // Every pair of roles is connected if every role has all others as peers.
+  header.flags = CONNMGR_BIN_ALLPAIRS;
+  peers = (int *)malloc(sizeof(int) * (nlinks + 1));
+  for (role_idx=0; role_idx<nroles && header.flags; ++role_idx) {
+    for (k=index[role_idx], npeers=0; k<index[role_idx + 1]; ++k) {
+      conn_idx = rows[k];
+      peers[npeers++] = (from[conn_idx] == role_idx) ? to[conn_idx] : from[conn_idx];
+    }
+    qsort(peers, npeers, sizeof(int), compare_ints);
+    for (k=0, conn_idx=0; k<npeers; ++k) {
+      if (peers[k] >= 0 && peers[k] != role_idx && (k == 0 || peers[k] != peers[k-1])) conn_idx++;
+    }
+    if (conn_idx < nroles - 1) header.flags = 0;
+  }
+
+  header.magic       = CONNMGR_BIN_MAGIC;
+  header.version     = CONNMGR_BIN_VERSION;
+  header.nroles      = nroles;
+  header.nconns      = nconns;
+  header.nlinks      = nlinks;
+  header.roles_off   = sizeof(connmgr_bin_header);
+  header.conns_off   = header.roles_off + sizeof(connmgr_bin_role) * nroles;
+  header.index_off   = header.conns_off + sizeof(connmgr_bin_conn) * nconns;
+  header.strings_off = header.index_off + sizeof(uint32_t) * (nroles + 1 + index[nroles]);
+  total = (size_t)header.index_off + sizeof(uint32_t) * (nroles + 1 + (size_t)index[nroles]) + used;
+  header.size        = total;
+
+  if (total > UINT32_MAX) {
+    fprintf(stderr, "%s: Configuration too large (%zu bytes)\n", __FUNCTION__, total);
+    errno = EFBIG;
+    rc = -1;
+  } else if ((out_fp = fopen(outfile, "wb")) == NULL) {
+    perror(__FUNCTION__);
+    rc = -1;
+  } else {
+    if (fwrite(&header, sizeof(header), 1, out_fp) != 1
+        || fwrite(roles, sizeof(connmgr_bin_role), nroles, out_fp) != (size_t)nroles
+        || fwrite(bconns, sizeof(connmgr_bin_conn), nconns, out_fp) != (size_t)nconns
+        || fwrite(index, sizeof(uint32_t), nroles + 1, out_fp) != (size_t)nroles + 1
+        || fwrite(rows, sizeof(uint32_t), index[nroles], out_fp) != index[nroles]
+        || fwrite(strings, 1, used, out_fp) != used) {
+      perror(__FUNCTION__);
+      rc = -1;
+    }
+    if (fclose(out_fp) != 0) rc = -1;
+  }
+
+  free(sorted);
+  free(roles);
+  free(bconns);
+  free(from);
+  free(to);
+  free(index);
+  free(rows);
+  free(peers);
+  free(strings);
+  name_table_free(&offsets);
+  name_table_free(&positions);
+
+  return rc;
+}
+
+
+/**
+ * Map a binary configuration file into memory.
+ */
+int connmgr_map(const char *infile, conn_config *config)
+{
+  int fd;
+  struct stat st;
+  const connmgr_bin_header *header;
+  uint64_t size;
+  uint32_t k;
+
+  config->addr = NULL;
+  if ((fd = open(infile, O_RDONLY)) < 0) return -1;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  if ((size_t)st.st_size < sizeof(connmgr_bin_header)) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  config->size = st.st_size;
+  config->addr = mmap(NULL, config->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (config->addr == MAP_FAILED) {
+    config->addr = NULL;
+    return -1;
+  }
+
+  // Sections in order, within the file.
+  header = (const connmgr_bin_header *)config->addr;
+  size = config->size;
+  if (header->magic != CONNMGR_BIN_MAGIC || header->version != CONNMGR_BIN_VERSION || header->size != size
+      || header->roles_off != sizeof(connmgr_bin_header)
+      || header->conns_off != header->roles_off + (uint64_t)sizeof(connmgr_bin_role) * header->nroles
+      || header->index_off != header->conns_off + (uint64_t)sizeof(connmgr_bin_conn) * header->nconns
+      || header->strings_off < header->index_off + (uint64_t)sizeof(uint32_t) * (header->nroles + 1)
+      || header->strings_off > size || header->nlinks > header->nconns
+      || (size > header->strings_off && ((const char *)config->addr)[size - 1] != '\0')) {
+    connmgr_unmap(config);
+    errno = EINVAL;
+    return -1;
+  }
+
+  config->header  = header;
+  config->roles   = (const connmgr_bin_role *)((const char *)config->addr + header->roles_off);
+  config->conns   = (const connmgr_bin_conn *)((const char *)config->addr + header->conns_off);
+  config->index   = (const uint32_t *)((const char *)config->addr + header->index_off);
+  config->rows    = config->index + header->nroles + 1;
+  config->strings = (const char *)config->addr + header->strings_off;
+
+  if (header->index_off + (uint64_t)sizeof(uint32_t) * (header->nroles + 1 + config->index[header->nroles]) != header->strings_off) {
+    connmgr_unmap(config);
+    errno = EINVAL;
+    return -1;
+  }
+
+  // Rows of each role within the rows.
+  for (k=0; k<header->nroles; ++k) {
+    if (config->index[k] > config->index[k + 1]) {
+      connmgr_unmap(config);
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+/**
+ * String at an offset of the string table of a mapped configuration
+ * (empty if out of range).
+ */
+static char *bin_str(const conn_config *config, uint32_t off)
+{
+  if (off >= config->size - config->header->strings_off) return (char *)"";
+
+  return (char *)config->strings + off;
+}
+
+
+/**
+ * Connection record of a row of a mapped configuration.
+ */
+static void bin_conn(const conn_config *config, uint32_t row, conn_rec *cr)
+{
+  const connmgr_bin_conn *bc = &config->conns[row];
+
+  cr->type = bc->type;
+  cr->from = bin_str(config, bc->from);
+  cr->to   = bin_str(config, bc->to);
+  cr->host = bin_str(config, bc->host);
+  cr->port = bc->port;
+}
+
+
+/**
+ * Connection records of a role from a mapped configuration.
+ */
+int connmgr_map_rows(const conn_config *config, const char *role, conn_rec **conns)
+{
+  const connmgr_bin_header *header = config->header;
+  int lo = 0;
+  int hi = (int)header->nroles - 1;
+  int mid, cmp, nconns = 0;
+  uint32_t k, first = 0, last = 0;
+
+  // Rows of the role, found by bisection of the sorted roles.
+  while (lo <= hi) {
+    mid = lo + (hi - lo) / 2;
+    if ((cmp = strcmp(bin_str(config, config->roles[mid].role), role)) == 0) {
+      first = config->index[mid];
+      last  = config->index[mid + 1];
+      break;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  *conns = (conn_rec *)malloc(sizeof(conn_rec) * (last - first + header->nconns - header->nlinks + 1));
+  for (k=first; k<last; ++k) {
+    if (config->rows[k] < header->nlinks) bin_conn(config, config->rows[k], &(*conns)[nconns++]);
+  }
+  for (k=header->nlinks; k<header->nconns; ++k) {
+    bin_conn(config, k, &(*conns)[nconns++]);
+  }
+
+  return nconns;
+}
+
+
+/**
+ * Point-to-point connection records of a mapped configuration.
+ */
+int connmgr_map_links(const conn_config *config, conn_rec **conns)
+{
+  uint32_t k;
+
+  *conns = NULL;
+  if (config->header->flags & CONNMGR_BIN_ALLPAIRS) return 0;
+
+  *conns = (conn_rec *)malloc(sizeof(conn_rec) * (config->header->nlinks + 1));
+  for (k=0; k<config->header->nlinks; ++k) {
+    bin_conn(config, k, &(*conns)[k]);
+  }
+
+  return k;
+}
+
+
+/**
+ * Unmap a mapped configuration.
+ */
+void connmgr_unmap(conn_config *config)
+{
+  if (config->addr != NULL) munmap(config->addr, config->size);
+  config->addr = NULL;
+}
@@ -1,5 +1,7 @@
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "connmgr.h"
 
@@ -13,20 +15,70 @@ int main(int argc, char **argv)
   int hosts_count;
   char **roles;
   int roles_count;
+  traffic_edge *traffic = NULL;
+  int ntraffic = 0;
+  connmgr_arena *strings = NULL;
 
-  if (argc < 4) {
+  int flags = 0;
+  int text = 0;
+  int option;
+  int role_idx;
+
+  while ((option = getopt(argc, argv, "tgx")) != -1) {
+    switch (option) {
+      case 't':
+        flags |= CONNMGR_TOPOLOGY;
+        break;
+      case 'g':
+        flags |= CONNMGR_PRUNE;
+        break;
+      case 'x':
+        text = 1;
+        break;
+      default:
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (argc - optind < 3) {
     fprintf(stderr, "Not enough arguments\n");
-    fprintf(stderr, "Usage: %s hostfile scribblefile outputfile\n", argv[0]);
-    fprintf(stderr, "       use `-' for stdout\n");
+    fprintf(stderr, "Usage: %s [-t] [-g] [-x] hostfile scribblefile outputfile\n", argv[0]);
+    fprintf(stderr, "       use `-' for stdout (text)\n");
+    fprintf(stderr, "       -t: place communicating roles on the same host\n");
+    fprintf(stderr, "       -g: connect only roles that communicate\n");
+    fprintf(stderr, "       -x: write the configuration as text instead of binary\n");
     return EXIT_FAILURE;
   }
 
-  printf("Host file: %s\nScribble file: %s\nOutput connection configuration: %s\n", argv[1], argv[2], argv[3]);
+  printf("Host file: %s\nScribble file: %s\nOutput connection configuration: %s\n", argv[optind], argv[optind+1], argv[optind+2]);
+
+  hosts_count = connmgr_load_hosts(argv[optind], &hosts, &strings);
+  roles_count = connmgr_load_roles(argv[optind+1], &roles, &strings);
+  if (flags) { // Traffic is only needed to place or prune.
+    ntraffic = connmgr_load_traffic(argv[optind+1], roles, roles_count, &traffic);
+  }
+
+  conns_count = connmgr_init(&conns, &hosts_roles, roles, roles_count, hosts, hosts_count, 6666, traffic, ntraffic, flags, &strings);
 
-  hosts_count = connmgr_load_hosts(argv[1], &hosts);
-  roles_count = connmgr_load_roles(argv[2], &roles);
+  printf("Placement (%s):\n", (flags & CONNMGR_TOPOLOGY) ? "topology" : "round-robin");
+  for (role_idx=0; role_idx<roles_count; ++role_idx) {
+    printf("  %s -> %s\n", hosts_roles[role_idx].role, hosts_roles[role_idx].host);
+  }
+  if (traffic != NULL) {
+    printf("Estimated cross-host traffic: %g\n", connmgr_cross_traffic(hosts_roles, traffic, ntraffic));
+  }
+  printf("Point-to-point connections: %d (of %lld)\n", conns_count - roles_count, (long long)roles_count * (roles_count - 1) / 2);
 
-  conns_count = connmgr_init(&conns, &hosts_roles, roles, roles_count, hosts, hosts_count, 6666);
-  connmgr_write(argv[3], conns, conns_count, hosts_roles, roles_count);
+  if (text || strcmp(argv[optind+2], "-") == 0) {
+    connmgr_write(argv[optind+2], conns, conns_count, hosts_roles, roles_count);
+  } else if (connmgr_write_bin(argv[optind+2], conns, conns_count, hosts_roles, roles_count) != 0) {
+    return EXIT_FAILURE;
+  }
+  free(traffic);
+  free(conns);
+  free(hosts_roles);
+  free(hosts);
+  free(roles);
+  connmgr_arena_free(strings);
   return EXIT_SUCCESS;
 }
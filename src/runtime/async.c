@@ -0,0 +1,434 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * non-blocking communication primitives module.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zmq.h>
+
+#include "sc/async.h"
+#include "sc/msg.h"
+#include "sc/session.h"
+
+
+/**
+ * \brief Helper function to get the endpoint of a role for a request.
+ *
+ */
+static struct role_endpoint *_endpoint(role *r, int kind)
+{
+  switch (r->type) {
+    case SESSION_ROLE_P2P:
+      return r->p2p;
+    case SESSION_ROLE_GRP:
+      return (kind == SC_REQ_SEND) ? r->grp->out : r->grp->in;
+    default:
+      fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+  }
+
+  return NULL;
+}
+
+
+/**
+ * \brief Helper function to append a request to an endpoint queue.
+ *
+ */
+static void _enqueue(void **queue, sc_request *req)
+{
+  sc_request **tail = (sc_request **)queue;
+
+  while (*tail != NULL) {
+    tail = &(*tail)->next;
+  }
+  req->next = NULL;
+  *tail = req;
+}
+
+
+/**
+ * \brief Helper function to remove a request from its endpoint queue.
+ *
+ */
+static void _dequeue(void **queue, sc_request *req)
+{
+  sc_request **prev = (sc_request **)queue;
+
+  while (*prev != NULL && *prev != req) {
+    prev = &(*prev)->next;
+  }
+  if (*prev != NULL) *prev = req->next;
+  req->next = NULL;
+}
+
+
+/**
+ * \brief Helper function to send queued messages of an endpoint
+ * until the endpoint would block.
+ *
+ */
+static void _progress_send(struct role_endpoint *ep)
+{
+  sc_request *req;
+
+  while ((req = (sc_request *)ep->sendq) != NULL) {
+    if (sc_msg_send_built(ep, (zmq_msg_t *)req->msg, ZMQ_DONTWAIT) == 0) {
+      req->rc = 0;
+    } else if (errno == EAGAIN) {
+      return;
+    } else {
+      perror(__FUNCTION__);
+      req->rc = -1;
+    }
+
+    zmq_msg_close((zmq_msg_t *)req->msg);
+    free(req->msg);
+    req->msg  = NULL;
+    req->done = 1;
+
+    ep->sendq = req->next;
+    req->next = NULL;
+  }
+}
+
+
+/**
+ * \brief Helper function to match received messages of an endpoint
+ * to queued receives until the endpoint would block.
+ *
+ */
+static void _progress_recv(struct role_endpoint *ep)
+{
+  int rc = 0;
+  int err;
+  sc_request *req;
+  sc_msg m;
+
+  while ((req = (sc_request *)ep->recvq) != NULL) {
+    rc = sc_msg_recv(ep, &m, ZMQ_DONTWAIT);
+    if (rc == 0) {
+      if (req->r->type == SESSION_ROLE_P2P) sc_msg_sequence(ep, &m);
+      rc = sc_msg_reject_iov(ep, &m, "sc_irecv");
+    }
+    if (rc == 0) {
+      rc = sc_msg_unpack(&m, req->buf, req->count, req->elem_size, req->type, "sc_irecv");
+    }
+    err = errno;
+    sc_msg_close(&m);
+
+    if (rc != 0) {
+      if (err == EAGAIN) return;
+      errno = err;
+      perror(__FUNCTION__);
+    }
+    req->rc = rc;
+    req->done = 1;
+
+    ep->recvq = req->next;
+    req->next = NULL;
+  }
+}
+
+
+/**
+ * \brief Helper function to make progress on the endpoint of a request.
+ *
+ */
+static void _progress(sc_request *req)
+{
+  if (req->kind == SC_REQ_SEND) {
+    _progress_send(req->ep);
+  } else {
+    _progress_recv(req->ep);
+  }
+}
+
+
+int sc_isend(const void *buf, size_t count, size_t elem_size, int type,
+             role *r, const char *label, sc_request *req)
+{
+  struct role_endpoint *ep;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(type %d, %zu elements) ", __FUNCTION__, type, count);
+  if (label != NULL) fprintf(stderr, "{label: %s}", label);
+#endif
+
+  memset(req, 0, sizeof(sc_request));
+  if ((ep = _endpoint(r, SC_REQ_SEND)) == NULL) return -1;
+
+  req->kind = SC_REQ_SEND;
+  req->r    = r;
+  req->ep   = ep;
+  if ((req->msg = malloc(sizeof(zmq_msg_t))) == NULL) {
+    perror(__FUNCTION__);
+    return -1;
+  }
+
+  // Copy the payload now so that buf can be reused straight away.
+  if (sc_msg_build((zmq_msg_t *)req->msg, ep, sc_label_id(label), type, buf, count, elem_size * count) != 0) {
+    perror(__FUNCTION__);
+    free(req->msg);
+    req->msg = NULL;
+    return -1;
+  }
+  req->active = 1;
+
+  _enqueue(&ep->sendq, req);
+  _progress_send(ep);
+
+#ifdef __DEBUG__
+  fprintf(stderr, "%s.\n", req->done ? "" : "[queued] ");
+#endif
+
+  return 0;
+}
+
+
+int sc_irecv(void *buf, size_t *count, size_t elem_size, int type,
+             role *r, sc_request *req)
+{
+  struct role_endpoint *ep;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-- %s(type %d) ", __FUNCTION__, type);
+#endif
+
+  memset(req, 0, sizeof(sc_request));
+  if ((ep = _endpoint(r, SC_REQ_RECV)) == NULL) return -1;
+
+  req->kind      = SC_REQ_RECV;
+  req->r         = r;
+  req->ep        = ep;
+  req->buf       = buf;
+  req->nelem     = 1;
+  req->count     = (count != NULL) ? count : &req->nelem;
+  req->elem_size = elem_size;
+  req->type      = type;
+  req->active    = 1;
+
+  _enqueue(&ep->recvq, req);
+  _progress_recv(ep);
+
+#ifdef __DEBUG__
+  fprintf(stderr, "%s.\n", req->done ? "" : "[queued] ");
+#endif
+
+  return 0;
+}
+
+
+int sc_test(sc_request *req, int *flag)
+{
+  *flag = 0;
+
+  if (!req->active) {
+    *flag = 1;
+    return req->rc;
+  }
+
+  if (!req->done) _progress(req);
+
+  if (req->done) {
+    req->active = 0;
+    *flag = 1;
+    return req->rc;
+  }
+
+  return 0;
+}
+
+
+void sc_cancel(sc_request *req)
+{
+  if (!req->active) return;
+
+  if (!req->done) {
+    if (req->kind == SC_REQ_SEND) {
+      _dequeue(&req->ep->sendq, req);
+      zmq_msg_close((zmq_msg_t *)req->msg);
+      free(req->msg);
+      req->msg = NULL;
+    } else {
+      _dequeue(&req->ep->recvq, req);
+    }
+    req->rc = -1;
+  }
+  req->active = 0;
+}
+
+
+/**
+ * \brief Helper function to cancel the unfinished requests of a
+ * failed wait, so that no endpoint refers to them afterwards.
+ *
+ */
+static void _cancel_pending(int n, sc_request reqs[])
+{
+  int i;
+  int err = errno;
+
+  for (i=0; i<n; ++i) {
+    if (reqs[i].active && !reqs[i].done) sc_cancel(&reqs[i]);
+  }
+  errno = err;
+}
+
+
+inline int sc_wait(sc_request *req)
+{
+  return sc_waitall(1, req);
+}
+
+
+int sc_waitall(int n, sc_request reqs[])
+{
+  int rc = 0;
+  int i;
+  int npending;
+  struct role_endpoint **eps = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * n);
+  short *events  = (short *)malloc(sizeof(short) * n);
+  short *revents = (short *)malloc(sizeof(short) * n);
+
+  if (eps == NULL || events == NULL || revents == NULL) {
+    perror(__FUNCTION__);
+    _cancel_pending(n, reqs);
+    rc = -1;
+  }
+
+  while (rc == 0) {
+    npending = 0;
+    for (i=0; i<n; ++i) {
+      if (!reqs[i].active || reqs[i].done) continue;
+      _progress(&reqs[i]);
+      if (!reqs[i].done) {
+        eps[npending]    = reqs[i].ep;
+        events[npending] = (reqs[i].kind == SC_REQ_SEND) ? SC_POLLOUT : SC_POLLIN;
+        npending++;
+      }
+    }
+    if (npending == 0) break;
+
+    if (sc_msg_poll(eps, events, revents, npending, -1) < 0) {
+      perror(__FUNCTION__);
+      _cancel_pending(n, reqs);
+      rc = -1;
+      break;
+    }
+  }
+
+  for (i=0; i<n; ++i) {
+    if (reqs[i].active && reqs[i].done) {
+      rc |= reqs[i].rc;
+      reqs[i].active = 0;
+    }
+  }
+
+  free(eps);
+  free(events);
+  free(revents);
+
+  return rc;
+}
+
+
+int sc_waitany(int n, sc_request reqs[], int *index)
+{
+  int rc = 0;
+  int i;
+  int npending;
+  struct role_endpoint **eps = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * n);
+  short *events  = (short *)malloc(sizeof(short) * n);
+  short *revents = (short *)malloc(sizeof(short) * n);
+
+  *index = -1;
+  if (eps == NULL || events == NULL || revents == NULL) {
+    perror(__FUNCTION__);
+    _cancel_pending(n, reqs);
+    rc = -1;
+  }
+
+  while (rc == 0 && *index < 0) {
+    npending = 0;
+    for (i=0; i<n && *index<0; ++i) {
+      if (!reqs[i].active) continue;
+      if (!reqs[i].done) _progress(&reqs[i]);
+      if (reqs[i].done) {
+        reqs[i].active = 0;
+        rc = reqs[i].rc;
+        *index = i;
+      } else {
+        eps[npending]    = reqs[i].ep;
+        events[npending] = (reqs[i].kind == SC_REQ_SEND) ? SC_POLLOUT : SC_POLLIN;
+        npending++;
+      }
+    }
+    if (*index >= 0 || npending == 0) break;
+
+    if (sc_msg_poll(eps, events, revents, npending, -1) < 0) {
+      perror(__FUNCTION__);
+      _cancel_pending(n, reqs);
+      rc = -1;
+      break;
+    }
+  }
+
+  free(eps);
+  free(events);
+  free(revents);
+
+  return rc;
+}
+
+
+void sc_async_flush(struct role_endpoint *ep, int kind)
+{
+  short events;
+  short revents;
+
+  while (1) {
+    if (kind & SC_REQ_SEND) _progress_send(ep);
+    if (kind & SC_REQ_RECV) _progress_recv(ep);
+
+    events = 0;
+    if ((kind & SC_REQ_SEND) && ep->sendq != NULL) events |= SC_POLLOUT;
+    if ((kind & SC_REQ_RECV) && ep->recvq != NULL) events |= SC_POLLIN;
+    if (events == 0) return;
+
+    if (sc_msg_poll(&ep, &events, &revents, 1, -1) < 0) {
+      perror(__FUNCTION__);
+      return;
+    }
+  }
+}
+
+
+/**
+ * Define the typed non-blocking family of an element type
+ * on top of the generic primitives.
+ */
+#define SC_DEFINE_ASYNC_PRIMITIVES(name, ctype, sctype)                                       \
+  int isend_##name(ctype val, role *r, const char *label, sc_request *req)                    \
+  {                                                                                           \
+    return sc_isend(&val, 1, sizeof(ctype), sctype, r, label, req);                           \
+  }                                                                                           \
+  int isend_##name##_array(const ctype arr[], size_t count, role *r, const char *label,       \
+                           sc_request *req)                                                   \
+  {                                                                                           \
+    return sc_isend(arr, count, sizeof(ctype), sctype, r, label, req);                        \
+  }                                                                                           \
+  int irecv_##name(ctype *dst, role *r, sc_request *req)                                      \
+  {                                                                                           \
+    return sc_irecv(dst, NULL, sizeof(ctype), sctype, r, req);                                \
+  }                                                                                           \
+  int irecv_##name##_array(ctype *arr, size_t *count, role *r, sc_request *req)               \
+  {                                                                                           \
+    return sc_irecv(arr, count, sizeof(ctype), sctype, r, req);                               \
+  }
+
+SC_PRIMITIVE_TYPES(SC_DEFINE_ASYNC_PRIMITIVES)
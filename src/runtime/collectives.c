@@ -0,0 +1,1133 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * collective operations module.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sc/async.h"
+#include "sc/collectives.h"
+#include "sc/primitives.h"
+#include "sc/session.h"
+
+
+/**
+ * Spanning tree of the connections of a session, rooted at a rank.
+ *
+ * Ranks are numbered in preorder, so the subtree of rank r is
+ * order[pos[r]] .. order[pos[r] + size[r] - 1], starting with r.
+ */
+struct sc_span
+{
+  int root;       // Root rank (-1 if not built)
+  int *parent;    // Parent of each rank (-1 for the root)
+  int *child_off; // Children of rank r are child[child_off[r]] .. child[child_off[r+1] - 1]
+  int *child;
+  int *order;     // Ranks in preorder
+  int *pos;       // Position of each rank in order
+  int *size;      // Number of ranks in the subtree of each rank
+};
+
+
+/**
+ * Ranks of a session (roles sorted by name).
+ */
+struct sc_comm
+{
+  int nrank;
+  int rank;      // Rank of this role
+  role **ranks;  // Role of each rank (null for this role)
+  char **names;  // Name of each rank
+
+  // Connections between ranks (communication graph).
+  int full;      // Every pair of ranks is connected
+  int *adj_off;  // Ranks connected to rank r are adj[adj_off[r]] .. adj[adj_off[r+1] - 1]
+  int *adj;
+
+  struct sc_span span; // Collectives along the connections if not full (last root used)
+};
+
+
+/**
+ * \brief Helper function to compare role names.
+ *
+ */
+static int _compare_names(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+
+/**
+ * \brief Helper function to compare ranks.
+ *
+ */
+static int _compare_ranks(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+
+/**
+ * \brief Helper function to find the rank of a role name (-1 if none).
+ *
+ */
+static int _rank_of(struct sc_comm *comm, const char *name)
+{
+  char **found = (char **)bsearch(&name, comm->names, comm->nrank, sizeof(char *), _compare_names);
+
+  return (found == NULL) ? -1 : found - comm->names;
+}
+
+
+/**
+ * \brief Helper function to index the connections between the
+ * ranks of a session.
+ *
+ */
+static void _comm_graph(struct sc_comm *comm, session *s)
+{
+  int n = comm->nrank;
+  int *degree = (int *)calloc(n, sizeof(int));
+  int *from = (int *)malloc(sizeof(int) * (s->nlink + 1));
+  int *to   = (int *)malloc(sizeof(int) * (s->nlink + 1));
+  unsigned int i;
+  int r, k, nadj;
+
+  comm->adj_off = (int *)calloc(n + 1, sizeof(int));
+
+  for (i=0; i<s->nlink; ++i) {
+    from[i] = _rank_of(comm, s->links[i].from);
+    to[i]   = _rank_of(comm, s->links[i].to);
+    if (from[i] < 0 || to[i] < 0 || from[i] == to[i]) continue;
+    comm->adj_off[from[i] + 1]++;
+    comm->adj_off[to[i] + 1]++;
+  }
+  for (r=0; r<n; ++r) {
+    comm->adj_off[r + 1] += comm->adj_off[r];
+  }
+
+  comm->adj = (int *)malloc(sizeof(int) * (comm->adj_off[n] + 1));
+  for (i=0; i<s->nlink; ++i) {
+    if (from[i] < 0 || to[i] < 0 || from[i] == to[i]) continue;
+    comm->adj[comm->adj_off[from[i]] + degree[from[i]]++] = to[i];
+    comm->adj[comm->adj_off[to[i]] + degree[to[i]]++] = from[i];
+  }
+
+  // Sort and drop duplicates (a pair may be listed both ways).
+  comm->full = 1;
+  for (r=0, nadj=0; r<n; ++r) {
+    k = comm->adj_off[r];
+    qsort(&comm->adj[k], degree[r], sizeof(int), _compare_ranks);
+    comm->adj_off[r] = nadj;
+    for (i=0; i<(unsigned int)degree[r]; ++i) {
+      if (nadj == comm->adj_off[r] || comm->adj[k + i] != comm->adj[nadj - 1]) {
+        comm->adj[nadj++] = comm->adj[k + i];
+      }
+    }
+    if (nadj - comm->adj_off[r] < n - 1) comm->full = 0;
+  }
+  comm->adj_off[n] = nadj;
+  if (s->links == NULL) comm->full = 1; // Every pair connected.
+
+  comm->span.root      = -1;
+  comm->span.parent    = (int *)malloc(sizeof(int) * n);
+  comm->span.child_off = (int *)malloc(sizeof(int) * (n + 1));
+  comm->span.child     = (int *)malloc(sizeof(int) * n);
+  comm->span.order     = (int *)malloc(sizeof(int) * n);
+  comm->span.pos       = (int *)malloc(sizeof(int) * n);
+  comm->span.size      = (int *)malloc(sizeof(int) * n);
+
+  free(degree);
+  free(from);
+  free(to);
+}
+
+
+/**
+ * \brief Helper function to get (building on first use) the ranks of a session.
+ *
+ */
+static struct sc_comm *_comm(session *s)
+{
+  struct sc_comm *comm = (struct sc_comm *)s->comm;
+  struct role_group *others = s->others->grp;
+  int i, j;
+
+  if (comm != NULL) return comm;
+
+  comm = (struct sc_comm *)malloc(sizeof(struct sc_comm));
+  comm->nrank = others->nendpoint + 1;
+  comm->ranks = (role **)malloc(sizeof(role *) * comm->nrank);
+  comm->names = (char **)malloc(sizeof(char *) * comm->nrank);
+
+  for (i=0; i<others->nendpoint; ++i) {
+    comm->names[i] = others->endpoints[i]->name;
+  }
+  comm->names[others->nendpoint] = s->name;
+  qsort(comm->names, comm->nrank, sizeof(char *), _compare_names);
+
+  // Members of _Others are roles[0..nendpoint-1].
+  for (i=0; i<comm->nrank; ++i) {
+    comm->ranks[i] = NULL;
+    if (strcmp(comm->names[i], s->name) == 0) {
+      comm->rank = i;
+      continue;
+    }
+    for (j=0; j<others->nendpoint; ++j) {
+      if (others->endpoints[j]->name == comm->names[i]) {
+        comm->ranks[i] = s->roles[j];
+        break;
+      }
+    }
+  }
+
+  _comm_graph(comm, s);
+
+  s->comm = comm;
+  return comm;
+}
+
+
+/**
+ * \brief Helper function to get the spanning tree of the connections
+ * rooted at a rank (breadth first, so that it is shallow).
+ *
+ */
+static struct sc_span *_span(struct sc_comm *comm, int root, const char *func)
+{
+  struct sc_span *span = &comm->span;
+  int n = comm->nrank;
+  int *queue = span->order; // Breadth first order, replaced by preorder below.
+  int *stack;
+  int head, tail, top;
+  int u, v, k;
+
+  if (span->root == root) return span;
+
+  for (u=0; u<n; ++u) {
+    span->parent[u] = -2;
+    span->child_off[u+1] = 0;
+  }
+  span->parent[root] = -1;
+  queue[0] = root;
+  for (head=0, tail=1; head<tail; ++head) {
+    u = queue[head];
+    for (k=comm->adj_off[u]; k<comm->adj_off[u+1]; ++k) {
+      v = comm->adj[k];
+      if (span->parent[v] != -2) continue;
+      span->parent[v] = u;
+      span->child_off[u+1]++;
+      queue[tail++] = v;
+    }
+  }
+  if (tail < n) {
+    fprintf(stderr, "%s: %d roles not connected to %s\n", func, n - tail, comm->names[root]);
+    span->root = -1;
+    errno = ENOTCONN;
+    return NULL;
+  }
+
+  // Children of each rank, in breadth first order.
+  span->child_off[0] = 0;
+  for (u=0; u<n; ++u) {
+    span->child_off[u+1] += span->child_off[u];
+    span->size[u] = 0; // Children placed so far.
+  }
+  for (head=1; head<n; ++head) {
+    v = queue[head];
+    u = span->parent[v];
+    span->child[span->child_off[u] + span->size[u]++] = v;
+  }
+
+  // Preorder (depth first), children in order.
+  stack = (int *)malloc(sizeof(int) * n);
+  stack[0] = root;
+  for (top=1, head=0; top>0; ) {
+    u = stack[--top];
+    span->order[head] = u;
+    span->pos[u] = head++;
+    for (k=span->child_off[u+1]-1; k>=span->child_off[u]; --k) {
+      stack[top++] = span->child[k];
+    }
+  }
+  free(stack);
+
+  for (head=n-1; head>=0; --head) {
+    u = span->order[head];
+    span->size[u] = 1;
+    for (k=span->child_off[u]; k<span->child_off[u+1]; ++k) {
+      span->size[u] += span->size[span->child[k]];
+    }
+  }
+
+  span->root = root;
+  return span;
+}
+
+
+/**
+ * \brief Helper function to find the rank of a root role.
+ *
+ */
+static int _root(struct sc_comm *comm, const char *root, const char *func)
+{
+  char **found = (char **)bsearch(&root, comm->names, comm->nrank, sizeof(char *), _compare_names);
+
+  if (found == NULL) {
+    fprintf(stderr, "%s: Root role %s not found in session\n", func, root);
+    errno = EINVAL;
+    return -1;
+  }
+
+  return found - comm->names;
+}
+
+
+/**
+ * \brief Helper function to receive exactly count elements from a rank.
+ *
+ */
+static int _recv_exact(void *buf, size_t count, size_t elem_size, int type, role *r)
+{
+  size_t n = count;
+
+  if (sc_recv(buf, &n, elem_size, type, r) != 0) return -1;
+  if (n != count) {
+    fprintf(stderr, "%s: Received %zu elements, expecting %zu\n", __FUNCTION__, n, count);
+    errno = EPROTO;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * Define the element-wise combine kernel of an element type.
+ * The loops are written so that the compiler vectorises them.
+ */
+#define SC_DEFINE_COMBINE(name, ctype, sctype)                                                \
+  static int _combine_##name(ctype *restrict inout, const ctype *restrict in,                 \
+                             size_t count, int op)                                            \
+  {                                                                                           \
+    size_t i;                                                                                 \
+    switch (op) {                                                                             \
+      case SC_OP_SUM:                                                                         \
+        for (i=0; i<count; ++i) inout[i] = inout[i] + in[i];                                  \
+        break;                                                                                \
+      case SC_OP_PROD:                                                                        \
+        for (i=0; i<count; ++i) inout[i] = inout[i] * in[i];                                  \
+        break;                                                                                \
+      case SC_OP_MIN:                                                                         \
+        for (i=0; i<count; ++i) inout[i] = (in[i] < inout[i]) ? in[i] : inout[i];             \
+        break;                                                                                \
+      case SC_OP_MAX:                                                                         \
+        for (i=0; i<count; ++i) inout[i] = (in[i] > inout[i]) ? in[i] : inout[i];             \
+        break;                                                                                \
+      default:                                                                                \
+        return -1;                                                                            \
+    }                                                                                         \
+    return 0;                                                                                 \
+  }
+
+SC_PRIMITIVE_TYPES(SC_DEFINE_COMBINE)
+
+
+/**
+ * \brief Helper function to combine a partial result into an accumulator.
+ *
+ */
+static int _combine(void *inout, const void *in, size_t count, int type,
+                    int op, sc_op_fn *fn)
+{
+  int rc = -1;
+
+  if (op == SC_OP_USER) {
+    if (fn == NULL) { // eg. from the typed wrappers
+      fprintf(stderr, "%s: No function for user-defined operator\n", __FUNCTION__);
+      errno = EINVAL;
+      return -1;
+    }
+    fn(inout, in, count, type);
+    return 0;
+  }
+
+#define SC_COMBINE_CASE(name, ctype, sctype)                                                  \
+    case sctype:                                                                              \
+      rc = _combine_##name((ctype *)inout, (const ctype *)in, count, op);                     \
+      break;
+
+  switch (type) {
+    SC_PRIMITIVE_TYPES(SC_COMBINE_CASE)
+  }
+
+#undef SC_COMBINE_CASE
+
+  if (rc != 0) {
+    fprintf(stderr, "%s: Unsupported operator %d on type %d\n", __FUNCTION__, op, type);
+    errno = EINVAL;
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to broadcast along a binomial tree.
+ *
+ * Rank (root + vrank) receives from the rank that differs in the
+ * lowest set bit of vrank, then forwards to the ranks below that bit.
+ */
+static int _bcast_tree(void *buf, size_t count, size_t elem_size, int type,
+                       int root, struct sc_comm *comm)
+{
+  int rc = 0;
+  int n = comm->nrank;
+  int vrank = (comm->rank - root + n) % n;
+  int mask;
+
+  for (mask=1; mask<n; mask<<=1) {
+    if (vrank & mask) {
+      rc |= _recv_exact(buf, count, elem_size, type, comm->ranks[(vrank - mask + root) % n]);
+      break;
+    }
+  }
+
+  for (mask>>=1; mask>0; mask>>=1) {
+    if (vrank + mask < n) {
+      rc |= sc_send(buf, count, elem_size, type, comm->ranks[(vrank + mask + root) % n], NULL);
+    }
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to broadcast around a ring in segments.
+ *
+ * Each rank forwards a segment to its successor as soon as it
+ * arrives, so all links carry data at the same time.
+ */
+static int _bcast_ring(void *buf, size_t count, size_t elem_size, int type,
+                       int root, struct sc_comm *comm)
+{
+  int rc = 0;
+  int n = comm->nrank;
+  int vrank = (comm->rank - root + n) % n;
+  role *prev = comm->ranks[(comm->rank - 1 + n) % n];
+  role *next = comm->ranks[(comm->rank + 1) % n];
+  size_t seg_count = (SC_BCAST_SEGMENT_SIZE > elem_size) ? SC_BCAST_SEGMENT_SIZE / elem_size : 1;
+  size_t offset, seg;
+
+  for (offset=0; offset<count; offset+=seg) {
+    seg = (count - offset < seg_count) ? count - offset : seg_count;
+    if (vrank > 0) {
+      rc |= _recv_exact((char *)buf + offset * elem_size, seg, elem_size, type, prev);
+    }
+    if (vrank < n-1) {
+      rc |= sc_send((char *)buf + offset * elem_size, seg, elem_size, type, next, NULL);
+    }
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to reduce along a binomial tree into acc
+ * (the result is complete at the root only).
+ *
+ * Mirror image of _bcast_tree: rank (root + vrank) combines the
+ * partial results of the ranks below its lowest set bit, then sends
+ * its own partial result up.
+ */
+static int _reduce_tree(void *acc, void *tmp, size_t count, size_t elem_size, int type,
+                        int op, sc_op_fn *fn, int root, struct sc_comm *comm)
+{
+  int rc = 0;
+  int n = comm->nrank;
+  int vrank = (comm->rank - root + n) % n;
+  int mask;
+
+  for (mask=1; mask<n; mask<<=1) {
+    if (vrank & mask) {
+      rc |= sc_send(acc, count, elem_size, type, comm->ranks[(vrank - mask + root) % n], NULL);
+      break;
+    }
+    if (vrank + mask < n) {
+      rc |= _recv_exact(tmp, count, elem_size, type, comm->ranks[(vrank + mask + root) % n]);
+      if (rc == 0) rc |= _combine(acc, tmp, count, type, op, fn);
+    }
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to reduce by recursive doubling
+ * (power of two number of ranks only).
+ *
+ * In round k every rank exchanges its partial result with the rank
+ * differing in bit k, so all ranks hold the result after log2(n) rounds.
+ */
+static int _allreduce_rd(void *acc, void *tmp, size_t count, size_t elem_size, int type,
+                         int op, sc_op_fn *fn, struct sc_comm *comm)
+{
+  int rc = 0;
+  int mask;
+  role *partner;
+
+  for (mask=1; mask<comm->nrank; mask<<=1) {
+    partner = comm->ranks[comm->rank ^ mask];
+    rc |= sc_send(acc, count, elem_size, type, partner, NULL);
+    rc |= _recv_exact(tmp, count, elem_size, type, partner);
+    if (rc == 0) rc |= _combine(acc, tmp, count, type, op, fn);
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to exchange blocks with all other ranks.
+ *
+ * Receives of block i from rank i are posted first (straight into
+ * recvbuf, if not null), then sends of the block at sendbuf + i *
+ * send_stride to rank i (if sendbuf is not null), and all requests
+ * are completed together.
+ */
+static int _exchange(const void *sendbuf, size_t send_stride, void *recvbuf,
+                     size_t count, size_t elem_size, int type, struct sc_comm *comm)
+{
+  int rc = 0;
+  int i;
+  int nreq = 0;
+  size_t block = count * elem_size;
+  sc_request *reqs = (sc_request *)malloc(sizeof(sc_request) * 2 * comm->nrank);
+  size_t *counts = (size_t *)malloc(sizeof(size_t) * comm->nrank);
+
+  for (i=0; i<comm->nrank && recvbuf!=NULL; ++i) {
+    if (i == comm->rank) continue;
+    counts[i] = count;
+    rc |= sc_irecv((char *)recvbuf + i * block, &counts[i], elem_size, type, comm->ranks[i], &reqs[nreq++]);
+  }
+
+  for (i=0; i<comm->nrank && sendbuf!=NULL; ++i) {
+    if (i == comm->rank) continue;
+    rc |= sc_isend((const char *)sendbuf + i * send_stride, count, elem_size, type, comm->ranks[i], NULL, &reqs[nreq++]);
+  }
+
+  rc |= sc_waitall(nreq, reqs);
+
+  for (i=0; i<comm->nrank && recvbuf!=NULL; ++i) {
+    if (i != comm->rank && counts[i] != count) {
+      fprintf(stderr, "%s: Received %zu elements from rank %d, expecting %zu\n", __FUNCTION__, counts[i], i, count);
+      errno = EPROTO;
+      rc = -1;
+    }
+  }
+
+  free(reqs);
+  free(counts);
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to broadcast along the spanning tree of the
+ * connections (not every pair of ranks is connected).
+ *
+ */
+static int _span_bcast(void *buf, size_t count, size_t elem_size, int type,
+                       int root, struct sc_comm *comm)
+{
+  int rc = 0;
+  int me = comm->rank;
+  int k;
+  struct sc_span *span;
+
+  if ((span = _span(comm, root, __FUNCTION__)) == NULL) return -1;
+
+  if (span->parent[me] >= 0) {
+    rc |= _recv_exact(buf, count, elem_size, type, comm->ranks[span->parent[me]]);
+  }
+  for (k=span->child_off[me]; k<span->child_off[me+1] && rc==0; ++k) {
+    rc |= sc_send(buf, count, elem_size, type, comm->ranks[span->child[k]], NULL);
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to reduce along the spanning tree of the
+ * connections into acc (the result is complete at the root only).
+ *
+ */
+static int _span_reduce(void *acc, void *tmp, size_t count, size_t elem_size, int type,
+                        int op, sc_op_fn *fn, int root, struct sc_comm *comm)
+{
+  int rc = 0;
+  int me = comm->rank;
+  int k;
+  struct sc_span *span;
+
+  if ((span = _span(comm, root, __FUNCTION__)) == NULL) return -1;
+
+  for (k=span->child_off[me]; k<span->child_off[me+1] && rc==0; ++k) {
+    rc |= _recv_exact(tmp, count, elem_size, type, comm->ranks[span->child[k]]);
+    if (rc == 0) rc |= _combine(acc, tmp, count, type, op, fn);
+  }
+  if (span->parent[me] >= 0 && rc == 0) {
+    rc |= sc_send(acc, count, elem_size, type, comm->ranks[span->parent[me]], NULL);
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to gather count elements of every rank along
+ * the spanning tree of the connections, into result (by rank) at the root.
+ *
+ * Each rank forwards the blocks of its subtree in preorder.
+ */
+static int _span_gather(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                        int root, struct sc_comm *comm)
+{
+  int rc = 0;
+  int me = comm->rank;
+  int i, k, c;
+  size_t block = count * elem_size;
+  char *sub;
+  struct sc_span *span;
+
+  if ((span = _span(comm, root, __FUNCTION__)) == NULL) return -1;
+
+  sub = (char *)malloc(span->size[me] * block + 1);
+  memmove(sub, buf, block);
+  for (k=span->child_off[me]; k<span->child_off[me+1] && rc==0; ++k) {
+    c = span->child[k];
+    rc |= _recv_exact(sub + (span->pos[c] - span->pos[me]) * block, span->size[c] * count, elem_size, type, comm->ranks[c]);
+  }
+
+  if (span->parent[me] >= 0) {
+    if (rc == 0) rc |= sc_send(sub, span->size[me] * count, elem_size, type, comm->ranks[span->parent[me]], NULL);
+  } else {
+    for (i=0; i<comm->nrank; ++i) {
+      memmove((char *)result + span->order[i] * block, sub + i * block, block);
+    }
+  }
+  free(sub);
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to scatter count elements to every rank along
+ * the spanning tree of the connections, from buf (by rank) at the root.
+ *
+ * Each rank forwards the blocks of the subtrees of its children in preorder.
+ */
+static int _span_scatter(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                         int root, struct sc_comm *comm)
+{
+  int rc = 0;
+  int me = comm->rank;
+  int i, k, c;
+  size_t block = count * elem_size;
+  char *sub;
+  struct sc_span *span;
+
+  if ((span = _span(comm, root, __FUNCTION__)) == NULL) return -1;
+
+  sub = (char *)malloc(span->size[me] * block + 1);
+  if (span->parent[me] >= 0) {
+    rc |= _recv_exact(sub, span->size[me] * count, elem_size, type, comm->ranks[span->parent[me]]);
+  } else {
+    for (i=0; i<comm->nrank; ++i) {
+      memmove(sub + i * block, (const char *)buf + span->order[i] * block, block);
+    }
+  }
+
+  for (k=span->child_off[me]; k<span->child_off[me+1] && rc==0; ++k) {
+    c = span->child[k];
+    rc |= sc_send(sub + (span->pos[c] - span->pos[me]) * block, span->size[c] * count, elem_size, type, comm->ranks[c], NULL);
+  }
+  memmove(result, sub, block);
+  free(sub);
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to exchange blocks between all ranks through
+ * the root of the spanning tree of the connections (rank 0), which
+ * gathers every block and scatters them back transposed.
+ *
+ */
+static int _span_alltoall(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                          struct sc_comm *comm)
+{
+  int rc = 0;
+  int n = comm->nrank;
+  int from, to;
+  size_t block = count * elem_size;
+  char *all = NULL;
+  char *out = NULL;
+
+  if (comm->rank == 0) {
+    all = (char *)malloc(n * n * block + 1);
+    out = (char *)malloc(n * n * block + 1);
+  }
+
+  rc = _span_gather(buf, all, n * count, elem_size, type, 0, comm);
+
+  // Block to of rank from becomes block from of rank to.
+  if (comm->rank == 0 && rc == 0) {
+    for (from=0; from<n; ++from) {
+      for (to=0; to<n; ++to) {
+        memcpy(out + (to * n + from) * block, all + (from * n + to) * block, block);
+      }
+    }
+  }
+
+  if (rc == 0) rc = _span_scatter(out, result, n * count, elem_size, type, 0, comm);
+
+  free(all);
+  free(out);
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to synchronise along the spanning tree of
+ * the connections (arrivals up to the root, release down).
+ *
+ */
+static int _span_barrier(struct sc_comm *comm)
+{
+  int rc = 0;
+  int me = comm->rank;
+  int k;
+  uint8_t token = 0;
+  struct sc_span *span;
+
+  if ((span = _span(comm, 0, __FUNCTION__)) == NULL) return -1;
+
+  for (k=span->child_off[me]; k<span->child_off[me+1] && rc==0; ++k) {
+    rc |= _recv_exact(&token, 1, sizeof(uint8_t), SC_TYPE_UINT8, comm->ranks[span->child[k]]);
+  }
+  if (span->parent[me] >= 0 && rc == 0) {
+    rc |= sc_send(&token, 1, sizeof(uint8_t), SC_TYPE_UINT8, comm->ranks[span->parent[me]], NULL);
+    rc |= _recv_exact(&token, 1, sizeof(uint8_t), SC_TYPE_UINT8, comm->ranks[span->parent[me]]);
+  }
+  for (k=span->child_off[me]; k<span->child_off[me+1] && rc==0; ++k) {
+    rc |= sc_send(&token, 1, sizeof(uint8_t), SC_TYPE_UINT8, comm->ranks[span->child[k]], NULL);
+  }
+
+  return rc;
+}
+
+
+int sc_nrank(session *s)
+{
+  return _comm(s)->nrank;
+}
+
+
+int sc_rank(session *s)
+{
+  return _comm(s)->rank;
+}
+
+
+int sc_rank_of(session *s, const char *name)
+{
+  return _rank_of(_comm(s), name);
+}
+
+
+role *sc_rank_role(session *s, int rank)
+{
+  struct sc_comm *comm = _comm(s);
+
+  return (rank >= 0 && rank < comm->nrank) ? comm->ranks[rank] : NULL;
+}
+
+
+int sc_bcast_alg(void *buf, size_t count, size_t elem_size, int type,
+                 const char *root, session *s, int alg)
+{
+  int rc = 0;
+  int root_rank;
+  size_t n = count;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(type %d, %zu elements, root %s, alg %d) ", __FUNCTION__, type, count, root, alg);
+#endif
+
+  if ((root_rank = _root(comm, root, __FUNCTION__)) < 0) return -1;
+  if (comm->nrank == 1) return 0;
+
+  // Roles not all connected: forward along the connections.
+  if (!comm->full && alg != SC_COLL_PUB) alg = SC_COLL_SPAN;
+
+  if (alg == SC_COLL_AUTO) {
+    alg = (count * elem_size >= SC_BCAST_RING_MIN_SIZE && comm->nrank >= SC_BCAST_RING_MIN_ROLES)
+          ? SC_COLL_RING : SC_COLL_TREE;
+  }
+
+  switch (alg) {
+    case SC_COLL_TREE:
+      rc = _bcast_tree(buf, count, elem_size, type, root_rank, comm);
+      break;
+    case SC_COLL_RING:
+      rc = _bcast_ring(buf, count, elem_size, type, root_rank, comm);
+      break;
+    case SC_COLL_SPAN:
+      rc = _span_bcast(buf, count, elem_size, type, root_rank, comm);
+      break;
+    case SC_COLL_PUB:
+      if (root_rank == comm->rank) {
+        rc = sc_send(buf, count, elem_size, type, s->others, NULL);
+      } else {
+        rc = sc_recv(buf, &n, elem_size, type, s->others);
+      }
+      break;
+    default:
+      fprintf(stderr, "%s: Unknown algorithm: %d\n", __FUNCTION__, alg);
+      errno = EINVAL;
+      rc = -1;
+  }
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+inline int sc_bcast(void *buf, size_t count, size_t elem_size, int type,
+                    const char *root, session *s)
+{
+  return sc_bcast_alg(buf, count, elem_size, type, root, s, SC_COLL_AUTO);
+}
+
+
+int sc_reduce(const void *buf, void *result, size_t count, size_t elem_size, int type,
+              int op, sc_op_fn *fn, const char *root, session *s)
+{
+  int rc = 0;
+  int root_rank;
+  void *acc, *tmp;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(type %d, %zu elements, op %d, root %s) ", __FUNCTION__, type, count, op, root);
+#endif
+
+  if ((root_rank = _root(comm, root, __FUNCTION__)) < 0) return -1;
+
+  // Accumulate in place at the root.
+  acc = (root_rank == comm->rank) ? result : malloc(count * elem_size + 1);
+  tmp = malloc(count * elem_size + 1);
+  if (acc != buf) memmove(acc, buf, count * elem_size);
+
+  if (comm->full) {
+    rc = _reduce_tree(acc, tmp, count, elem_size, type, op, fn, root_rank, comm);
+  } else {
+    rc = _span_reduce(acc, tmp, count, elem_size, type, op, fn, root_rank, comm);
+  }
+
+  if (acc != result) free(acc);
+  free(tmp);
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int sc_allreduce(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                 int op, sc_op_fn *fn, session *s)
+{
+  int rc = 0;
+  void *tmp;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(type %d, %zu elements, op %d) ", __FUNCTION__, type, count, op);
+#endif
+
+  tmp = malloc(count * elem_size + 1);
+  if (result != buf) memmove(result, buf, count * elem_size);
+
+  if (!comm->full) {
+    rc = _span_reduce(result, tmp, count, elem_size, type, op, fn, 0, comm);
+    rc |= _span_bcast(result, count, elem_size, type, 0, comm);
+  } else if ((comm->nrank & (comm->nrank - 1)) == 0) {
+    rc = _allreduce_rd(result, tmp, count, elem_size, type, op, fn, comm);
+  } else {
+    rc = _reduce_tree(result, tmp, count, elem_size, type, op, fn, 0, comm);
+    rc |= sc_bcast(result, count, elem_size, type, comm->names[0], s);
+  }
+
+  free(tmp);
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int sc_scatter(const void *buf, void *result, size_t count, size_t elem_size, int type,
+               const char *root, session *s)
+{
+  int rc = 0;
+  int root_rank;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(type %d, %zu elements, root %s) ", __FUNCTION__, type, count, root);
+#endif
+
+  if ((root_rank = _root(comm, root, __FUNCTION__)) < 0) return -1;
+
+  if (!comm->full) {
+    rc = _span_scatter(buf, result, count, elem_size, type, root_rank, comm);
+  } else if (root_rank == comm->rank) {
+    rc = _exchange(buf, count * elem_size, NULL, count, elem_size, type, comm);
+    memmove(result, (const char *)buf + comm->rank * count * elem_size, count * elem_size);
+  } else {
+    rc = _recv_exact(result, count, elem_size, type, comm->ranks[root_rank]);
+  }
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int sc_gather(const void *buf, void *result, size_t count, size_t elem_size, int type,
+              const char *root, session *s)
+{
+  int rc = 0;
+  int root_rank;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(type %d, %zu elements, root %s) ", __FUNCTION__, type, count, root);
+#endif
+
+  if ((root_rank = _root(comm, root, __FUNCTION__)) < 0) return -1;
+
+  if (!comm->full) {
+    rc = _span_gather(buf, result, count, elem_size, type, root_rank, comm);
+  } else if (root_rank == comm->rank) {
+    memmove((char *)result + comm->rank * count * elem_size, buf, count * elem_size);
+    rc = _exchange(NULL, 0, result, count, elem_size, type, comm);
+  } else {
+    rc = sc_send(buf, count, elem_size, type, comm->ranks[root_rank], NULL);
+  }
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int sc_allgather(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                 session *s)
+{
+  int rc = 0;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(type %d, %zu elements) ", __FUNCTION__, type, count);
+#endif
+
+  if (!comm->full) {
+    rc = _span_gather(buf, result, count, elem_size, type, 0, comm);
+    rc |= _span_bcast(result, comm->nrank * count, elem_size, type, 0, comm);
+  } else {
+    memmove((char *)result + comm->rank * count * elem_size, buf, count * elem_size);
+    rc = _exchange((char *)result + comm->rank * count * elem_size, 0, result, count, elem_size, type, comm);
+  }
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int sc_alltoall(const void *buf, void *result, size_t count, size_t elem_size, int type,
+                session *s)
+{
+  int rc = 0;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(type %d, %zu elements) ", __FUNCTION__, type, count);
+#endif
+
+  if (!comm->full) {
+    rc = _span_alltoall(buf, result, count, elem_size, type, comm);
+  } else {
+    memmove((char *)result + comm->rank * count * elem_size, (const char *)buf + comm->rank * count * elem_size, count * elem_size);
+    rc = _exchange(buf, count * elem_size, result, count, elem_size, type, comm);
+  }
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int sc_barrier(session *s)
+{
+  int rc = 0;
+  int dist;
+  uint8_t round = 0;
+  uint8_t token;
+  sc_request req;
+  struct sc_comm *comm = _comm(s);
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s() ", __FUNCTION__);
+#endif
+
+  if (!comm->full) rc = _span_barrier(comm);
+
+  for (dist=1; dist<comm->nrank && rc==0 && comm->full; dist*=2, ++round) {
+    rc |= sc_isend(&round, 1, sizeof(uint8_t), SC_TYPE_UINT8, comm->ranks[(comm->rank + dist) % comm->nrank], NULL, &req);
+    rc |= _recv_exact(&token, 1, sizeof(uint8_t), SC_TYPE_UINT8, comm->ranks[(comm->rank - dist + comm->nrank) % comm->nrank]);
+    rc |= sc_wait(&req);
+    if (rc == 0 && token != round) {
+      fprintf(stderr, "%s: Received round %u, expecting %u\n", __FUNCTION__, token, round);
+      errno = EPROTO;
+      rc = -1;
+    }
+  }
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+void sc_coll_free(session *s)
+{
+  struct sc_comm *comm = (struct sc_comm *)s->comm;
+
+  if (comm != NULL) {
+    free(comm->span.parent);
+    free(comm->span.child_off);
+    free(comm->span.child);
+    free(comm->span.order);
+    free(comm->span.pos);
+    free(comm->span.size);
+    free(comm->adj_off);
+    free(comm->adj);
+    free(comm->ranks);
+    free(comm->names);
+    free(comm);
+  }
+  s->comm = NULL;
+}
+
+
+/**
+ * Define the typed collective family of an element type
+ * on top of the generic collectives.
+ */
+#define SC_DEFINE_COLL_PRIMITIVES(name, ctype, sctype)                                        \
+  int coll_bcast_##name(ctype *val, const char *root, session *s)                             \
+  {                                                                                           \
+    return sc_bcast(val, 1, sizeof(ctype), sctype, root, s);                                  \
+  }                                                                                           \
+  int coll_bcast_##name##_array(ctype *arr, size_t count, const char *root, session *s)       \
+  {                                                                                           \
+    return sc_bcast(arr, count, sizeof(ctype), sctype, root, s);                              \
+  }                                                                                           \
+  int coll_reduce_##name(ctype val, ctype *result, int op, const char *root, session *s)      \
+  {                                                                                           \
+    return sc_reduce(&val, result, 1, sizeof(ctype), sctype, op, NULL, root, s);              \
+  }                                                                                           \
+  int coll_reduce_##name##_array(const ctype arr[], ctype *result, size_t count, int op,      \
+                                 const char *root, session *s)                                \
+  {                                                                                           \
+    return sc_reduce(arr, result, count, sizeof(ctype), sctype, op, NULL, root, s);           \
+  }                                                                                           \
+  int coll_allreduce_##name(ctype val, ctype *result, int op, session *s)                     \
+  {                                                                                           \
+    return sc_allreduce(&val, result, 1, sizeof(ctype), sctype, op, NULL, s);                 \
+  }                                                                                           \
+  int coll_allreduce_##name##_array(const ctype arr[], ctype *result, size_t count, int op,   \
+                                    session *s)                                               \
+  {                                                                                           \
+    return sc_allreduce(arr, result, count, sizeof(ctype), sctype, op, NULL, s);              \
+  }                                                                                           \
+  int coll_scatter_##name##_array(const ctype arr[], ctype *result, size_t count,             \
+                                  const char *root, session *s)                               \
+  {                                                                                           \
+    return sc_scatter(arr, result, count, sizeof(ctype), sctype, root, s);                    \
+  }                                                                                           \
+  int coll_gather_##name##_array(const ctype arr[], ctype *result, size_t count,              \
+                                 const char *root, session *s)                                \
+  {                                                                                           \
+    return sc_gather(arr, result, count, sizeof(ctype), sctype, root, s);                     \
+  }                                                                                           \
+  int coll_allgather_##name##_array(const ctype arr[], ctype *result, size_t count,           \
+                                    session *s)                                               \
+  {                                                                                           \
+    return sc_allgather(arr, result, count, sizeof(ctype), sctype, s);                        \
+  }                                                                                           \
+  int coll_alltoall_##name##_array(const ctype arr[], ctype *result, size_t count,            \
+                                   session *s)                                                \
+  {                                                                                           \
+    return sc_alltoall(arr, result, count, sizeof(ctype), sctype, s);                         \
+  }
+
+SC_PRIMITIVE_TYPES(SC_DEFINE_COLL_PRIMITIVES)
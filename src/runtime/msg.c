@@ -0,0 +1,474 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * message encoding module.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zmq.h>
+
+#include "sc/msg.h"
+#include "sc/transport.h"
+#include "sc/types.h"
+#include "sc/utils.h"
+
+
+/**
+ * \brief Helper function to deallocate send queue.
+ *
+ */
+static void _dealloc(void *data, void *hint)
+{
+  free(data);
+}
+
+
+/**
+ * \brief Helper function to fill in a message header.
+ *
+ */
+static void _hdr_init(sc_msg_hdr *hdr, struct role_endpoint *ep, sc_label_t label, int type,
+                      size_t count, int flags)
+{
+  hdr->label = label;
+  hdr->type  = (uint16_t)type;
+  hdr->flags = (uint16_t)flags;
+  hdr->count = (uint32_t)count;
+  hdr->seq   = ep->seq_out++;
+}
+
+
+int sc_msg_build(zmq_msg_t *msg, struct role_endpoint *ep, sc_label_t label, int type,
+                 const void *buf, size_t count, size_t size)
+{
+  sc_msg_hdr hdr;
+
+  _hdr_init(&hdr, ep, label, type, count, 0);
+
+  // Header and payload in a single frame.
+  if (zmq_msg_init_size(msg, sizeof(sc_msg_hdr) + size) != 0) return -1;
+  memcpy(zmq_msg_data(msg), &hdr, sizeof(sc_msg_hdr));
+  if (size > 0) {
+    memcpy((char *)zmq_msg_data(msg) + sizeof(sc_msg_hdr), buf, size);
+  }
+
+  return 0;
+}
+
+
+int sc_msg_send_built(struct role_endpoint *ep, zmq_msg_t *msg, int flags)
+{
+  return (ep->transport->send(ep, msg, flags) < 0) ? -1 : 0;
+}
+
+
+int sc_msg_send(struct role_endpoint *ep, sc_label_t label, int type,
+                const void *buf, size_t count, size_t size, int flags)
+{
+  int rc = 0;
+  zmq_msg_t msg;
+
+  if (sc_msg_build(&msg, ep, label, type, buf, count, size) != 0) return -1;
+  rc = sc_msg_send_built(ep, &msg, flags);
+  zmq_msg_close(&msg);
+
+  return rc;
+}
+
+
+int sc_msg_send_nocopy(struct role_endpoint *ep, sc_label_t label, int type,
+                       void *buf, size_t count, size_t size,
+                       sc_free_fn *ffn, void *hint)
+{
+  int rc = 0;
+  zmq_msg_t msg;
+  sc_msg_hdr hdr;
+
+  if (ffn == NULL) ffn = _dealloc;
+
+  _hdr_init(&hdr, ep, label, type, count, SC_MSG_SPLIT);
+
+  if (zmq_msg_init_size(&msg, sizeof(sc_msg_hdr)) != 0) {
+    ffn(buf, hint);
+    return -1;
+  }
+  memcpy(zmq_msg_data(&msg), &hdr, sizeof(sc_msg_hdr));
+  rc = ep->transport->send(ep, &msg, ZMQ_SNDMORE);
+  zmq_msg_close(&msg);
+  if (rc < 0) { // buf is released even if it is never sent.
+    ffn(buf, hint);
+    return -1;
+  }
+
+  // Hand buf over to ZeroMQ, released through ffn (or free()).
+  if (zmq_msg_init_data(&msg, buf, size, ffn, hint) != 0) {
+    ffn(buf, hint);
+    return -1;
+  }
+  rc = ep->transport->send(ep, &msg, 0);
+  zmq_msg_close(&msg);
+
+  return (rc < 0) ? -1 : 0;
+}
+
+
+int sc_msg_send_iov(struct role_endpoint *ep, sc_label_t label,
+                    const struct iovec iov[], int iovcnt)
+{
+  int rc = 0;
+  int i;
+  zmq_msg_t msg;
+  sc_msg_hdr hdr;
+
+  _hdr_init(&hdr, ep, label, SC_TYPE_UINT8, iovcnt, SC_MSG_IOV);
+
+  if (zmq_msg_init_size(&msg, sizeof(sc_msg_hdr)) != 0) return -1;
+  memcpy(zmq_msg_data(&msg), &hdr, sizeof(sc_msg_hdr));
+  rc = ep->transport->send(ep, &msg, (iovcnt > 0) ? ZMQ_SNDMORE : 0);
+  zmq_msg_close(&msg);
+
+  // One frame per segment, no concatenation.
+  for (i=0; i<iovcnt && rc >= 0; ++i) {
+    if (zmq_msg_init_size(&msg, iov[i].iov_len) != 0) return -1;
+    if (iov[i].iov_len > 0) {
+      memcpy(zmq_msg_data(&msg), iov[i].iov_base, iov[i].iov_len);
+    }
+    rc = ep->transport->send(ep, &msg, (i < iovcnt-1) ? ZMQ_SNDMORE : 0);
+    zmq_msg_close(&msg);
+  }
+
+  return (rc < 0) ? -1 : 0;
+}
+
+
+int sc_msg_send_iov_nocopy(struct role_endpoint *ep, sc_label_t label,
+                           const struct iovec iov[], int iovcnt,
+                           sc_free_fn *ffn, void *hint)
+{
+  int rc = 0;
+  int i;
+  zmq_msg_t msg;
+  sc_msg_hdr hdr;
+
+  _hdr_init(&hdr, ep, label, SC_TYPE_UINT8, iovcnt, SC_MSG_IOV);
+
+  if (zmq_msg_init_size(&msg, sizeof(sc_msg_hdr)) == 0) {
+    memcpy(zmq_msg_data(&msg), &hdr, sizeof(sc_msg_hdr));
+    rc = ep->transport->send(ep, &msg, (iovcnt > 0) ? ZMQ_SNDMORE : 0);
+    zmq_msg_close(&msg);
+  } else {
+    rc = -1;
+  }
+
+  for (i=0; i<iovcnt && rc >= 0; ++i) {
+    if (zmq_msg_init_data(&msg, iov[i].iov_base, iov[i].iov_len, (ffn == NULL) ? _dealloc : ffn, hint) != 0) {
+      rc = -1;
+      break;
+    }
+    rc = ep->transport->send(ep, &msg, (i < iovcnt-1) ? ZMQ_SNDMORE : 0);
+    zmq_msg_close(&msg);
+  }
+
+  // Segments not handed over (on error) are still released.
+  for (; i<iovcnt; ++i) {
+    ((ffn == NULL) ? _dealloc : ffn)(iov[i].iov_base, hint);
+  }
+
+  return (rc < 0) ? -1 : 0;
+}
+
+
+int sc_msg_recv(struct role_endpoint *ep, sc_msg *m, int flags)
+{
+  int rc = 0;
+  sc_msg *pending = (sc_msg *)ep->pending;
+  size_t size;
+
+  zmq_msg_init(&m->msg);
+  memset(&m->hdr, 0, sizeof(sc_msg_hdr));
+  m->offset = 0;
+  m->size   = 0;
+  m->ready  = 0;
+
+  if (pending != NULL && pending != m && pending->ready) { // Received ahead.
+    zmq_msg_move(&m->msg, &pending->msg);
+    zmq_msg_close(&pending->msg);
+    m->hdr    = pending->hdr;
+    m->offset = pending->offset;
+    m->size   = pending->size;
+    pending->ready = 0;
+    return 0;
+  }
+
+  rc = ep->transport->recv(ep, &m->msg, flags);
+  if (rc < 0) return -1;
+
+  size = zmq_msg_size(&m->msg);
+  if (size < sizeof(sc_msg_hdr)) {
+    fprintf(stderr, "%s: Malformed message (%zu bytes) from %s\n", __FUNCTION__, size, ep->uri);
+    errno = EPROTO;
+    return -1;
+  }
+  memcpy(&m->hdr, zmq_msg_data(&m->msg), sizeof(sc_msg_hdr));
+
+  if (m->hdr.flags & SC_MSG_IOV) { // Segments left for sc_msg_recv_segment.
+    m->offset = sizeof(sc_msg_hdr);
+    m->size   = 0;
+  } else if (m->hdr.flags & SC_MSG_SPLIT) { // Payload in next frame.
+    zmq_msg_close(&m->msg);
+    zmq_msg_init(&m->msg);
+    rc = ep->transport->recv(ep, &m->msg, 0);
+    if (rc < 0) return -1;
+    m->offset = 0;
+    m->size   = zmq_msg_size(&m->msg);
+  } else {
+    m->offset = sizeof(sc_msg_hdr);
+    m->size   = size - sizeof(sc_msg_hdr);
+  }
+
+  return 0;
+}
+
+
+int sc_msg_recv_segment(struct role_endpoint *ep, zmq_msg_t *frame)
+{
+  return (ep->transport->recv(ep, frame, 0) < 0) ? -1 : 0;
+}
+
+
+int sc_msg_reject_iov(struct role_endpoint *ep, const sc_msg *m, const char *func)
+{
+  unsigned int i;
+  zmq_msg_t frame;
+
+  if (!(m->hdr.flags & SC_MSG_IOV)) return 0;
+
+  fprintf(stderr, "%s: Unexpected segmented message (%u segments), segments dropped\n",
+      func, m->hdr.count);
+
+  // Segments are sent along with the header.
+  for (i=0; i<m->hdr.count; ++i) {
+    zmq_msg_init(&frame);
+    if (sc_msg_recv_segment(ep, &frame) != 0) {
+      zmq_msg_close(&frame);
+      return -1;
+    }
+    zmq_msg_close(&frame);
+  }
+
+  errno = EPROTO;
+  return -1;
+}
+
+
+int sc_msg_check_type(const sc_msg *m, int type, size_t elem_size, const char *func)
+{
+  if (m->hdr.type != type || m->hdr.count * elem_size != m->size) {
+    fprintf(stderr, "%s: Unexpected message (type %u, %u elements, %zu bytes)\n",
+        func, m->hdr.type, m->hdr.count, m->size);
+    return 0;
+  }
+  return 1;
+}
+
+
+int sc_msg_unpack(sc_msg *m, void *buf, size_t *count, size_t elem_size, int type, const char *func)
+{
+  size_t size = m->size;
+
+  if (!sc_msg_check_type(m, type, elem_size, func)) {
+    *count = 0;
+    errno = EPROTO;
+    return -1;
+  }
+
+  if (*count * elem_size >= size) {
+    memcpy(buf, sc_msg_data(m), size);
+    if (size % elem_size == 0) {
+      *count = size / elem_size;
+    }
+  } else {
+    memcpy(buf, sc_msg_data(m), *count * elem_size);
+    fprintf(stderr,
+      "%s: Received data (%zu bytes) > memory size (%zu), data truncated\n",
+      func, size, *count * elem_size);
+  }
+
+  return 0;
+}
+
+
+void sc_msg_sequence(struct role_endpoint *ep, const sc_msg *m)
+{
+#ifdef __DEBUG__
+  if (m->hdr.seq != ep->seq_in) {
+    fprintf(stderr, "%s: Message #%u from %s out of sequence (expecting #%u)\n",
+        __FUNCTION__, m->hdr.seq, ep->name, ep->seq_in);
+  }
+#endif
+  ep->seq_in = m->hdr.seq + 1;
+}
+
+
+/**
+ * \brief Helper function to poll endpoints that can be waited on
+ * with zmq_poll (other endpoints are skipped).
+ *
+ * The pollitem of an event loop (SC_TRANSPORT_LOOP) is readable when
+ * any of its endpoints has events, the endpoints are then checked
+ * with poll, and waited on again if none of them is ready.
+ *
+ */
+static int _poll_wait(struct role_endpoint *eps[], const short events[], short revents[], int n, long timeout)
+{
+  int i;
+  int nitem = 0;
+  int nloop = 0;
+  int nready;
+  long wait;
+  long long deadline = (timeout > 0) ? sc_time() + timeout * 1000 : 0;
+  zmq_pollitem_t *items = (zmq_pollitem_t *)malloc(sizeof(zmq_pollitem_t) * n);
+  int *index = (int *)malloc(sizeof(int) * n);
+
+  if (items == NULL || index == NULL) {
+    free(items);
+    free(index);
+    return -1;
+  }
+
+  for (i=0; i<n; ++i) {
+    revents[i] = 0;
+    if (!(eps[i]->transport->caps & SC_TRANSPORT_WAIT)) continue;
+    if (eps[i]->transport->pollitem(eps[i], &items[nitem]) != 0) { // Not connected.
+      free(items);
+      free(index);
+      return -1;
+    }
+    if (eps[i]->transport->caps & SC_TRANSPORT_LOOP) {
+      items[nitem].events = ZMQ_POLLIN;
+      nloop++;
+    } else {
+      items[nitem].events = ((events[i] & SC_POLLIN) ? ZMQ_POLLIN : 0) | ((events[i] & SC_POLLOUT) ? ZMQ_POLLOUT : 0);
+    }
+    items[nitem].revents = 0;
+    index[nitem++] = i;
+  }
+
+  while (1) {
+    nready = 0;
+    for (i=0; i<nitem && nloop>0; ++i) {
+      if (!(eps[index[i]]->transport->caps & SC_TRANSPORT_LOOP)) continue;
+      if ((revents[index[i]] = eps[index[i]]->transport->poll(eps[index[i]], events[index[i]])) != 0) nready++;
+    }
+
+    wait = timeout;
+    if (nready > 0) {
+      wait = 0;
+    } else if (timeout > 0) {
+      wait = (deadline > sc_time()) ? (long)((deadline - sc_time()) / 1000) : 0;
+    }
+    if (nitem > 0 && zmq_poll(items, nitem, wait) < 0) {
+      nready = -1;
+      break;
+    }
+
+    for (i=0; i<nitem; ++i) {
+      if (eps[index[i]]->transport->caps & SC_TRANSPORT_LOOP) continue;
+      revents[index[i]] = ((items[i].revents & ZMQ_POLLIN) ? SC_POLLIN : 0) | ((items[i].revents & ZMQ_POLLOUT) ? SC_POLLOUT : 0);
+      if (revents[index[i]] != 0) nready++;
+    }
+    if (nready > 0 || nloop == 0 || wait == 0) break;
+  }
+  free(items);
+  free(index);
+
+  return nready;
+}
+
+
+int sc_msg_poll(struct role_endpoint *eps[], const short events[], short revents[], int n, long timeout)
+{
+  int i;
+  int nready = 0;
+  int nbusy = 0;
+  int spins = 0;
+  long long deadline;
+
+  // Messages received ahead are ready without polling.
+  for (i=0; i<n; ++i) {
+    sc_msg *pending = (sc_msg *)eps[i]->pending;
+    revents[i] = 0;
+    if ((events[i] & SC_POLLIN) && pending != NULL && pending->ready) {
+      revents[i] = SC_POLLIN;
+      nready++;
+    }
+    if (!(eps[i]->transport->caps & SC_TRANSPORT_WAIT)) nbusy++;
+  }
+  if (nready > 0) return nready;
+
+  if (nbusy == 0) return _poll_wait(eps, events, revents, n, timeout);
+
+  // Some transports cannot be waited on with zmq_poll, check
+  // all endpoints in turn until something is ready.
+  deadline = (timeout >= 0) ? sc_time() + timeout * 1000 : -1;
+  while (1) {
+    if ((nready = _poll_wait(eps, events, revents, n, 0)) < 0) return -1;
+    for (i=0; i<n; ++i) {
+      if (eps[i]->transport->caps & SC_TRANSPORT_WAIT) continue;
+      if ((revents[i] = eps[i]->transport->poll(eps[i], events[i])) != 0) nready++;
+    }
+    if (nready > 0 || (deadline >= 0 && sc_time() >= deadline)) break;
+    sc_transport_wait(&spins);
+  }
+
+  return nready;
+}
+
+
+sc_msg *sc_msg_peek(struct role_endpoint *ep)
+{
+  if (ep->pending == NULL) {
+    ep->pending = calloc(1, sizeof(sc_msg));
+  }
+  sc_msg *pending = (sc_msg *)ep->pending;
+
+  if (!pending->ready) {
+    if (sc_msg_recv(ep, pending, 0) != 0) {
+      zmq_msg_close(&pending->msg);
+      return NULL;
+    }
+    pending->ready = 1;
+  }
+
+  return pending;
+}
+
+
+inline void *sc_msg_data(sc_msg *m)
+{
+  return (char *)zmq_msg_data(&m->msg) + m->offset;
+}
+
+
+inline void sc_msg_close(sc_msg *m)
+{
+  zmq_msg_close(&m->msg);
+}
+
+
+void sc_msg_drop_pending(struct role_endpoint *ep)
+{
+  sc_msg *pending = (sc_msg *)ep->pending;
+
+  if (pending != NULL) {
+    if (pending->ready) {
+      zmq_msg_close(&pending->msg);
+    }
+    free(pending);
+  }
+  ep->pending = NULL;
+}
@@ -5,6 +5,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,78 +13,132 @@
 
 #include <zmq.h>
 
+#include "sc/async.h"
+#include "sc/collectives.h"
+#include "sc/msg.h"
 #include "sc/primitives.h"
+#include "sc/session.h"
 
 
 /**
- * \brief Helper function to deallocate send queue.
+ * \brief Helper function to get the sending endpoint of a role,
+ * completing outstanding non-blocking sends on it first.
  *
  */
-void _dealloc(void *data, void *hint)
+static struct role_endpoint *_out_endpoint(role *r)
 {
-  free(data);
+  switch (r->type) {
+    case SESSION_ROLE_P2P:
+      if (r->p2p->sendq != NULL) sc_async_flush(r->p2p, SC_REQ_SEND);
+      return r->p2p;
+    case SESSION_ROLE_GRP:
+#ifdef __DEBUG__
+      fprintf(stderr, "bcast -> %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
+#endif
+      if (r->grp->out->sendq != NULL) sc_async_flush(r->grp->out, SC_REQ_SEND);
+      return r->grp->out;
+    default:
+      fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+  }
+
+  return NULL;
 }
 
 
-inline int send_int(int val, role *r, const char *label)
+/**
+ * \brief Helper function to get the receiving endpoint of a role,
+ * completing outstanding non-blocking receives on it first.
+ *
+ */
+static struct role_endpoint *_in_endpoint(role *r)
 {
-  return send_int_array(&val, 1, r, label);
+  switch (r->type) {
+    case SESSION_ROLE_P2P:
+      if (r->p2p->recvq != NULL) sc_async_flush(r->p2p, SC_REQ_RECV);
+      return r->p2p;
+    case SESSION_ROLE_GRP:
+#ifdef __DEBUG__
+      fprintf(stderr, "bcast <- %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
+#endif
+      if (r->grp->in->recvq != NULL) sc_async_flush(r->grp->in, SC_REQ_RECV);
+      return r->grp->in;
+    default:
+      fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+  }
+
+  return NULL;
 }
 
 
-int send_int_array(const int arr[], size_t count, role *r, const char *label)
+/**
+ * \brief Helper function to receive a message from a role
+ * (segmented: a scatter/gather message is expected, rejected otherwise).
+ *
+ */
+static int _recv(role *r, sc_msg *m, int segmented)
 {
   int rc = 0;
-  zmq_msg_t msg;
-  size_t size = sizeof(int) * count;
+  struct role_endpoint *ep;
+
+  if ((ep = _in_endpoint(r)) == NULL) {
+    zmq_msg_init(&m->msg);
+    m->size = 0;
+    m->offset = 0;
+    return -1;
+  }
+  rc = sc_msg_recv(ep, m, 0);
+
+  // Broadcasts from different senders interleave, only p2p is ordered.
+  if (rc == 0 && r->type == SESSION_ROLE_P2P) sc_msg_sequence(ep, m);
+  if (rc == 0 && !segmented) rc = sc_msg_reject_iov(ep, m, __FUNCTION__);
+
+  return rc;
+}
 
 
+int sc_send(const void *buf, size_t count, size_t elem_size, int type,
+            role *r, const char *label)
+{
+  int rc = 0;
+  struct role_endpoint *ep;
+
 #ifdef __DEBUG__
-  fprintf(stderr, " --> %s ", __FUNCTION__);
+  fprintf(stderr, " --> %s(type %d, %zu elements) ", __FUNCTION__, type, count);
+  if (label != NULL) fprintf(stderr, "{label: %s}", label);
 #endif
 
-  if (label != NULL) {
+  if ((ep = _out_endpoint(r)) == NULL) return -1;
+  rc = sc_msg_send(ep, sc_label_id(label), type, buf, count, elem_size * count, 0);
+
+  if (rc != 0) perror(__FUNCTION__);
+ 
 #ifdef __DEBUG__
-    fprintf(stderr, "{label: %s}", label);
+  fprintf(stderr, ".\n");
 #endif
-    zmq_msg_t msg_label;
-    char *buf_label = (char *)calloc(sizeof(char), strlen(label));
-    memcpy(buf_label, label, strlen(label));
-    zmq_msg_init_data(&msg_label, buf_label, strlen(label), _dealloc, NULL);
-    switch (r->type) {
-      case SESSION_ROLE_P2P:
-        rc = zmq_msg_send(r->p2p->ptr, &msg_label, ZMQ_SNDMORE);
-        break;
-      case SESSION_ROLE_GRP:
-        rc = zmq_msg_send(r->grp->out->ptr, &msg_label, ZMQ_SNDMORE);
-        break;
-    default:
-        fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
-    }
-    zmq_msg_close(&msg_label);
-  }
 
-  int *buf = (int *)malloc(size);
-  memcpy(buf, arr, size);
+  return rc;
+}
+
+
+int sc_send_nocopy(void *buf, size_t count, size_t elem_size, int type,
+                   role *r, const char *label, sc_free_fn *ffn, void *hint)
+{
+  int rc = 0;
+  struct role_endpoint *ep;
 
-  zmq_msg_init_data(&msg, buf, size, _dealloc, NULL);
-  switch (r->type) {
-    case SESSION_ROLE_P2P:
-      rc = zmq_msg_send(r->p2p->ptr, &msg, 0);
-      break;
-    case SESSION_ROLE_GRP:
 #ifdef __DEBUG__
-      fprintf(stderr, "bcast -> %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
+  fprintf(stderr, " --> %s(type %d, %zu elements) ", __FUNCTION__, type, count);
+  if (label != NULL) fprintf(stderr, "{label: %s}", label);
 #endif
-      rc = zmq_msg_send(r->grp->out->ptr, &msg, 0);
-      break;
-    default:
-      fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+
+  if ((ep = _out_endpoint(r)) == NULL) {
+    if (ffn != NULL) ffn(buf, hint); else free(buf);
+    return -1;
   }
-  zmq_msg_close(&msg);
+  rc = sc_msg_send_nocopy(ep, sc_label_id(label), type, buf, count, elem_size * count, ffn, hint);
 
   if (rc != 0) perror(__FUNCTION__);
- 
+
 #ifdef __DEBUG__
   fprintf(stderr, ".\n");
 #endif
@@ -92,27 +147,25 @@ int send_int_array(const int arr[], size_t count, role *r, const char *label)
 }
 
 
-int vsend_int(int val, int nr_of_roles, ...)
+int sc_vsend(const void *buf, size_t count, size_t elem_size, int type,
+             int nr_of_roles, va_list roles)
 {
   int rc = 0;
   int i;
   role *r;
-  va_list roles;
 
 #ifdef __DEBUG__
-  fprintf(stderr, " --> %s(%d)@%d ", __FUNCTION__, val, nr_of_roles);
+  fprintf(stderr, " --> %s(type %d)@%d ", __FUNCTION__, type, nr_of_roles);
 #endif
-  va_start(roles, nr_of_roles);
   for (i=0; i<nr_of_roles; i++) {
     r = va_arg(roles, role *);
 
 #ifdef __DEBUG__
     fprintf(stderr, "   +");
 #endif
-    rc |= send_int(val, r, NULL);
+    rc |= sc_send(buf, count, elem_size, type, r, NULL);
     if (rc != 0) perror(__FUNCTION__);
   }
-  va_end(roles);
 
 #ifdef __DEBUG__
   fprintf(stderr, ".\n");
@@ -122,210 +175,621 @@ int vsend_int(int val, int nr_of_roles, ...)
 }
 
 
+int probe_label_id(sc_label_t *label, role *r)
+{
+  struct role_endpoint *ep;
+  sc_msg *m;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-- %s() ", __FUNCTION__);
+#endif
+
+  if ((ep = _in_endpoint(r)) == NULL) return -1;
+
+  // Keep the message for the receive following the label.
+  if ((m = sc_msg_peek(ep)) == NULL) {
+    perror(__FUNCTION__);
+    return -1;
+  }
+  *label = m->hdr.label;
+
+#ifdef __DEBUG__
+  fprintf(stderr, "[%08x] .\n", *label);
+#endif
+  return 0;
+}
+
+
 int probe_label(char **label, role *r)
 {
   int rc = 0;
-  zmq_msg_t msg;
-  size_t size = -1;
+  sc_label_t id = SC_LABEL_NONE;
+
+  *label = NULL;
+  if ((rc = probe_label_id(&id, r)) != 0) return rc;
 
-  // Label detection.
-  int64_t more;
-  size_t more_size = sizeof(more);
+  if (sc_label_name(r->s, id) == NULL) {
+    fprintf(stderr, "%s: Unknown label %08x (not in protocol %s)\n",
+        __FUNCTION__, id, r->s->name);
+    errno = EPROTO;
+    return -1;
+  }
+  *label = strdup(sc_label_name(r->s, id));
 
 #ifdef __DEBUG__
-  fprintf(stderr, " <-- %s() ", __FUNCTION__);
+  fprintf(stderr, "[%s] .\n", *label);
 #endif
+  return rc;
+}
+
+
+inline int has_label(char *label, const char *_label)
+{
+  return (label != NULL && strcmp(label, _label) == 0);
+}
+
+
+int sc_recv(void *buf, size_t *count, size_t elem_size, int type, role *r)
+{
+  int rc = 0;
+  sc_msg m;
 
-  zmq_msg_init(&msg);
-  switch (r->type) {
-    case SESSION_ROLE_P2P:
-      rc = zmq_msg_recv(r->p2p->ptr, &msg, 0);
-      assert(rc == 0);
-      rc = zmq_getsockopt(r->p2p->ptr, ZMQ_RCVMORE, &more, &more_size);
-      assert(rc == 0);
-      break;
-    case SESSION_ROLE_GRP:
 #ifdef __DEBUG__
-      fprintf(stderr, "recv_label <- %s (%d endpoints) ", r->grp->name, r->grp->nendpoint);
+  fprintf(stderr, " <-- %s(type %d) ", __FUNCTION__, type);
 #endif
-      rc = zmq_msg_recv(r->grp->in->ptr, &msg, 0);
-      assert(rc == 0);
-      rc = zmq_getsockopt(r->grp->in->ptr, ZMQ_RCVMORE, &more, &more_size);
-      assert(rc == 0);
-      break;
-    default:
-        fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+
+  rc = _recv(r, &m, 0);
+  if (rc == 0) {
+    rc = sc_msg_unpack(&m, buf, count, elem_size, type, __FUNCTION__);
+  } else {
+    *count = 0;
+  }
+  sc_msg_close(&m);
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, "[%zu elements] .\n", *count);
+#endif
+
+  return rc;
+}
+
+
+/**
+ * A run of receives from any of a set of endpoints.
+ */
+struct sc_any_run
+{
+  int n;
+  struct role_endpoint **eps;
+  char *done;  // Endpoints received from in this run
+  int nleft;   // Endpoints left to receive from
+};
+
+
+/**
+ * \brief Helper function to get the run of receives from any of
+ * a set of endpoints, a new run is started if the set of endpoints
+ * differs from the current run (or the current run is complete).
+ *
+ */
+static struct sc_any_run *_any_run(session *s, struct role_endpoint **eps, int n)
+{
+  struct sc_any_run *run = (struct sc_any_run *)s->any;
+
+  if (run != NULL && run->nleft > 0 && run->n == n
+      && memcmp(run->eps, eps, sizeof(struct role_endpoint *) * n) == 0) {
+    return run;
+  }
+
+  sc_recv_any_free(s);
+  if ((run = (struct sc_any_run *)malloc(sizeof(struct sc_any_run))) == NULL) return NULL;
+  run->n     = n;
+  run->nleft = n;
+  run->eps   = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * n);
+  run->done  = (char *)calloc(n, sizeof(char));
+  if (run->eps == NULL || run->done == NULL) {
+    free(run->eps);
+    free(run->done);
+    free(run);
+    return NULL;
+  }
+  memcpy(run->eps, eps, sizeof(struct role_endpoint *) * n);
+  s->any = run;
+
+  return run;
+}
+
+
+int sc_recv_any(void *buf, size_t *count, size_t elem_size, int type,
+                role **from, int nroles, role *roles[])
+{
+  int rc = 0;
+  int i, j;
+  int n = 0;
+  int npoll = 0;
+  int ready = -1;
+  role **srcs;
+  struct role_endpoint **eps;
+  struct role_endpoint **polled;
+  int *index;
+  short *events, *revents;
+  struct sc_any_run *run = NULL;
+  sc_msg m;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-- %s(type %d)@%d ", __FUNCTION__, type, nroles);
+#endif
+
+  *from = NULL;
+
+  // Group roles stand for all of their member (p2p) roles.
+  for (i=0; i<nroles; ++i) {
+    n += (roles[i]->type == SESSION_ROLE_GRP) ? roles[i]->grp->nendpoint : 1;
+  }
+  srcs    = (role **)malloc(sizeof(role *) * n);
+  eps     = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * n);
+  polled  = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * n);
+  index   = (int *)malloc(sizeof(int) * n);
+  events  = (short *)malloc(sizeof(short) * n);
+  revents = (short *)malloc(sizeof(short) * n);
+
+  if (n == 0 || srcs == NULL || eps == NULL || polled == NULL
+      || index == NULL || events == NULL || revents == NULL) {
+    if (n == 0) errno = EINVAL;
+    rc = -1;
+  }
+
+  n = 0;
+  for (i=0; i<nroles && rc==0; ++i) {
+    if (roles[i]->type == SESSION_ROLE_GRP) {
+      for (j=0; j<roles[i]->grp->nendpoint; ++j) {
+        // Members without a connection (pruned) can never send.
+        if (roles[i]->grp->endpoints[j]->uri[0] == '\0') continue;
+        srcs[n] = roles[i]->s->roles[j];
+        eps[n]  = roles[i]->grp->endpoints[j];
+        n++;
+      }
+    } else if (roles[i]->type == SESSION_ROLE_P2P) {
+      srcs[n] = roles[i];
+      eps[n]  = roles[i]->p2p;
+      n++;
+    } else {
+      fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, roles[i]->type);
+    }
+  }
+  if (rc == 0 && n == 0) {
+    errno = ENOTCONN;
+    rc = -1;
+  }
+
+  // Each endpoint is received from once per run, so that a fast
+  // sender cannot supply a later message in place of a slow one.
+  if (rc == 0 && (run = _any_run(roles[0]->s, eps, n)) == NULL) rc = -1;
+
+  for (i=0; i<n && run!=NULL; ++i) {
+    if (run->done[i]) continue;
+    if (eps[i]->recvq != NULL) sc_async_flush(eps[i], SC_REQ_RECV);
+    polled[npoll] = eps[i];
+    events[npoll] = SC_POLLIN;
+    index[npoll++] = i;
   }
-  size = zmq_msg_size(&msg);
-  *label = (char *)calloc(sizeof(char), size+1);
-  memcpy(*label, (char *)zmq_msg_data(&msg), size);
-  zmq_msg_close(&msg);
 
-  assert(more == 1); // Label has to be followed by a message
+  if (rc == 0 && sc_msg_poll(polled, events, revents, npoll, -1) >= 0) {
+    for (i=0; i<npoll && ready<0; ++i) {
+      if (revents[i] & SC_POLLIN) ready = index[i];
+    }
+  }
+
+  if (ready >= 0) {
+    *from = srcs[ready];
+    rc = _recv(srcs[ready], &m, 0);
+    if (rc == 0) {
+      run->done[ready] = 1;
+      if (--run->nleft == 0) sc_recv_any_free(roles[0]->s);
+      rc = sc_msg_unpack(&m, buf, count, elem_size, type, __FUNCTION__);
+    } else {
+      *count = 0;
+    }
+    sc_msg_close(&m);
+  } else {
+    *count = 0;
+    rc = -1;
+  }
 
   if (rc != 0) perror(__FUNCTION__);
 
+  free(srcs);
+  free(eps);
+  free(polled);
+  free(index);
+  free(events);
+  free(revents);
+
 #ifdef __DEBUG__
-  fprintf(stderr, "[%s] .\n", *label);
+  fprintf(stderr, "[%zu elements from %s] .\n", *count, (*from != NULL) ? (*from)->p2p->name : "-");
 #endif
+
   return rc;
 }
 
 
-inline int has_label(char *label, const char *_label)
+int sc_vrecv_any(void *buf, size_t *count, size_t elem_size, int type,
+                 role **from, int nr_of_roles, va_list roles)
 {
-  return (strcmp(label, _label) == 0);
+  int rc = 0;
+  int i;
+  role **rs = (role **)malloc(sizeof(role *) * nr_of_roles);
+
+  for (i=0; i<nr_of_roles; i++) {
+    rs[i] = va_arg(roles, role *);
+  }
+  rc = sc_recv_any(buf, count, elem_size, type, from, nr_of_roles, rs);
+  free(rs);
+
+  return rc;
 }
 
 
-inline int recv_int(int *dst, role *r)
+void sc_recv_any_free(session *s)
 {
-  size_t count = 1;
-  return recv_int_array(dst, &count, r);
+  struct sc_any_run *run = (struct sc_any_run *)s->any;
+
+  if (run != NULL) {
+    free(run->eps);
+    free(run->done);
+    free(run);
+  }
+  s->any = NULL;
 }
 
 
-int recv_int_array(int *arr, size_t *count, role *r)
+int sc_recv_view(sc_view *view, size_t elem_size, int type, role *r)
 {
   int rc = 0;
-  zmq_msg_t msg;
-  size_t size = -1;
+  sc_msg *m = (sc_msg *)malloc(sizeof(sc_msg));
 
 #ifdef __DEBUG__
-  fprintf(stderr, " <-- %s() ", __FUNCTION__);
+  fprintf(stderr, " <-- %s(type %d) ", __FUNCTION__, type);
 #endif
 
-  zmq_msg_init(&msg);
-  switch (r->type) {
-    case SESSION_ROLE_P2P:
-      rc = zmq_msg_recv(r->p2p->ptr, &msg, 0);
-      break;
-    case SESSION_ROLE_GRP:
+  rc = _recv(r, m, 0);
+  if (rc == 0 && !sc_msg_check_type(m, type, elem_size, __FUNCTION__)) {
+    errno = EPROTO;
+    rc = -1;
+  }
+
+  if (rc != 0) {
+    sc_msg_close(m);
+    free(m);
+    view->msg   = NULL;
+    view->data  = NULL;
+    view->size  = 0;
+    view->count = 0;
+    perror(__FUNCTION__);
+    return rc;
+  }
+
+  // Borrow the receive buffer, released by sc_view_release().
+  view->msg   = m;
+  view->data  = sc_msg_data(m);
+  view->size  = m->size;
+  view->count = view->size / elem_size;
+
 #ifdef __DEBUG__
-      fprintf(stderr, "bcast <- %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
+  fprintf(stderr, "[%zu elements] .\n", view->count);
 #endif
-      rc = zmq_msg_recv(r->grp->in->ptr, &msg, 0);
-      break;
-    default:
-        fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+
+  return rc;
+}
+
+
+int sc_recv_alloc(void **buf, size_t *count, size_t elem_size, int type, role *r)
+{
+  int rc = 0;
+  sc_msg m;
+  size_t size = -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-- %s(type %d) ", __FUNCTION__, type);
+#endif
+
+  rc = _recv(r, &m, 0);
+  if (rc == 0 && !sc_msg_check_type(&m, type, elem_size, __FUNCTION__)) {
+    errno = EPROTO;
+    rc = -1;
   }
-  size = zmq_msg_size(&msg);
-  if (*count * sizeof(int) >= size) {
-    memcpy(arr, (int *)zmq_msg_data(&msg), size);
-    if (size % sizeof(int) == 0) {
-      *count = size / sizeof(int);
-    }
-  } else {
-    memcpy(arr, (int *)zmq_msg_data(&msg), *count * sizeof(int));
-    fprintf(stderr,
-      "%s: Received data (%zu bytes) > memory size (%zu), data truncated\n",
-      __FUNCTION__, size, *count * sizeof(int));
+
+  if (rc != 0) {
+    sc_msg_close(&m);
+    *buf = NULL;
+    *count = 0;
+    perror(__FUNCTION__);
+    return rc;
   }
-  zmq_msg_close(&msg);
 
-  if (rc != 0) perror(__FUNCTION__);
+  size = m.size;
+  *count = size / elem_size;
+  *buf = malloc(size > 0 ? size : 1);
+  memcpy(*buf, sc_msg_data(&m), *count * elem_size);
+  sc_msg_close(&m);
 
 #ifdef __DEBUG__
-  fprintf(stderr, "[%d ...] .\n", *arr);
+  fprintf(stderr, "[%zu elements] .\n", *count);
 #endif
 
   return rc;
 }
 
 
-inline int bcast_int(int val, session *s)
+void sc_view_release(sc_view *view)
+{
+  if (view->msg != NULL) {
+    sc_msg_close((sc_msg *)view->msg);
+    free(view->msg);
+  }
+  view->msg   = NULL;
+  view->data  = NULL;
+  view->size  = 0;
+  view->count = 0;
+}
+
+
+inline int send_struct(const void *ptr, size_t size, role *r, const char *label)
 {
-  return send_int_array(&val, 1, s->r(s, "_Others"), NULL);
+  return sc_send(ptr, 1, size, SC_TYPE_STRUCT, r, label);
 }
 
 
-inline int bcast_int_array(const int arr[], size_t count, session *s)
+inline int send_struct_array(const void *arr, size_t size, size_t count, role *r, const char *label)
 {
-  return send_int_array(arr, count, s->r(s, "_Others"), NULL);
+  return sc_send(arr, count, size, SC_TYPE_STRUCT, r, label);
 }
 
 
-inline int brecv_int(int *dst, session *s)
+inline int recv_struct(void *dst, size_t size, role *r)
 {
-  size_t count;
-  return recv_int_array(dst, &count, s->r(s, "_Others"));
+  size_t count = 1;
+  return sc_recv(dst, &count, size, SC_TYPE_STRUCT, r);
 }
 
 
-inline int brecv_int_array(int *arr, size_t *count, session *s)
+inline int recv_struct_array(void *arr, size_t size, size_t *count, role *r)
 {
-  return recv_int_array(arr, count, s->r(s, "_Others"));
+  return sc_recv(arr, count, size, SC_TYPE_STRUCT, r);
 }
 
 
-int barrier(role *grp_role, char *at_rolename)
+inline int bcast_struct(const void *ptr, size_t size, session *s)
 {
-  if (grp_role->type != SESSION_ROLE_GRP) {
-    fprintf(stderr, "Error: cannot perform barrier synchronisation with non group role!\n");
+  return sc_send(ptr, 1, size, SC_TYPE_STRUCT, s->others, NULL);
+}
+
+
+inline int brecv_struct(void *dst, size_t size, session *s)
+{
+  size_t count = 1;
+  return sc_recv(dst, &count, size, SC_TYPE_STRUCT, s->others);
+}
+
+
+int send_iov(const struct iovec iov[], int iovcnt, role *r, const char *label)
+{
+  int rc = 0;
+  struct role_endpoint *ep;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(%d segments) ", __FUNCTION__, iovcnt);
+#endif
+
+  if ((ep = _out_endpoint(r)) == NULL) return -1;
+  rc = sc_msg_send_iov(ep, sc_label_id(label), iov, iovcnt);
+
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int send_iov_nocopy(const struct iovec iov[], int iovcnt, role *r, const char *label,
+                    sc_free_fn *ffn, void *hint)
+{
+  int rc = 0;
+  int i;
+  struct role_endpoint *ep;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(%d segments) ", __FUNCTION__, iovcnt);
+#endif
+
+  if ((ep = _out_endpoint(r)) == NULL) {
+    for (i=0; i<iovcnt; ++i) {
+      if (ffn != NULL) ffn(iov[i].iov_base, hint); else free(iov[i].iov_base);
+    }
     return -1;
   }
+  rc = sc_msg_send_iov_nocopy(ep, sc_label_id(label), iov, iovcnt, ffn, hint);
 
+  if (rc != 0) perror(__FUNCTION__);
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int recv_iov(struct iovec iov[], int *iovcnt, role *r)
+{
   int rc = 0;
-  zmq_msg_t msg;
   int i;
+  unsigned int nsegment;
+  size_t size;
+  sc_msg m;
+  zmq_msg_t frame;
 
-  if (strcmp(grp_role->s->name, at_rolename) == 0) { // Master role
+#ifdef __DEBUG__
+  fprintf(stderr, " <-- %s() ", __FUNCTION__);
+#endif
 
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "S1", 2);
-    if (rc != 0) perror(__FUNCTION__);
+  rc = _recv(r, &m, 1);
+  sc_msg_close(&m);
+  if (rc != 0) {
+    perror(__FUNCTION__);
+    return rc;
+  }
+  if (!(m.hdr.flags & SC_MSG_IOV)) {
+    fprintf(stderr, "%s: Received message is not segmented\n", __FUNCTION__);
+    errno = EPROTO;
+    return -1;
+  }
 
-    // Wait for S1 (Phase 1) messages.
-    for (i=0; i<grp_role->grp->nendpoint; ++i) {
-      zmq_msg_init(&msg);
-      rc |= zmq_msg_recv(grp_role->grp->in->ptr, &msg, 0);
-      if (rc != 0) perror(__FUNCTION__);
-      zmq_msg_close (&msg);
-    }
+  nsegment = m.hdr.count;
+  for (i=0; i<nsegment; ++i) {
+    zmq_msg_init(&frame);
+    rc |= sc_msg_recv_segment(_in_endpoint(r), &frame);
+    size = zmq_msg_size(&frame);
+    if (i < *iovcnt) {
+      if (size > iov[i].iov_len) {
+        fprintf(stderr,
+          "%s: Received segment#%d (%zu bytes) > memory size (%zu), data truncated\n",
+          __FUNCTION__, i, size, iov[i].iov_len);
+        size = iov[i].iov_len;
+      }
+      memcpy(iov[i].iov_base, zmq_msg_data(&frame), size);
+      iov[i].iov_len = size;
+    } // else: drain segments without a buffer
+    zmq_msg_close(&frame);
+  }
 
-    // Reset filters.
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "S1", 2);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
+  if (nsegment > *iovcnt) {
+    fprintf(stderr, "%s: Received %u segments > %d buffers, segments dropped\n",
+        __FUNCTION__, nsegment, *iovcnt);
+  } else {
+    *iovcnt = nsegment;
+  }
 
-    zmq_msg_init_size(&msg, 2);
-    memcpy(zmq_msg_data(&msg), "S2", 2);
-    rc |= zmq_msg_send(grp_role->grp->out->ptr, &msg, 0);
-    if (rc != 0) perror(__FUNCTION__);
-    zmq_msg_close(&msg);
+  if (rc != 0) perror(__FUNCTION__);
 
-    // Synchronised.
+#ifdef __DEBUG__
+  fprintf(stderr, "[%d segments] .\n", *iovcnt);
+#endif
 
-  } else { // Slave role
+  return rc;
+}
 
-    // Send S1 (Phase 1) messages.
-    zmq_msg_init_size(&msg, 2);
-    memcpy(zmq_msg_data(&msg), "S1", 2);
-    rc |= zmq_msg_send(grp_role->grp->out->ptr, &msg, 0);
-    if (rc != 0) perror(__FUNCTION__);
-    zmq_msg_close(&msg);
 
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "S2", 2);
-    if (rc != 0) perror(__FUNCTION__);
+/**
+ * Define the typed primitive family of an element type
+ * on top of the generic primitives.
+ */
+#define SC_DEFINE_PRIMITIVES(name, ctype, sctype)                                          \
+  int send_##name(ctype val, role *r, const char *label)                                   \
+  {                                                                                        \
+    return sc_send(&val, 1, sizeof(ctype), sctype, r, label);                              \
+  }                                                                                        \
+  int send_##name##_array(const ctype arr[], size_t count, role *r, const char *label)     \
+  {                                                                                        \
+    return sc_send(arr, count, sizeof(ctype), sctype, r, label);                           \
+  }                                                                                        \
+  int send_##name##_array_nocopy(ctype arr[], size_t count, role *r, const char *label,    \
+                                 sc_free_fn *ffn, void *hint)                              \
+  {                                                                                        \
+    return sc_send_nocopy(arr, count, sizeof(ctype), sctype, r, label, ffn, hint);         \
+  }                                                                                        \
+  int vsend_##name(ctype val, int nr_of_roles, ...)                                        \
+  {                                                                                        \
+    int rc;                                                                                \
+    va_list roles;                                                                         \
+    va_start(roles, nr_of_roles);                                                          \
+    rc = sc_vsend(&val, 1, sizeof(ctype), sctype, nr_of_roles, roles);                     \
+    va_end(roles);                                                                         \
+    return rc;                                                                             \
+  }                                                                                        \
+  int recv_##name(ctype *dst, role *r)                                                     \
+  {                                                                                        \
+    size_t count = 1;                                                                      \
+    return sc_recv(dst, &count, sizeof(ctype), sctype, r);                                 \
+  }                                                                                        \
+  int recv_##name##_array(ctype *arr, size_t *count, role *r)                              \
+  {                                                                                        \
+    return sc_recv(arr, count, sizeof(ctype), sctype, r);                                  \
+  }                                                                                        \
+  int recv_##name##_array_view(sc_view *view, role *r)                                     \
+  {                                                                                        \
+    return sc_recv_view(view, sizeof(ctype), sctype, r);                                   \
+  }                                                                                        \
+  int recv_##name##_array_alloc(ctype **arr, size_t *count, role *r)                       \
+  {                                                                                        \
+    return sc_recv_alloc((void **)arr, count, sizeof(ctype), sctype, r);                   \
+  }                                                                                        \
+  int recv_##name##_any(ctype *dst, role **from, int nr_of_roles, ...)                     \
+  {                                                                                        \
+    int rc;                                                                                \
+    size_t count = 1;                                                                      \
+    va_list roles;                                                                         \
+    va_start(roles, nr_of_roles);                                                          \
+    rc = sc_vrecv_any(dst, &count, sizeof(ctype), sctype, from, nr_of_roles, roles);       \
+    va_end(roles);                                                                         \
+    return rc;                                                                             \
+  }                                                                                        \
+  int recv_##name##_array_any(ctype *arr, size_t *count, role **from,                      \
+                              int nr_of_roles, ...)                                        \
+  {                                                                                        \
+    int rc;                                                                                \
+    va_list roles;                                                                         \
+    va_start(roles, nr_of_roles);                                                          \
+    rc = sc_vrecv_any(arr, count, sizeof(ctype), sctype, from, nr_of_roles, roles);        \
+    va_end(roles);                                                                         \
+    return rc;                                                                             \
+  }                                                                                        \
+  int bcast_##name(ctype val, session *s)                                                  \
+  {                                                                                        \
+    return sc_send(&val, 1, sizeof(ctype), sctype, s->others, NULL);                       \
+  }                                                                                        \
+  int bcast_##name##_array(const ctype arr[], size_t count, session *s)                    \
+  {                                                                                        \
+    return sc_send(arr, count, sizeof(ctype), sctype, s->others, NULL);                    \
+  }                                                                                        \
+  int bcast_##name##_array_nocopy(ctype arr[], size_t count, session *s,                   \
+                                  sc_free_fn *ffn, void *hint)                             \
+  {                                                                                        \
+    return sc_send_nocopy(arr, count, sizeof(ctype), sctype, s->others, NULL,              \
+                          ffn, hint);                                                      \
+  }                                                                                        \
+  int brecv_##name(ctype *dst, session *s)                                                 \
+  {                                                                                        \
+    size_t count = 1;                                                                      \
+    return sc_recv(dst, &count, sizeof(ctype), sctype, s->others);                         \
+  }                                                                                        \
+  int brecv_##name##_array(ctype *arr, size_t *count, session *s)                          \
+  {                                                                                        \
+    return sc_recv(arr, count, sizeof(ctype), sctype, s->others);                          \
+  }                                                                                        \
+  int brecv_##name##_array_view(sc_view *view, session *s)                                 \
+  {                                                                                        \
+    return sc_recv_view(view, sizeof(ctype), sctype, s->others);                           \
+  }                                                                                        \
+  int brecv_##name##_array_alloc(ctype **arr, size_t *count, session *s)                   \
+  {                                                                                        \
+    return sc_recv_alloc((void **)arr, count, sizeof(ctype), sctype, s->others);           \
+  }
 
-    // Wait for S2 (Phase 2) messages.
-    zmq_msg_init(&msg);
-    rc |= zmq_msg_recv(grp_role->grp->in->ptr, &msg, 0);
-    if (rc != 0) perror(__FUNCTION__);
-    zmq_msg_close(&msg);
+SC_PRIMITIVE_TYPES(SC_DEFINE_PRIMITIVES)
 
-    // Reset filters.
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "S2", 2);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
 
-    // Synchronised.
+int barrier(role *grp_role, char *at_rolename)
+{
+  if (grp_role->type != SESSION_ROLE_GRP) {
+    fprintf(stderr, "Error: cannot perform barrier synchronisation with non group role!\n");
+    return -1;
   }
 
-  return rc;
+  return sc_barrier(grp_role->s);
 }
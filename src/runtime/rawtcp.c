@@ -0,0 +1,685 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * raw TCP transport module.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+#include <zmq.h>
+
+#include "sc/msg.h"
+#include "sc/rawtcp.h"
+#include "sc/transport.h"
+
+#define SC_RAWTCP_RETRY_NS 1000000 // Delay (ns) before connecting again to a peer not yet listening
+#define SC_RAWTCP_EVENTS   64      // Largest number of events dispatched at once
+
+
+/**
+ * Event loop of the raw TCP channels of a ZeroMQ context.
+ *
+ * All sockets of the channels are registered edge-triggered with one
+ * epoll instance, events are recorded in the channels they belong to.
+ */
+struct rawtcp_loop
+{
+  void *ctx;   // ZeroMQ context of the channels
+  int epfd;    // epoll instance
+  int timerfd; // Timer to connect again (registered with epfd)
+  int nchan;   // Number of channels using the loop
+
+  struct rawtcp_loop *next;
+};
+
+
+/**
+ * State of a raw TCP channel.
+ */
+struct rawtcp_chan
+{
+  int listen_fd; // Listening socket (binding side, until accepted), -1 otherwise
+  int fd;        // Connection (or connection in progress), -1 if none
+  int ready;     // Connection established
+  struct sockaddr_storage addr; // Peer address (connecting side)
+  socklen_t addrlen;
+
+  struct rawtcp_loop *loop; // Event loop of the socket
+  uint32_t events;          // Events since the socket last would have blocked
+
+  int ntx;                          // Number of frames queued (ZMQ_SNDMORE)
+  uint32_t txhdr[SC_RAWTCP_BATCH];  // Length prefixes of queued frames
+  zmq_msg_t txq[SC_RAWTCP_BATCH];   // Queued frames
+
+  char *rxbuf;    // Receive buffer
+  size_t rxcap;   // Capacity of rxbuf
+  size_t rxhead;  // Start of unparsed data in rxbuf
+  size_t rxtail;  // End of data in rxbuf
+};
+
+
+static struct rawtcp_loop *_loops = NULL;
+static pthread_mutex_t _loops_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * \brief Helper function to resolve a tcp://host:port uri
+ * (host * for any address).
+ *
+ */
+static int _resolve(const char *uri, int passive, struct sockaddr_storage *addr, socklen_t *addrlen)
+{
+  char host[256];
+  const char *sep;
+  struct addrinfo hints;
+  struct addrinfo *res;
+  int rc;
+
+  if (strncmp(uri, "tcp://", 6) == 0) uri += 6;
+  if ((sep = strrchr(uri, ':')) == NULL || (size_t)(sep - uri) >= sizeof(host)) {
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(host, uri, sep - uri);
+  host[sep - uri] = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = passive ? AI_PASSIVE : 0;
+  if ((rc = getaddrinfo(strcmp(host, "*") == 0 ? NULL : host, sep + 1, &hints, &res)) != 0) {
+    fprintf(stderr, "%s: %s: %s\n", __FUNCTION__, uri, gai_strerror(rc));
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(addr, res->ai_addr, res->ai_addrlen);
+  *addrlen = res->ai_addrlen;
+  freeaddrinfo(res);
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to make a socket non-blocking (and disable
+ * Nagle's algorithm on connections).
+ *
+ */
+static int _nonblock(int fd, int nodelay)
+{
+  int on = 1;
+
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != 0) return -1;
+  if (nodelay && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0) return -1;
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to get the event loop of a context
+ * (created on first use).
+ *
+ */
+static struct rawtcp_loop *_loop_get(void *ctx)
+{
+  struct rawtcp_loop *loop;
+  struct epoll_event ev;
+
+  pthread_mutex_lock(&_loops_lock);
+  for (loop=_loops; loop!=NULL && loop->ctx!=ctx; loop=loop->next);
+
+  if (loop == NULL && (loop = (struct rawtcp_loop *)calloc(1, sizeof(struct rawtcp_loop))) != NULL) {
+    loop->ctx = ctx;
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // The timer, channels otherwise.
+    if (loop->epfd < 0 || loop->timerfd < 0 || epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->timerfd, &ev) != 0) {
+      if (loop->epfd >= 0) close(loop->epfd);
+      if (loop->timerfd >= 0) close(loop->timerfd);
+      free(loop);
+      loop = NULL;
+    } else {
+      loop->next = _loops;
+      _loops = loop;
+    }
+  }
+  if (loop != NULL) loop->nchan++;
+  pthread_mutex_unlock(&_loops_lock);
+
+  return loop;
+}
+
+
+/**
+ * \brief Helper function to release the event loop of a channel
+ * (closed with its last channel).
+ *
+ */
+static void _loop_put(struct rawtcp_loop *loop)
+{
+  struct rawtcp_loop **prev;
+
+  pthread_mutex_lock(&_loops_lock);
+  if (--loop->nchan == 0) {
+    for (prev=&_loops; *prev!=loop; prev=&(*prev)->next);
+    *prev = loop->next;
+    close(loop->timerfd);
+    close(loop->epfd);
+    free(loop);
+  }
+  pthread_mutex_unlock(&_loops_lock);
+}
+
+
+/**
+ * \brief Helper function to record the events of an event loop in
+ * their channels, waiting for at most timeout ms (-1 for no limit).
+ *
+ * \returns Number of events, -1 on error
+ */
+static int _dispatch(struct rawtcp_loop *loop, int timeout)
+{
+  struct epoll_event evs[SC_RAWTCP_EVENTS];
+  uint64_t expired;
+  int n;
+  int i;
+
+  while ((n = epoll_wait(loop->epfd, evs, SC_RAWTCP_EVENTS, timeout)) < 0 && errno == EINTR);
+
+  for (i=0; i<n; ++i) {
+    if (evs[i].data.ptr == NULL) { // Time to connect again, see _establish_step.
+      if (read(loop->timerfd, &expired, sizeof(expired)) < 0) expired = 0;
+    } else {
+      ((struct rawtcp_chan *)evs[i].data.ptr)->events |= evs[i].events;
+    }
+  }
+
+  return n;
+}
+
+
+/**
+ * \brief Helper function to register a socket of a channel with its
+ * event loop.
+ *
+ * Events are reported when the socket becomes ready (edge-triggered),
+ * the socket is taken to be ready for events until it would block.
+ *
+ */
+static int _watch(struct rawtcp_chan *chan, int fd, uint32_t events)
+{
+  struct epoll_event ev;
+
+  ev.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = chan;
+  chan->events = events;
+
+  return epoll_ctl(chan->loop->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+
+/**
+ * \brief Helper function to allocate the state of a channel.
+ *
+ */
+static struct rawtcp_chan *_chan_new(void *ctx)
+{
+  struct rawtcp_chan *chan = (struct rawtcp_chan *)calloc(1, sizeof(struct rawtcp_chan));
+
+  if (chan == NULL) return NULL;
+  chan->listen_fd = -1;
+  chan->fd        = -1;
+  if ((chan->loop = _loop_get(ctx)) == NULL) {
+    free(chan);
+    return NULL;
+  }
+
+  return chan;
+}
+
+
+/**
+ * \brief Helper function to wait for events on the socket of a channel.
+ *
+ * The socket is the listening socket until a connection is accepted.
+ * Events of other channels of the loop are recorded on the way.
+ *
+ * \returns Events of the socket (0 on timeout), -1 on error
+ */
+static int _wait(struct rawtcp_chan *chan, uint32_t events, int timeout)
+{
+  events |= EPOLLERR | EPOLLHUP;
+
+  if (timeout == 0 && _dispatch(chan->loop, 0) < 0) return -1;
+  while (!(chan->events & events) && timeout != 0) {
+    if (_dispatch(chan->loop, timeout) < 0) return -1;
+  }
+
+  return (int)(chan->events & events);
+}
+
+
+/**
+ * \brief Helper function to drop the socket of a channel.
+ *
+ */
+static void _drop(int *fd)
+{
+  close(*fd); // Closing removes it from the event loop.
+  *fd = -1;
+}
+
+
+/**
+ * \brief Helper function to connect again later to a peer not yet
+ * listening, the event loop is woken after SC_RAWTCP_RETRY_NS.
+ *
+ */
+static void _retry_later(struct rawtcp_chan *chan)
+{
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_nsec = SC_RAWTCP_RETRY_NS;
+  timerfd_settime(chan->loop->timerfd, 0, &its, NULL);
+}
+
+
+/**
+ * \brief Helper function to make progress establishing the connection
+ * of a channel, fails with EAGAIN if it is not established yet.
+ *
+ */
+static int _establish_step(struct rawtcp_chan *chan)
+{
+  int err = 0;
+  socklen_t errlen = sizeof(err);
+
+  if (chan->listen_fd >= 0) { // Binding side: accept the peer.
+    if ((chan->fd = accept(chan->listen_fd, NULL, NULL)) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        chan->events &= ~EPOLLIN;
+        errno = EAGAIN;
+      }
+      return -1;
+    }
+    _drop(&chan->listen_fd);
+    if (_nonblock(chan->fd, 1) != 0 || _watch(chan, chan->fd, EPOLLIN | EPOLLOUT) != 0) return -1;
+    chan->ready = 1;
+    return 0;
+  }
+
+  if (chan->fd < 0) { // Connecting side: start connecting.
+    if ((chan->fd = socket(chan->addr.ss_family, SOCK_STREAM, 0)) < 0) return -1;
+    if (_nonblock(chan->fd, 1) != 0 || _watch(chan, chan->fd, 0) != 0) return -1;
+    if (connect(chan->fd, (struct sockaddr *)&chan->addr, chan->addrlen) == 0) {
+      chan->events = EPOLLIN | EPOLLOUT;
+      chan->ready = 1;
+      return 0;
+    }
+    if (errno != EINPROGRESS) {
+      err = errno;
+      _drop(&chan->fd);
+      if (err == ECONNREFUSED) _retry_later(chan);
+      errno = (err == ECONNREFUSED) ? EAGAIN : err;
+      return -1;
+    }
+    errno = EAGAIN;
+    return -1;
+  }
+
+  // Connection in progress, the socket becomes writable once connected.
+  if (!(chan->events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+    errno = EAGAIN;
+    return -1;
+  }
+  if (getsockopt(chan->fd, SOL_SOCKET, SO_ERROR, &err, &errlen) != 0) return -1;
+  if (err != 0) { // Peer not listening yet, try again.
+    _drop(&chan->fd);
+    if (err == ECONNREFUSED) _retry_later(chan);
+    errno = (err == ECONNREFUSED) ? EAGAIN : err;
+    return -1;
+  }
+  chan->events |= EPOLLIN;
+  chan->ready = 1;
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to establish the connection of a channel.
+ *
+ */
+static int _establish(struct rawtcp_chan *chan, int flags)
+{
+  struct timespec ts = { 0, SC_RAWTCP_RETRY_NS };
+
+  while (!chan->ready) {
+    if (_establish_step(chan) == 0) break;
+    if (errno != EAGAIN || (flags & ZMQ_DONTWAIT)) return -1;
+    if (chan->listen_fd >= 0) {
+      if (_wait(chan, EPOLLIN, -1) < 0) return -1;
+    } else if (chan->fd >= 0) {
+      if (_wait(chan, EPOLLOUT, -1) < 0) return -1;
+    } else {
+      nanosleep(&ts, NULL);
+    }
+  }
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to read what is available from the
+ * connection of a channel.
+ *
+ * \returns Number of bytes read, -1 on error
+ */
+static int _read(struct rawtcp_chan *chan)
+{
+  ssize_t n;
+  int total = 0;
+
+  while (1) {
+    if (chan->rxtail == chan->rxcap) { // Make room.
+      if (chan->rxhead > 0) {
+        memmove(chan->rxbuf, chan->rxbuf + chan->rxhead, chan->rxtail - chan->rxhead);
+        chan->rxtail -= chan->rxhead;
+        chan->rxhead = 0;
+      } else {
+        size_t cap = (chan->rxcap == 0) ? SC_RAWTCP_BUFSIZE : chan->rxcap * 2;
+        char *buf = (char *)realloc(chan->rxbuf, cap);
+        if (buf == NULL) return -1;
+        chan->rxbuf = buf;
+        chan->rxcap = cap;
+      }
+    }
+
+    n = read(chan->fd, chan->rxbuf + chan->rxtail, chan->rxcap - chan->rxtail);
+    if (n > 0) {
+      chan->rxtail += n;
+      total += n;
+      if (chan->rxtail < chan->rxcap) break; // Drained.
+    } else if (n == 0) {
+      errno = ECONNRESET;
+      return -1;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      chan->events &= ~EPOLLIN;
+      break;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+
+  return total;
+}
+
+
+/**
+ * \brief Helper function to take the next complete frame out of the
+ * receive buffer of a channel.
+ *
+ * \returns 1 if a frame was taken, 0 otherwise, -1 on error
+ */
+static int _take(struct rawtcp_chan *chan, zmq_msg_t *frame)
+{
+  size_t avail = chan->rxtail - chan->rxhead;
+  uint32_t size;
+
+  if (avail < sizeof(uint32_t)) return 0;
+  memcpy(&size, chan->rxbuf + chan->rxhead, sizeof(uint32_t));
+  if (avail < sizeof(uint32_t) + size) return 0;
+
+  zmq_msg_close(frame);
+  if (zmq_msg_init_size(frame, size) != 0) {
+    zmq_msg_init(frame);
+    return -1;
+  }
+  memcpy(zmq_msg_data(frame), chan->rxbuf + chan->rxhead + sizeof(uint32_t), size);
+
+  chan->rxhead += sizeof(uint32_t) + size;
+  if (chan->rxhead == chan->rxtail) {
+    chan->rxhead = 0;
+    chan->rxtail = 0;
+  }
+
+  return 1;
+}
+
+
+/**
+ * \brief Helper function to write the queued frames of a channel
+ * with as few writev calls as possible.
+ *
+ */
+static int _flush(struct rawtcp_chan *chan)
+{
+  struct iovec iov[2 * SC_RAWTCP_BATCH];
+  int niov = 0;
+  int idx = 0;
+  int i;
+  ssize_t n;
+  int rc = 0;
+
+  for (i=0; i<chan->ntx; ++i) {
+    iov[niov].iov_base  = &chan->txhdr[i];
+    iov[niov++].iov_len = sizeof(uint32_t);
+    iov[niov].iov_base  = zmq_msg_data(&chan->txq[i]);
+    iov[niov++].iov_len = zmq_msg_size(&chan->txq[i]);
+  }
+
+  while (idx < niov) {
+    if ((n = writev(chan->fd, &iov[idx], niov - idx)) < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) chan->events &= ~EPOLLOUT;
+      // The peer is not reading, receive ahead in case it is sending to us.
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) || _read(chan) < 0 || _wait(chan, EPOLLIN | EPOLLOUT, -1) < 0) {
+        rc = -1;
+        break;
+      }
+      continue;
+    }
+    while (idx < niov && (size_t)n >= iov[idx].iov_len) {
+      n -= iov[idx++].iov_len;
+    }
+    if (n > 0) {
+      iov[idx].iov_base = (char *)iov[idx].iov_base + n;
+      iov[idx].iov_len -= n;
+    }
+  }
+
+  for (i=0; i<chan->ntx; ++i) {
+    zmq_msg_close(&chan->txq[i]);
+  }
+  chan->ntx = 0;
+
+  return rc;
+}
+
+
+static int _bind(struct role_endpoint *ep, void *ctx)
+{
+  struct rawtcp_chan *chan;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+  int on = 1;
+
+  if (_resolve(ep->uri, 1, &addr, &addrlen) != 0) return -1;
+  if ((chan = _chan_new(ctx)) == NULL) return -1;
+  ep->chan = chan;
+
+  if ((chan->listen_fd = socket(addr.ss_family, SOCK_STREAM, 0)) < 0) return -1;
+  setsockopt(chan->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (_nonblock(chan->listen_fd, 0) != 0) return -1;
+  if (bind(chan->listen_fd, (struct sockaddr *)&addr, addrlen) != 0) return -1;
+  if (listen(chan->listen_fd, 1) != 0) return -1;
+
+  return _watch(chan, chan->listen_fd, EPOLLIN);
+}
+
+
+static int _connect(struct role_endpoint *ep, void *ctx)
+{
+  struct rawtcp_chan *chan;
+
+  if ((chan = _chan_new(ctx)) == NULL) return -1;
+  ep->chan = chan;
+
+  if (_resolve(ep->uri, 0, &chan->addr, &chan->addrlen) != 0) return -1;
+
+  // Start connecting now, the peer may not be listening yet.
+  if (_establish_step(chan) != 0 && errno != EAGAIN) return -1;
+
+  return 0;
+}
+
+
+static int _send(struct role_endpoint *ep, zmq_msg_t *frame, int flags)
+{
+  struct rawtcp_chan *chan = (struct rawtcp_chan *)ep->chan;
+  size_t size = zmq_msg_size(frame);
+  int i;
+
+  if (_establish(chan, flags) != 0) return -1;
+
+  // The length prefix is 32 bits, a message is either sent completely or not at all.
+  if (size > UINT32_MAX) {
+    for (i=0; i<chan->ntx; ++i) {
+      zmq_msg_close(&chan->txq[i]);
+    }
+    chan->ntx = 0;
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  // ZMQ_DONTWAIT applies to the start of a message, which is then written completely (see sc/rawtcp.h).
+  if ((flags & ZMQ_DONTWAIT) && chan->ntx == 0 && !(_wait(chan, EPOLLOUT, 0) & EPOLLOUT)) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  // Frames of a multipart message are queued and written together.
+  chan->txhdr[chan->ntx] = (uint32_t)size;
+  zmq_msg_init(&chan->txq[chan->ntx]);
+  zmq_msg_move(&chan->txq[chan->ntx], frame);
+  chan->ntx++;
+  if ((flags & ZMQ_SNDMORE) && chan->ntx < SC_RAWTCP_BATCH) return (int)size;
+
+  return (_flush(chan) == 0) ? (int)size : -1;
+}
+
+
+static int _recv(struct role_endpoint *ep, zmq_msg_t *frame, int flags)
+{
+  struct rawtcp_chan *chan = (struct rawtcp_chan *)ep->chan;
+  int n;
+  int rc;
+
+  if (_establish(chan, flags) != 0) return -1;
+
+  while ((rc = _take(chan, frame)) == 0) {
+    if ((n = _read(chan)) < 0) return -1;
+    if (n > 0) continue;
+    if (flags & ZMQ_DONTWAIT) {
+      errno = EAGAIN;
+      return -1;
+    }
+    if (_wait(chan, EPOLLIN, -1) < 0) return -1;
+  }
+  if (rc < 0) return -1;
+
+  return (int)zmq_msg_size(frame);
+}
+
+
+static short _poll(struct role_endpoint *ep, short events)
+{
+  struct rawtcp_chan *chan = (struct rawtcp_chan *)ep->chan;
+  short revents = 0;
+  uint32_t size;
+
+  if (chan == NULL) return 0;
+  if (_dispatch(chan->loop, 0) < 0) return 0;
+  if (_establish(chan, ZMQ_DONTWAIT) != 0) return 0;
+
+  if (events & SC_POLLIN) {
+    if ((chan->events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) && _read(chan) < 0) {
+      return SC_POLLIN; // Let recv report the error.
+    }
+    if (chan->rxtail - chan->rxhead >= sizeof(uint32_t)) {
+      memcpy(&size, chan->rxbuf + chan->rxhead, sizeof(uint32_t));
+      if (chan->rxtail - chan->rxhead >= sizeof(uint32_t) + size) revents |= SC_POLLIN;
+    }
+  }
+  if ((events & SC_POLLOUT) && (chan->events & EPOLLOUT)) {
+    revents |= SC_POLLOUT;
+  }
+
+  return revents;
+}
+
+
+static int _pollitem(struct role_endpoint *ep, zmq_pollitem_t *item)
+{
+  struct rawtcp_chan *chan = (struct rawtcp_chan *)ep->chan;
+
+  if (chan == NULL) {
+    errno = ENOTCONN;
+    return -1;
+  }
+
+  // Readable when any channel of the loop has events, see SC_TRANSPORT_LOOP.
+  item->socket = NULL;
+  item->fd     = chan->loop->epfd;
+
+  return 0;
+}
+
+
+static int _close(struct role_endpoint *ep)
+{
+  struct rawtcp_chan *chan = (struct rawtcp_chan *)ep->chan;
+  int i;
+
+  if (chan == NULL) return 0;
+
+  for (i=0; i<chan->ntx; ++i) {
+    zmq_msg_close(&chan->txq[i]);
+  }
+  if (chan->listen_fd >= 0) close(chan->listen_fd);
+  if (chan->fd >= 0) {
+    shutdown(chan->fd, SHUT_WR); // Sent data is still delivered.
+    close(chan->fd);
+  }
+  _loop_put(chan->loop);
+  free(chan->rxbuf);
+  free(chan);
+  ep->chan = NULL;
+
+  return 0;
+}
+
+
+const struct sc_transport sc_transport_rawtcp = {
+  "rawtcp", SC_TRANSPORT_WAIT | SC_TRANSPORT_LOOP,
+  _bind, _connect, _send, _recv, _poll, _pollitem, _close
+};
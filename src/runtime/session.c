@@ -5,24 +5,36 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include <zmq.h>
 
 #include "connmgr.h"
 #include "st_node.h"
 
+#include "sc/async.h"
+#include "sc/collectives.h"
+#include "sc/msg.h"
 #include "sc/session.h"
+#include "sc/transport.h"
 #include "sc/types.h"
 #include "sc/utils.h"
 
 
 extern FILE *yyin;
 extern int yyparse(st_tree *tree);
+
+static pthread_mutex_t parser_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Context shared by the in-process sessions (session_init_inproc).
+static pthread_mutex_t inproc_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *inproc_ctx = NULL;
+static unsigned int inproc_nsession = 0;
 #ifdef __DEBUG__
 long long DEBUG_prog_start_time;
 long long DEBUG_sess_start_time;
@@ -31,36 +43,61 @@ long long DEBUG_prog_end_time;
 #endif
 
 
+/**
+ * Helper function to get the name of a role.
+ *
+ */
+static const char *name_of_role(const role *r)
+{
+  switch (r->type) {
+    case SESSION_ROLE_P2P:
+      return r->p2p->name;
+    case SESSION_ROLE_GRP:
+      return r->grp->name;
+    case SESSION_ROLE_INDEXED:
+      assert(0); // TODO handle indexed endpoint
+      break;
+    default:
+      fprintf(stderr, "Unknown endpoint type: %d\n", r->type);
+  }
+
+  return NULL;
+}
+
+
+/**
+ * Helper function to lookup a role in the role table of a session.
+ *
+ */
+static role *lookup_role(const session *s, const char *role_name)
+{
+  unsigned int slot;
+  unsigned int mask = s->nslot - 1;
+
+  // Linear probing from the hashed role name.
+  for (slot = st_node_msgsig_id(role_name) & mask; s->role_table[slot] != NULL; slot = (slot+1) & mask) {
+    if (strcmp(name_of_role(s->role_table[slot]), role_name) == 0) {
+      return s->role_table[slot];
+    }
+  }
+
+  return NULL;
+}
+
+
 /**
  * Helper function to lookup a role in a session.
  *
  */
 static role *find_role_in_session(session *s, char *role_name)
 {
-  int role_idx;
+  role *r;
+
 #ifdef __DEBUG__
-  fprintf(stderr, "%s: { role: %s } in ", __FUNCTION__, role_name);
-  session_dump(s);
+  fprintf(stderr, "%s: { role: %s }\n", __FUNCTION__, role_name);
 #endif
-  for (role_idx=0; role_idx<s->nrole; ++role_idx) {
-    switch (s->roles[role_idx]->type) {
-      case SESSION_ROLE_P2P: 
-        if (strcmp(s->roles[role_idx]->p2p->name, role_name) == 0) {
-          return s->roles[role_idx];
-        }
-        break;
-      case SESSION_ROLE_GRP:
-        if (strcmp(s->roles[role_idx]->grp->name, role_name) == 0) {
-          return s->roles[role_idx];
-        }
-        break;
-      case SESSION_ROLE_INDEXED:
-        assert(0); // TODO handle indexed endpoint
-        break;
-      default:
-        fprintf(stderr, "Unknown endpoint type: %d\n", s->roles[role_idx]->type);
-    } 
-  }
+
+  if ((r = lookup_role(s, role_name)) != NULL) return r;
 
   fprintf(stderr, "%s: Role %s not found in session.\n",
       __FUNCTION__, role_name);
@@ -71,22 +108,97 @@ static role *find_role_in_session(session *s, char *role_name)
 }
 
 
-void session_init(int *argc, char ***argv, session **s, const char *scribble)
+/**
+ * Helper function to build the role lookup table of a session.
+ *
+ */
+static void index_roles(session *s)
 {
   unsigned int role_idx;
-#ifdef __DEBUG__
-  sc_print_version();
-  DEBUG_prog_start_time = sc_time();
-#endif
+  unsigned int slot;
+
+  // At most half full, so probe sequences stay short.
+  free(s->role_table);
+  s->nslot = 4;
+  while (s->nslot < 2 * s->nrole) {
+    s->nslot <<= 1;
+  }
+  s->role_table = (role **)calloc(s->nslot, sizeof(role *));
+
+  for (role_idx=0; role_idx<s->nrole; role_idx++) {
+    slot = st_node_msgsig_id(name_of_role(s->roles[role_idx])) & (s->nslot - 1);
+    while (s->role_table[slot] != NULL) {
+      slot = (slot+1) & (s->nslot - 1);
+    }
+    s->role_table[slot] = s->roles[role_idx];
+  }
+}
+
+
+/**
+ * Helper function to collect message labels of a (local) protocol
+ * into the label table of a session.
+ *
+ */
+static void intern_labels(session *s, const st_node *node)
+{
+  int i;
+  unsigned int label_idx;
+  if (node == NULL) return;
+
+  if (node->type == ST_NODE_SEND || node->type == ST_NODE_RECV || node->type == ST_NODE_SENDRECV) {
+    const char *op = node->interaction->msgsig.op;
+    if (op != NULL && strlen(op) > 0) {
+      sc_label_t id = sc_label_id(op);
+      for (label_idx=0; label_idx<s->nlabel; ++label_idx) {
+        if (s->labels[label_idx].id == id) break;
+      }
+      if (label_idx == s->nlabel) {
+        s->labels = (struct session_label *)realloc(s->labels, sizeof(struct session_label) * (s->nlabel+1));
+        s->labels[s->nlabel].id = id;
+        s->labels[s->nlabel].name = (char *)calloc(sizeof(char), strlen(op)+1);
+        strcpy(s->labels[s->nlabel].name, op);
+        s->nlabel++;
+      } else if (strcmp(s->labels[label_idx].name, op) != 0) {
+        fprintf(stderr, "Error: labels %s and %s have the same identifier %08x\n",
+            s->labels[label_idx].name, op, id);
+      }
+    }
+  }
+
+  for (i=0; i<node->nchild; ++i) {
+    intern_labels(s, node->children[i]);
+  }
+}
+
+
+static int compare_labels(const void *a, const void *b)
+{
+  sc_label_t id_a = ((const struct session_label *)a)->id;
+  sc_label_t id_b = ((const struct session_label *)b)->id;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
 
+/**
+ * Helper function to parse the (local) protocol of a session.
+ *
+ */
+static st_tree *load_protocol(const char *scribble)
+{
   st_tree *tree = st_tree_init((st_tree *)malloc(sizeof(st_tree)));
 
+  // The parser is not reentrant (roles may be threads of one process).
+  pthread_mutex_lock(&parser_lock);
+
   // Get meta information from Scribble protocol.
   if ((yyin = fopen(scribble, "r")) == NULL) {
     fprintf(stderr, "Warning: Cannot open %s, reading from stdin\n", scribble);
   }
   yyparse(tree);
 
+  pthread_mutex_unlock(&parser_lock);
+
 #ifdef __DEBUG__
   printf("The local protocol:");
   st_tree_print(tree);
@@ -96,14 +208,225 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
   // Sanity check.
   if (tree->info->global) {
     fprintf(stderr, "Error: %s is a Global protocol\n", scribble);
-    return;
+    free(tree);
+    return NULL;
+  }
+
+  return tree;
+}
+
+
+/**
+ * Helper function to build the session of a protocol from
+ * connection parameters (conns), given the point-to-point
+ * connections between all roles (links, NULL if all pairs).
+ *
+ */
+static session *open_session(st_tree *tree, conn_rec *conns, int nconns, conn_rec *links, int nlinks, void *ctx)
+{
+  unsigned int role_idx;
+  int conn_idx;
+
+  session *sess = (session *)malloc(sizeof(session));
+
+  sess->name = (char *)calloc(sizeof(char), strlen(tree->info->myrole)+1);
+  strcpy(sess->name, tree->info->myrole);
+
+  // Intern message labels.
+  sess->nlabel = 0;
+  sess->labels = NULL;
+  intern_labels(sess, tree->root);
+  qsort(sess->labels, sess->nlabel, sizeof(struct session_label), compare_labels);
+
+  // Direct connections (p2p).
+  sess->nrole = tree->info->nrole;
+  sess->roles = (role **)malloc(sizeof(role *) * sess->nrole);
+  sess->ctx = ctx;
+  sess->inproc = 0;
+
+  for (role_idx=0; role_idx<sess->nrole; role_idx++) {
+    sess->roles[role_idx] = (role *)malloc(sizeof(role));
+    sess->roles[role_idx]->type = SESSION_ROLE_P2P;
+    sess->roles[role_idx]->s = sess;
+    sess->roles[role_idx]->p2p = (struct role_endpoint *)calloc(1, sizeof(struct role_endpoint));
+    sess->roles[role_idx]->p2p->transport = &sc_transport_zmq;
+
+    sess->roles[role_idx]->p2p->name = (char *)calloc(sizeof(char), strlen(tree->info->roles[role_idx])+1);
+    strcpy(sess->roles[role_idx]->p2p->name, tree->info->roles[role_idx]);
+  }
+  sess->role_table = NULL;
+  index_roles(sess);
+
+  // Communication graph of the session (for collectives).
+  sess->nlink = 0;
+  sess->links = (links == NULL) ? NULL : (struct session_link *)malloc(sizeof(struct session_link) * (nlinks + 1));
+  for (conn_idx=0; conn_idx<nlinks; conn_idx++) {
+    if (CONNMGR_TYPE_P2P != links[conn_idx].type) continue;
+    sess->links[sess->nlink].from = strdup(links[conn_idx].from);
+    sess->links[sess->nlink].to   = strdup(links[conn_idx].to);
+    sess->nlink++;
+  }
+
+  // Plan the connections in one pass, indexed by the peer role
+  // (the first connection parameter of a pair is used).
+  role **servers = (role **)malloc(sizeof(role *) * sess->nrole);
+  role **clients = (role **)malloc(sizeof(role *) * sess->nrole);
+  int nserver = 0;
+  int nclient = 0;
+  const struct sc_transport *transport;
+  role *peer;
+
+  for (conn_idx=0; conn_idx<nconns; conn_idx++) {
+    if (CONNMGR_TYPE_P2P != conns[conn_idx].type) continue;
+
+    if (strcmp(conns[conn_idx].from, sess->name) == 0) { // As a client.
+      if ((peer = lookup_role(sess, conns[conn_idx].to)) == NULL || peer->p2p->uri[0] != '\0') continue;
+      assert(strlen(conns[conn_idx].host) < 255 && conns[conn_idx].port < 65536);
+      transport = sc_transport_find(conns[conn_idx].host);
+      if (transport == &sc_transport_inproc) {
+        snprintf(peer->p2p->uri, sizeof(peer->p2p->uri), "inproc://sessionc-%s-%s", conns[conn_idx].from, conns[conn_idx].to);
+      } else if (transport == &sc_transport_shm || strstr(conns[conn_idx].host, "ipc:") != NULL) {
+        sprintf(peer->p2p->uri, "ipc:///tmp/sessionc-%u", conns[conn_idx].port);
+      } else {
+        sprintf(peer->p2p->uri, "tcp://%s:%u",
+            (transport == &sc_transport_rawtcp) ? conns[conn_idx].host + strlen("rawtcp:") : conns[conn_idx].host,
+            conns[conn_idx].port);
+      }
+      peer->p2p->transport = transport;
+      clients[nclient++] = peer;
+    } else if (strcmp(conns[conn_idx].to, sess->name) == 0) { // As a server.
+      if ((peer = lookup_role(sess, conns[conn_idx].from)) == NULL || peer->p2p->uri[0] != '\0') continue;
+      assert(conns[conn_idx].port < 65536);
+      transport = sc_transport_find(conns[conn_idx].host);
+      if (transport == &sc_transport_inproc) {
+        snprintf(peer->p2p->uri, sizeof(peer->p2p->uri), "inproc://sessionc-%s-%s", conns[conn_idx].from, conns[conn_idx].to);
+      } else if (transport == &sc_transport_shm || strstr(conns[conn_idx].host, "ipc:") != NULL) {
+        sprintf(peer->p2p->uri, "ipc:///tmp/sessionc-%u", conns[conn_idx].port);
+      } else {
+        sprintf(peer->p2p->uri, "tcp://*:%u", conns[conn_idx].port);
+      }
+      peer->p2p->transport = transport;
+      servers[nserver++] = peer;
+    }
+  }
+
+  // Bind all server sockets first, so connections made next (and
+  // the peers' connections) can complete in the background.
+  for (role_idx=0; role_idx<nserver; role_idx++) {
+#ifdef __DEBUG__
+    fprintf(stderr, "Connection (as server) %s -> %s is %s\n",
+        servers[role_idx]->p2p->name,
+        sess->name,
+        servers[role_idx]->p2p->uri);
+#endif
+    if (servers[role_idx]->p2p->transport->bind(servers[role_idx]->p2p, sess->ctx) != 0) {
+      perror(servers[role_idx]->p2p->transport->name);
+    }
+  }
+
+  for (role_idx=0; role_idx<nclient; role_idx++) {
+#ifdef __DEBUG__
+    fprintf(stderr, "Connection (as client) %s -> %s is %s\n",
+        sess->name,
+        clients[role_idx]->p2p->name,
+        clients[role_idx]->p2p->uri);
+#endif
+    if (clients[role_idx]->p2p->transport->connect(clients[role_idx]->p2p, sess->ctx) != 0) {
+      perror(clients[role_idx]->p2p->transport->name);
+    }
+  }
+
+  free(servers);
+  free(clients);
+
+  // Add a _Others group role.
+  sess->nrole++;
+  sess->roles = (role **)realloc(sess->roles, sizeof(role *) * sess->nrole);
+  sess->roles[sess->nrole-1] = (role *)malloc(sizeof(role)); // A group role at roles[last_index]
+  sess->roles[sess->nrole-1]->type = SESSION_ROLE_GRP;
+  sess->roles[sess->nrole-1]->s = sess;
+  sess->roles[sess->nrole-1]->grp = (struct role_group *)malloc(sizeof(struct role_group));
+
+  sess->roles[sess->nrole-1]->grp->name = "_Others";
+  sess->roles[sess->nrole-1]->grp->nendpoint = tree->info->nrole;
+  sess->roles[sess->nrole-1]->grp->endpoints
+      = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * sess->roles[sess->nrole-1]->grp->nendpoint);
+  // Copy endpoints to our global group role.
+  unsigned int endpoint_idx;
+  for (endpoint_idx=0; endpoint_idx<sess->roles[sess->nrole-1]->grp->nendpoint; endpoint_idx++) {
+    if (sess->roles[endpoint_idx]->type == SESSION_ROLE_P2P) {
+      sess->roles[sess->nrole-1]->grp->endpoints[endpoint_idx] = sess->roles[endpoint_idx]->p2p;
+    }
+  }
+
+  sess->roles[sess->nrole-1]->grp->in  = (struct role_endpoint *)calloc(1, sizeof(struct role_endpoint));
+  sess->roles[sess->nrole-1]->grp->out = (struct role_endpoint *)calloc(1, sizeof(struct role_endpoint));
+  sess->roles[sess->nrole-1]->grp->in->transport  = &sc_transport_zmq;
+  sess->roles[sess->nrole-1]->grp->out->transport = &sc_transport_zmq;
+
+  // Setup a SUB (broadcast-in) socket
+  if ((sess->roles[sess->nrole-1]->grp->in->ptr = zmq_socket(sess->ctx, ZMQ_SUB)) == NULL) perror("zmq_socket");
+  // Setup a series of PUB (broadcast-out) socket
+  if ((sess->roles[sess->nrole-1]->grp->out->ptr = zmq_socket(sess->ctx, ZMQ_PUB)) == NULL) perror("zmq_socket");
+
+  for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for the broadcast socket
+    if ((CONNMGR_TYPE_GRP == conns[conn_idx].type) && (strcmp(conns[conn_idx].to, sess->name) == 0)) {
+      if (strcmp(conns[conn_idx].host, "inproc") == 0) {
+        snprintf(sess->roles[sess->nrole-1]->grp->in->uri, sizeof(sess->roles[sess->nrole-1]->grp->in->uri), "inproc://sessionc-%s", conns[conn_idx].to);
+      } else {
+        sprintf(sess->roles[sess->nrole-1]->grp->in->uri, "tcp://*:%u", conns[conn_idx].port);
+      }
+#ifdef __DEBUG__
+      fprintf(stderr, "Broadcast in-socket: %s\n",
+        sess->roles[sess->nrole-1]->grp->in->uri);
+#endif
+      if (zmq_bind(sess->roles[sess->nrole-1]->grp->in->ptr, sess->roles[sess->nrole-1]->grp->in->uri) != 0) perror("zmq_bind");
+      break;
+    }
+  }
+
+  for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for the broadcast socket
+    if ((CONNMGR_TYPE_GRP == conns[conn_idx].type) && (strcmp(conns[conn_idx].to, sess->name) != 0)) {
+      if (strcmp(conns[conn_idx].host, "inproc") == 0) {
+        snprintf(sess->roles[sess->nrole-1]->grp->out->uri, sizeof(sess->roles[sess->nrole-1]->grp->out->uri), "inproc://sessionc-%s", conns[conn_idx].to);
+      } else {
+        sprintf(sess->roles[sess->nrole-1]->grp->out->uri, "tcp://%s:%u", conns[conn_idx].host, conns[conn_idx].port);
+      }
+#ifdef __DEBUG__
+      fprintf(stderr, "Broadcast out-socket: %s\n",
+        sess->roles[sess->nrole-1]->grp->out->uri);
+#endif
+      if (sc_transport_zmq_connect(sess->roles[sess->nrole-1]->grp->out, sess->ctx, ZMQ_PUB) != 0) perror("zmq_connect");
+    }
   }
+  zmq_setsockopt(sess->roles[sess->nrole-1]->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
+
+  sess->others = sess->roles[sess->nrole-1];
+  sess->comm = NULL;
+  sess->any = NULL;
+  index_roles(sess);
+  sess->r = &find_role_in_session;
+
+  return sess;
+}
+
+
+void session_init(int *argc, char ***argv, session **s, const char *scribble)
+{
+#ifdef __DEBUG__
+  sc_print_version();
+  DEBUG_prog_start_time = sc_time();
+#endif
+
+  st_tree *tree = load_protocol(scribble);
+  if (tree == NULL) return;
 
   // Parse arguments.
   int option;
   char *config_file = NULL;
   char *hosts_file = NULL;
   char *protocol_file = NULL;
+  int ready = 0;
 
   // Invoke getopt to extract arguments we need
   while (1) {
@@ -111,11 +434,12 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
       {"conf",     required_argument, 0, 'c'},
       {"hosts",    required_argument, 0, 's'},
       {"protocol", required_argument, 0, 'p'},
+      {"ready",    no_argument,       0, 'r'},
       {0, 0, 0, 0}
     };
 
     int option_idx = 0;
-    option = getopt_long(*argc, *argv, "c:s:p:", long_options, &option_idx);
+    option = getopt_long(*argc, *argv, "c:s:p:r", long_options, &option_idx);
 
     if (option == -1) break;
 
@@ -135,6 +459,9 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
         strcpy(protocol_file, optarg);
         fprintf(stderr, "Using protocol file %s\n", protocol_file);
         break;
+      case 'r':
+        ready = 1;
+        break;
     }
   }
 
@@ -149,7 +476,12 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
   char **roles;
   int nroles;
   host_map *hosts_roles;
-  int conn_idx;
+  traffic_edge *traffic;
+  int ntraffic;
+  connmgr_arena *strings = NULL;
+  conn_rec *links;
+  int nlinks;
+  conn_config config;
 
   if (config_file == NULL) { // Generate dynamic connection parameters (config file absent).
 
@@ -157,18 +489,34 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
       hosts_file = "hosts";
       fprintf(stderr, "Warning: host file not specified (-s), reading from `%s'\n", hosts_file);
     }
-    nhosts = connmgr_load_hosts(hosts_file, &hosts);
+    nhosts = connmgr_load_hosts(hosts_file, &hosts, &strings);
     if (protocol_file == NULL) {
       protocol_file = "Protocol.spr";
       fprintf(stderr, "Warning: protocol file not specified (-p), reading from `%s'\n", protocol_file);
     }
 
-    nroles = connmgr_load_roles(protocol_file, &roles);
-    nconns = connmgr_init(&conns, &hosts_roles, roles, nroles, hosts, nhosts, 7777);
+    nroles = connmgr_load_roles(protocol_file, &roles, &strings);
+    ntraffic = connmgr_load_traffic(protocol_file, roles, nroles, &traffic);
+    nconns = connmgr_init(&conns, &hosts_roles, roles, nroles, hosts, nhosts, 7777, traffic, ntraffic, CONNMGR_PRUNE, &strings);
+    free(traffic);
+    free(hosts);
+    free(roles);
+    links  = conns;
+    nlinks = nconns;
+    config.addr = NULL;
+
+  } else if (connmgr_map(config_file, &config) == 0) { // Use binary config file (own rows only).
+
+    nconns = connmgr_map_rows(&config, tree->info->myrole, &conns);
+    nlinks = connmgr_map_links(&config, &links);
+    hosts_roles = NULL;
+    nroles = 0;
 
   } else { // Use config file.
 
-    nconns = connmgr_read(config_file, &conns, &hosts_roles, &nroles);
+    nconns = connmgr_read(config_file, &conns, &hosts_roles, &nroles, &strings);
+    links  = conns;
+    nlinks = nconns;
 
   }
 
@@ -178,131 +526,261 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
   printf("--------------------\n");
 #endif
 
-  *s = (session *)malloc(sizeof(session));
-  session *sess = *s;
+  *s = open_session(tree, conns, nconns, links, nlinks, zmq_init(1));
+  free(tree);
+  if (links != conns) free(links);
+  free(conns);
+  free(hosts_roles);
+  connmgr_arena_free(strings);
+  connmgr_unmap(&config);
+
+  if (ready && session_ready(*s) != 0) {
+    fprintf(stderr, "Warning: readiness handshake failed\n");
+  }
+#ifdef __DEBUG__
+  DEBUG_sess_start_time = sc_time();
+#endif
+}
 
-  sess->name = (char *)calloc(sizeof(char), strlen(tree->info->myrole)+1);
-  strcpy(sess->name, tree->info->myrole);
 
-  // Direct connections (p2p).
-  sess->nrole = tree->info->nrole;
-  sess->roles = (role **)malloc(sizeof(role *) * sess->nrole);
-  sess->ctx = zmq_init(1);
+void session_init_inproc(session **s, const char *scribble)
+{
+  conn_rec *conns;
+  int nconns = 0;
+  int role_idx;
 
-  for (role_idx=0; role_idx<sess->nrole; role_idx++) {
-    sess->roles[role_idx] = (role *)malloc(sizeof(role));
-    sess->roles[role_idx]->type = SESSION_ROLE_P2P;
-    sess->roles[role_idx]->s = sess;
-    sess->roles[role_idx]->p2p = (struct role_endpoint *)malloc(sizeof(struct role_endpoint));
+#ifdef __DEBUG__
+  DEBUG_prog_start_time = sc_time();
+#endif
 
-    sess->roles[role_idx]->p2p->name = (char *)calloc(sizeof(char), strlen(tree->info->roles[role_idx])+1);
-    strcpy(sess->roles[role_idx]->p2p->name, tree->info->roles[role_idx]);
+  st_tree *tree = load_protocol(scribble);
+  if (tree == NULL) return;
+
+  // Every pair of roles is connected, the lower role name binds.
+  // inproc endpoints are named after the roles (see open_session).
+  conns = (conn_rec *)calloc(2 * tree->info->nrole + 1, sizeof(conn_rec));
+  for (role_idx=0; role_idx<tree->info->nrole; role_idx++) {
+    conns[nconns].type = CONNMGR_TYPE_P2P;
+    if (strcmp(tree->info->myrole, tree->info->roles[role_idx]) < 0) {
+      conns[nconns].from = tree->info->roles[role_idx];
+      conns[nconns].to   = tree->info->myrole;
+    } else {
+      conns[nconns].from = tree->info->myrole;
+      conns[nconns].to   = tree->info->roles[role_idx];
+    }
+    conns[nconns++].host = "inproc";
 
-    for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for matching connection parameter
+    conns[nconns].type = CONNMGR_TYPE_GRP;
+    conns[nconns].from = tree->info->roles[role_idx];
+    conns[nconns].to   = tree->info->roles[role_idx];
+    conns[nconns++].host = "inproc";
+  }
+  conns[nconns].type = CONNMGR_TYPE_GRP;
+  conns[nconns].from = tree->info->myrole;
+  conns[nconns].to   = tree->info->myrole;
+  conns[nconns++].host = "inproc";
+
+  // One context shared by all sessions of the process.
+  pthread_mutex_lock(&inproc_lock);
+  if (inproc_nsession++ == 0) inproc_ctx = zmq_init(1);
+  pthread_mutex_unlock(&inproc_lock);
+
+  *s = open_session(tree, conns, nconns, NULL, 0, inproc_ctx); // Every pair connected.
+  (*s)->inproc = 1;
+  free(conns);
+  free(tree);
 
-      if ((CONNMGR_TYPE_P2P == conns[conn_idx].type) && strcmp(conns[conn_idx].to, sess->roles[role_idx]->p2p->name) == 0 && strcmp(conns[conn_idx].from, sess->name) == 0) { // As a client.
-        assert(strlen(conns[conn_idx].host) < 255 && conns[conn_idx].port < 65536);
-        if (strstr(conns[conn_idx].host, "ipc:") != NULL) {
-          sprintf(sess->roles[role_idx]->p2p->uri, "ipc:///tmp/sessionc-%u", conns[conn_idx].port);
-        } else {
-          sprintf(sess->roles[role_idx]->p2p->uri, "tcp://%s:%u", conns[conn_idx].host, conns[conn_idx].port);
-        }
 #ifdef __DEBUG__
-        fprintf(stderr, "Connection (as client) %s -> %s is %s\n",
-            conns[conn_idx].from,
-            conns[conn_idx].to,
-            sess->roles[role_idx]->p2p->uri);
+  DEBUG_sess_start_time = sc_time();
 #endif
-        if ((sess->roles[role_idx]->p2p->ptr = zmq_socket(sess->ctx, ZMQ_PAIR)) == NULL) perror("zmq_socket");
-        if (zmq_connect(sess->roles[role_idx]->p2p->ptr, sess->roles[role_idx]->p2p->uri) != 0) perror("zmq_connect");
+}
 
-        break;
-      }
 
-      if ((CONNMGR_TYPE_P2P == conns[conn_idx].type) && strcmp(conns[conn_idx].from, sess->roles[role_idx]->p2p->name) == 0 && strcmp(conns[conn_idx].to, sess->name) == 0) { // As a server.
-        assert(conns[conn_idx].port < 65536);
-        if (strstr(conns[conn_idx].host, "ipc:") != NULL) {
-          sprintf(sess->roles[role_idx]->p2p->uri, "ipc:///tmp/sessionc-%u", conns[conn_idx].port);
-        } else {
-          sprintf(sess->roles[role_idx]->p2p->uri, "tcp://*:%u",conns[conn_idx].port);
-        }
-  #ifdef __DEBUG__
-        fprintf(stderr, "Connection (as server) %s -> %s is %s\n",
-            conns[conn_idx].from,
-            conns[conn_idx].to,
-            sess->roles[role_idx]->p2p->uri);
-  #endif
-        if ((sess->roles[role_idx]->p2p->ptr = zmq_socket(sess->ctx, ZMQ_PAIR)) == NULL) perror("zmq_socket");
-        if (zmq_bind(sess->roles[role_idx]->p2p->ptr, sess->roles[role_idx]->p2p->uri) != 0) perror("zmq_bind");
+/**
+ * Readiness handshake messages (uint8 payload).
+ */
+#define READY_HELLO 0 // p2p connection established
+#define READY_PROBE 1 // Broadcast probe, repeated until acknowledged
+#define READY_LAST  2 // Last broadcast probe of a role
+#define READY_ACK   3 // Broadcast probe received (sent over p2p)
 
-        break;
-      }
 
-    }
+/**
+ * Readiness of a peer in the handshake.
+ */
+struct ready_peer
+{
+  role *r;
+  sc_label_t id;       // Label identifying broadcasts of the peer
+  long long p2p_time;  // Time the p2p connection was established
+  long long grp_time;  // Time the peer acknowledged our broadcasts
+  int probed;          // Broadcasts of the peer received (and acknowledged)
+  int last;            // Last probe of the peer received
+};
 
+
+/**
+ * \brief Helper function to handle a readiness handshake message.
+ *
+ */
+static int ready_handle(struct role_endpoint *ep, struct ready_peer *peers, int npeer, int *pending_acks, int *pending_last)
+{
+  int i;
+  uint8_t kind;
+  uint8_t ack = READY_ACK;
+  sc_msg m;
+
+  if (sc_msg_recv(ep, &m, ZMQ_DONTWAIT) != 0) {
+    sc_msg_close(&m);
+    return (errno == EAGAIN) ? 0 : -1;
   }
 
-  // Add a _Others group role.
-  sess->nrole++;
-  sess->roles = (role **)realloc(sess->roles, sizeof(role *) * sess->nrole);
-  sess->roles[sess->nrole-1] = (role *)malloc(sizeof(role)); // A group role at roles[last_index]
-  sess->roles[sess->nrole-1]->type = SESSION_ROLE_GRP;
-  sess->roles[sess->nrole-1]->s = sess;
-  sess->roles[sess->nrole-1]->grp = (struct role_group *)malloc(sizeof(struct role_group));
+  if (sc_msg_reject_iov(ep, &m, "session_ready") != 0) {
+    sc_msg_close(&m);
+    return -1;
+  }
 
-  sess->roles[sess->nrole-1]->grp->name = "_Others";
-  sess->roles[sess->nrole-1]->grp->nendpoint = tree->info->nrole;
-  sess->roles[sess->nrole-1]->grp->endpoints
-      = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * sess->roles[sess->nrole-1]->grp->nendpoint);
-  // Copy endpoints to our global group role.
-  unsigned int endpoint_idx;
-  for (endpoint_idx=0; endpoint_idx<sess->roles[sess->nrole-1]->grp->nendpoint; endpoint_idx++) {
-    if (sess->roles[endpoint_idx]->type == SESSION_ROLE_P2P) {
-      sess->roles[sess->nrole-1]->grp->endpoints[endpoint_idx] = sess->roles[endpoint_idx]->p2p;
+  if (!sc_msg_check_type(&m, SC_TYPE_UINT8, sizeof(uint8_t), "session_ready") || m.size < 1) {
+    sc_msg_close(&m);
+    errno = EPROTO;
+    return -1;
+  }
+  kind = *(uint8_t *)sc_msg_data(&m);
+
+  for (i=0; i<npeer; ++i) {
+    if (kind == READY_ACK && peers[i].r->p2p == ep) { // Peer receives our broadcasts
+      sc_msg_sequence(ep, &m);
+      peers[i].grp_time = sc_time();
+      (*pending_acks)--;
+      break;
+    }
+    if ((kind == READY_PROBE || kind == READY_LAST) && peers[i].id == m.hdr.label) { // Broadcast of peer
+      if (!peers[i].probed) {
+        if (sc_msg_send(peers[i].r->p2p, SC_LABEL_NONE, SC_TYPE_UINT8, &ack, 1, sizeof(uint8_t), 0) != 0) {
+          sc_msg_close(&m);
+          return -1;
+        }
+        peers[i].probed = 1;
+      }
+      if (kind == READY_LAST) {
+        peers[i].last = 1;
+        (*pending_last)--;
+      }
+      break;
     }
   }
+  sc_msg_close(&m);
 
-  sess->roles[sess->nrole-1]->grp->in  = (struct role_endpoint *)malloc(sizeof(struct role_endpoint));
-  sess->roles[sess->nrole-1]->grp->out = (struct role_endpoint *)malloc(sizeof(struct role_endpoint));
+  return 0;
+}
 
-  // Setup a SUB (broadcast-in) socket
-  if ((sess->roles[sess->nrole-1]->grp->in->ptr = zmq_socket(sess->ctx, ZMQ_SUB)) == NULL) perror("zmq_socket");
-  // Setup a series of PUB (broadcast-out) socket
-  if ((sess->roles[sess->nrole-1]->grp->out->ptr = zmq_socket(sess->ctx, ZMQ_PUB)) == NULL) perror("zmq_socket");
 
-  for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for the broadcast socket
-    if ((CONNMGR_TYPE_GRP == conns[conn_idx].type) && (strcmp(conns[conn_idx].to, sess->name) == 0)) {
-      sprintf(sess->roles[sess->nrole-1]->grp->in->uri, "tcp://*:%u", conns[conn_idx].port);
-#ifdef __DEBUG__
-      fprintf(stderr, "Broadcast in-socket: %s\n",
-        sess->roles[sess->nrole-1]->grp->in->uri);
-#endif
-      if (zmq_bind(sess->roles[sess->nrole-1]->grp->in->ptr, sess->roles[sess->nrole-1]->grp->in->uri) != 0) perror("zmq_bind");
+int session_ready(session *s)
+{
+  int rc = 0;
+  int i;
+  int index;
+  int npeer = 0;
+  int npoll;
+  int pending_acks, pending_last;
+  int sent_last = 0;
+  long long start_time = sc_time();
+  long long probe_time = 0;
+  long timeout;
+  uint8_t hello = READY_HELLO;
+  uint8_t kind;
+  struct role_endpoint *in  = s->others->grp->in;
+  struct role_endpoint *out = s->others->grp->out;
+
+  struct ready_peer *peers = (struct ready_peer *)calloc(s->nrole, sizeof(struct ready_peer));
+  uint8_t *hellos = (uint8_t *)malloc(sizeof(uint8_t) * s->nrole);
+  sc_request *reqs = (sc_request *)malloc(sizeof(sc_request) * 2 * s->nrole);
+  struct role_endpoint **eps = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * (s->nrole + 1));
+  short *events  = (short *)malloc(sizeof(short) * (s->nrole + 1));
+  short *revents = (short *)malloc(sizeof(short) * (s->nrole + 1));
+
+  for (i=0; i<s->nrole; ++i) {
+    if (s->roles[i]->type != SESSION_ROLE_P2P) continue;
+    if (s->roles[i]->p2p->uri[0] == '\0') continue; // Not connected (roles do not communicate).
+    peers[npeer].r  = s->roles[i];
+    peers[npeer].id = sc_label_id(s->roles[i]->p2p->name);
+    npeer++;
+  }
+
+  // Phase 1: Hello on every p2p connection.
+  for (i=0; i<npeer; ++i) {
+    rc |= sc_irecv(&hellos[i], NULL, sizeof(uint8_t), SC_TYPE_UINT8, peers[i].r, &reqs[i]);
+    rc |= sc_isend(&hello, 1, sizeof(uint8_t), SC_TYPE_UINT8, peers[i].r, NULL, &reqs[npeer + i]);
+  }
+  for (i=0; i<npeer && rc==0; ++i) {
+    rc |= sc_waitany(npeer, reqs, &index);
+    if (index >= 0) peers[index].p2p_time = sc_time();
+  }
+  rc |= sc_waitall(npeer, &reqs[npeer]);
+
+  // Phase 2: Broadcast probes until every peer acknowledged one over p2p,
+  // then a last probe so that peers know no more probes will follow.
+  // Only the messages still expected are received (the ack is the only
+  // message of this phase on a p2p connection, and the last probe is
+  // the last broadcast of a peer until phase 3).
+  pending_acks = npeer;
+  pending_last = npeer;
+  while (rc == 0) {
+    if (pending_acks == 0 && !sent_last) {
+      kind = READY_LAST;
+      rc |= sc_msg_send(out, sc_label_id(s->name), SC_TYPE_UINT8, &kind, 1, sizeof(uint8_t), 0);
+      sent_last = 1;
+    } else if (pending_acks > 0 && sc_time() - probe_time >= SC_READY_INTERVAL_MS * 1000) {
+      kind = READY_PROBE;
+      rc |= sc_msg_send(out, sc_label_id(s->name), SC_TYPE_UINT8, &kind, 1, sizeof(uint8_t), 0);
+      probe_time = sc_time();
+    }
+    if (pending_acks == 0 && pending_last == 0) break;
+
+    npoll = 0;
+    for (i=0; i<npeer; ++i) {
+      if (peers[i].grp_time != 0) continue;
+      eps[npoll]    = peers[i].r->p2p;
+      events[npoll] = SC_POLLIN;
+      npoll++;
+    }
+    if (pending_last > 0) {
+      eps[npoll]    = in;
+      events[npoll] = SC_POLLIN;
+      npoll++;
+    }
+    timeout = (pending_acks > 0) ? SC_READY_INTERVAL_MS : -1;
+    if (sc_msg_poll(eps, events, revents, npoll, timeout) < 0) {
+      rc = -1;
       break;
     }
+
+    for (i=0; i<npoll && rc==0; ++i) {
+      if (revents[i] & SC_POLLIN) rc |= ready_handle(eps[i], peers, npeer, &pending_acks, &pending_last);
+    }
   }
 
-  for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for the broadcast socket
-    if ((CONNMGR_TYPE_GRP == conns[conn_idx].type) && (strcmp(conns[conn_idx].to, sess->name) != 0)) {
-      sprintf(sess->roles[sess->nrole-1]->grp->out->uri, "tcp://%s:%u", conns[conn_idx].host, conns[conn_idx].port);
-#ifdef __DEBUG__
-      fprintf(stderr, "Broadcast out-socket: %s\n",
-        sess->roles[sess->nrole-1]->grp->out->uri);
-#endif
-      if (zmq_connect(sess->roles[sess->nrole-1]->grp->out->ptr, sess->roles[sess->nrole-1]->grp->out->uri) != 0) perror("zmq_connect");
+  // Phase 3: No role broadcasts before all roles received the last probes.
+  if (rc == 0) rc = sc_barrier(s);
+
+  if (rc != 0) {
+    perror(__FUNCTION__);
+  } else {
+    for (i=0; i<npeer; ++i) {
+      fprintf(stderr, "%s: %s ready: p2p %f sec, broadcast %f sec\n", s->name, peers[i].r->p2p->name,
+          sc_time_diff(start_time, peers[i].p2p_time), sc_time_diff(start_time, peers[i].grp_time));
     }
+    fprintf(stderr, "%s: All endpoints ready in %f sec\n", s->name, sc_time_diff(start_time, sc_time()));
   }
-  zmq_setsockopt(sess->roles[sess->nrole-1]->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
-#ifdef ZMQ_LINGER
-  zmq_setsockopt(sess->roles[sess->nrole-1]->grp->out->ptr, ZMQ_LINGER, 0, 0);
-#endif
 
-  sess->r = &find_role_in_session;
+  free(peers);
+  free(hellos);
+  free(reqs);
+  free(eps);
+  free(events);
+  free(revents);
 
-  free(tree);
-#ifdef __DEBUG__
-  DEBUG_sess_start_time = sc_time();
-#endif
+  return rc;
 }
 
 
@@ -322,21 +800,26 @@ void session_end(session *s)
   DEBUG_sess_end_time = sc_time();
 #endif
 
-  sleep(1);
+  sc_coll_free(s);
+  sc_recv_any_free(s);
 
   for (role_idx=0; role_idx<role_count; role_idx++) {
     switch (s->roles[role_idx]->type) {
       case SESSION_ROLE_P2P:
         assert(s->roles[role_idx]->p2p != NULL);
-        if (zmq_close(s->roles[role_idx]->p2p->ptr)) {
-          perror("zmq_close");
+        sc_async_flush(s->roles[role_idx]->p2p, SC_REQ_SEND);
+        sc_msg_drop_pending(s->roles[role_idx]->p2p);
+        if (s->roles[role_idx]->p2p->transport->close(s->roles[role_idx]->p2p) != 0) {
+          perror(s->roles[role_idx]->p2p->transport->name);
         }
         break;
       case SESSION_ROLE_GRP:
-        if (zmq_close(s->roles[role_idx]->grp->in->ptr) != 0) {
+        sc_async_flush(s->roles[role_idx]->grp->out, SC_REQ_SEND);
+        sc_msg_drop_pending(s->roles[role_idx]->grp->in);
+        if (sc_transport_zmq_close(s->roles[role_idx]->grp->in) != 0) {
           perror("zmq_close");
         }
-        if (zmq_close(s->roles[role_idx]->grp->out->ptr) != 0) {
+        if (sc_transport_zmq_close(s->roles[role_idx]->grp->out) != 0) {
           perror("zmq_close");
         }
         free(s->roles[role_idx]->grp->in);
@@ -355,8 +838,32 @@ void session_end(session *s)
     free(s->roles[role_idx]);
   }
   free(s->roles);
+  free(s->role_table);
+  s->others = NULL;
 
-  zmq_term(s->ctx);
+  unsigned int label_idx;
+  for (label_idx=0; label_idx<s->nlabel; label_idx++) {
+    free(s->labels[label_idx].name);
+  }
+  free(s->labels);
+
+  unsigned int link_idx;
+  for (link_idx=0; link_idx<s->nlink; link_idx++) {
+    free(s->links[link_idx].from);
+    free(s->links[link_idx].to);
+  }
+  free(s->links);
+
+  if (s->inproc) { // Last session of the process terminates the shared context.
+    pthread_mutex_lock(&inproc_lock);
+    if (--inproc_nsession == 0) {
+      zmq_term(inproc_ctx);
+      inproc_ctx = NULL;
+    }
+    pthread_mutex_unlock(&inproc_lock);
+  } else {
+    zmq_term(s->ctx);
+  }
   s->r = NULL;
   free(s);
 #ifdef __DEBUG__
@@ -369,6 +876,36 @@ void session_end(session *s)
 }
 
 
+void session_end_sync(session *s)
+{
+  if (sc_barrier(s) != 0) {
+    fprintf(stderr, "%s: Termination handshake failed\n", __FUNCTION__);
+  }
+
+  session_end(s);
+}
+
+
+sc_label_t sc_label_id(const char *label)
+{
+  if (label == NULL) return SC_LABEL_NONE;
+  return st_node_msgsig_id(label);
+}
+
+
+const char *sc_label_name(const session *s, sc_label_t id)
+{
+  struct session_label key;
+  struct session_label *found;
+
+  key.id = id;
+  found = (struct session_label *)bsearch(&key, s->labels, s->nlabel,
+                                          sizeof(struct session_label), compare_labels);
+
+  return (found == NULL) ? NULL : found->name;
+}
+
+
 void session_dump(const session *s)
 {
   assert(s != NULL);
@@ -378,6 +915,7 @@ void session_dump(const session *s)
   printf("\n------Session-------\n");
   printf("My role: %s\n", s->name);
   printf("Number of endpoint roles: %u\n", s->nrole);
+  printf("Number of message labels: %u\n", s->nlabel);
 
   for (endpoint_idx=0; endpoint_idx<endpoint_count; endpoint_idx++) {
     switch (s->roles[endpoint_idx]->type) {
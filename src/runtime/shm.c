@@ -0,0 +1,504 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * shared memory transport module.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zmq.h>
+
+#include "sc/msg.h"
+#include "sc/shm.h"
+#include "sc/transport.h"
+
+#define SC_SHM_REC_PAD  0x1 // Unused space up to the end of the ring
+#define SC_SHM_REC_CONT 0x2 // Frame continues in the next record
+
+#define SC_SHM_MAX_CHUNK (SC_SHM_RING_SIZE / 2 - sizeof(struct shm_rec)) // Largest frame data in a record
+
+
+/**
+ * Record header in a ring, records are aligned to its size.
+ */
+struct shm_rec
+{
+  uint32_t size;  // Size of frame data in the record
+  uint32_t flags; // SC_SHM_REC_* flags
+  uint64_t total; // Size of the frame
+};
+
+
+/**
+ * Single-producer, single-consumer ring (in shared memory).
+ * head and tail count the bytes ever written and read,
+ * and are on separate cache lines.
+ */
+struct shm_ring
+{
+  uint64_t head __attribute__((aligned(64)));
+  uint64_t tail __attribute__((aligned(64)));
+  char data[SC_SHM_RING_SIZE] __attribute__((aligned(64)));
+};
+
+
+/**
+ * Shared memory region of a channel.
+ */
+struct shm_region
+{
+  struct shm_ring ring[2]; // Written by the connecting and the binding side
+};
+
+
+/**
+ * Frame received ahead.
+ */
+struct shm_frame
+{
+  zmq_msg_t msg;
+  struct shm_frame *next;
+};
+
+
+/**
+ * Shared memory channel of an endpoint (process local).
+ */
+struct shm_chan
+{
+  char name[64];
+  struct shm_region *region; // NULL until attached
+  struct shm_ring *tx;
+  struct shm_ring *rx;
+
+  zmq_msg_t rx_msg;  // Frame being received
+  int rx_active;
+  size_t rx_offset;
+
+  struct shm_frame *ahead; // Frames received ahead (in order)
+  struct shm_frame **ahead_tail;
+};
+
+
+/**
+ * \brief Helper function to get the size of a record.
+ *
+ */
+static inline size_t _rec_size(size_t size)
+{
+  return (sizeof(struct shm_rec) + size + sizeof(struct shm_rec) - 1) & ~(sizeof(struct shm_rec) - 1);
+}
+
+
+/**
+ * \brief Helper function to map a shared memory region.
+ *
+ */
+static struct shm_region *_map(const char *name, int create)
+{
+  int fd;
+  struct shm_region *region;
+
+  if ((fd = shm_open(name, create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR, 0600)) < 0) return NULL;
+
+  // A new region is zero-filled, which is an empty ring in both directions.
+  if (create && ftruncate(fd, sizeof(struct shm_region)) != 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  region = (struct shm_region *)mmap(NULL, sizeof(struct shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    if (create) shm_unlink(name);
+    return NULL;
+  }
+
+  return region;
+}
+
+
+/**
+ * \brief Helper function to attach the binding side of a channel,
+ * on receiving the region name from the connecting side.
+ *
+ */
+static int _attach(struct role_endpoint *ep, int flags)
+{
+  struct shm_chan *chan = (struct shm_chan *)ep->chan;
+  zmq_msg_t msg;
+  size_t size;
+
+  if (chan->region != NULL) return 0;
+
+  zmq_msg_init(&msg);
+  if (zmq_msg_recv(ep->ptr, &msg, flags & ZMQ_DONTWAIT) < 0) {
+    zmq_msg_close(&msg);
+    return -1;
+  }
+  size = zmq_msg_size(&msg);
+  if (size == 0 || size > sizeof(chan->name)) {
+    fprintf(stderr, "%s: Malformed channel name (%zu bytes) from %s\n", __FUNCTION__, size, ep->uri);
+    zmq_msg_close(&msg);
+    errno = EPROTO;
+    return -1;
+  }
+  memcpy(chan->name, zmq_msg_data(&msg), size);
+  chan->name[size-1] = '\0';
+  zmq_msg_close(&msg);
+
+  if ((chan->region = _map(chan->name, 0)) == NULL) {
+    perror(__FUNCTION__);
+    return -1;
+  }
+  shm_unlink(chan->name);
+
+  chan->tx = &chan->region->ring[1];
+  chan->rx = &chan->region->ring[0];
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to check for space for a record of size
+ * bytes of frame data.
+ *
+ */
+static int _writable(const struct shm_ring *ring, size_t size)
+{
+  uint64_t head = ring->head;
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  size_t need = _rec_size(size);
+  size_t contig = SC_SHM_RING_SIZE - (head & (SC_SHM_RING_SIZE - 1));
+
+  if (need > contig) need += contig; // Padded to the start of the ring.
+
+  return SC_SHM_RING_SIZE - (head - tail) >= need;
+}
+
+
+/**
+ * \brief Helper function to write a record, if there is space.
+ *
+ * \returns 1 if written, 0 otherwise
+ */
+static int _write(struct shm_ring *ring, const void *data, size_t size, uint64_t total, uint32_t flags)
+{
+  uint64_t head = ring->head;
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  size_t need = _rec_size(size);
+  size_t pos = head & (SC_SHM_RING_SIZE - 1);
+  size_t contig = SC_SHM_RING_SIZE - pos;
+  struct shm_rec *rec;
+
+  if (need > contig) { // Pad to the start of the ring.
+    if (SC_SHM_RING_SIZE - (head - tail) < contig + need) return 0;
+    rec = (struct shm_rec *)(ring->data + pos);
+    rec->size  = 0;
+    rec->flags = SC_SHM_REC_PAD;
+    rec->total = 0;
+    head += contig;
+    pos = 0;
+  } else if (SC_SHM_RING_SIZE - (head - tail) < need) {
+    return 0;
+  }
+
+  rec = (struct shm_rec *)(ring->data + pos);
+  rec->size  = (uint32_t)size;
+  rec->flags = flags;
+  rec->total = total;
+  if (size > 0) memcpy(rec + 1, data, size);
+
+  // Publish the record (and padding) to the consumer.
+  __atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+
+/**
+ * \brief Helper function to read records until a frame is complete.
+ *
+ * \returns 1 if a frame is complete (in chan->rx_msg), 0 if the ring
+ *          is empty, -1 otherwise and set errno
+ */
+static int _read(struct shm_chan *chan)
+{
+  struct shm_ring *ring = chan->rx;
+  uint64_t tail = ring->tail;
+  size_t pos;
+  uint32_t flags;
+  struct shm_rec *rec;
+
+  while (tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+    pos = tail & (SC_SHM_RING_SIZE - 1);
+    rec = (struct shm_rec *)(ring->data + pos);
+
+    if (rec->flags & SC_SHM_REC_PAD) {
+      tail += SC_SHM_RING_SIZE - pos;
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+      continue;
+    }
+
+    if (!chan->rx_active) {
+      if (zmq_msg_init_size(&chan->rx_msg, rec->total) != 0) return -1;
+      chan->rx_active = 1;
+      chan->rx_offset = 0;
+    }
+    if (chan->rx_offset + rec->size > zmq_msg_size(&chan->rx_msg)) {
+      fprintf(stderr, "%s: Malformed record (%u bytes) in %s\n", __FUNCTION__, rec->size, chan->name);
+      errno = EPROTO;
+      return -1;
+    }
+    memcpy((char *)zmq_msg_data(&chan->rx_msg) + chan->rx_offset, rec + 1, rec->size);
+    chan->rx_offset += rec->size;
+    flags = rec->flags;
+
+    // Release the record to the producer.
+    tail += _rec_size(rec->size);
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+    if (!(flags & SC_SHM_REC_CONT)) {
+      chan->rx_active = 0;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to receive all complete frames ahead.
+ *
+ */
+static int _read_ahead(struct shm_chan *chan)
+{
+  int rc;
+  struct shm_frame *frame;
+
+  while ((rc = _read(chan)) == 1) {
+    frame = (struct shm_frame *)malloc(sizeof(struct shm_frame));
+    zmq_msg_init(&frame->msg);
+    zmq_msg_move(&frame->msg, &chan->rx_msg);
+    zmq_msg_close(&chan->rx_msg);
+    frame->next = NULL;
+    *chan->ahead_tail = frame;
+    chan->ahead_tail = &frame->next;
+  }
+
+  return rc;
+}
+
+
+int sc_shm_create(struct role_endpoint *ep)
+{
+  static unsigned int nchan = 0;
+  struct shm_chan *chan = (struct shm_chan *)calloc(1, sizeof(struct shm_chan));
+  zmq_msg_t msg;
+
+  chan->ahead_tail = &chan->ahead;
+
+  // Sessions of roles running as threads share the counter, and a
+  // segment left behind by an earlier process with the same pid is
+  // skipped (the segment is created exclusively).
+  do {
+    snprintf(chan->name, sizeof(chan->name), "/sessionc-%d-%u", (int)getpid(),
+             __atomic_fetch_add(&nchan, 1, __ATOMIC_RELAXED));
+  } while ((chan->region = _map(chan->name, 1)) == NULL && errno == EEXIST);
+
+  if (chan->region == NULL) {
+    free(chan);
+    return -1;
+  }
+  chan->tx = &chan->region->ring[0];
+  chan->rx = &chan->region->ring[1];
+
+  // Announce the region to the binding side.
+  zmq_msg_init_size(&msg, strlen(chan->name) + 1);
+  memcpy(zmq_msg_data(&msg), chan->name, strlen(chan->name) + 1);
+  if (zmq_msg_send(ep->ptr, &msg, 0) < 0) {
+    zmq_msg_close(&msg);
+    munmap(chan->region, sizeof(struct shm_region));
+    shm_unlink(chan->name);
+    free(chan);
+    return -1;
+  }
+  zmq_msg_close(&msg);
+
+  ep->chan = chan;
+
+  return 0;
+}
+
+
+int sc_shm_accept(struct role_endpoint *ep)
+{
+  struct shm_chan *chan = (struct shm_chan *)calloc(1, sizeof(struct shm_chan));
+
+  chan->region = NULL;
+  chan->ahead_tail = &chan->ahead;
+
+  ep->chan = chan;
+
+  return 0;
+}
+
+
+int sc_shm_send(struct role_endpoint *ep, zmq_msg_t *frame, int flags)
+{
+  struct shm_chan *chan = (struct shm_chan *)ep->chan;
+  const char *data = (const char *)zmq_msg_data(frame);
+  size_t total = zmq_msg_size(frame);
+  size_t offset = 0;
+  size_t size;
+  int spins = 0;
+
+  if (_attach(ep, flags) != 0) return -1;
+
+  // Only the first chunk is checked, a larger frame cannot be in the ring at once.
+  if ((flags & ZMQ_DONTWAIT) && !_writable(chan->tx, (total < SC_SHM_MAX_CHUNK) ? total : SC_SHM_MAX_CHUNK)) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  // Frames larger than half the ring are sent in chunks.
+  do {
+    size = (total - offset < SC_SHM_MAX_CHUNK) ? total - offset : SC_SHM_MAX_CHUNK;
+    while (!_write(chan->tx, data + offset, size, total, (offset + size < total) ? SC_SHM_REC_CONT : 0)) {
+      if (_read_ahead(chan) < 0) return -1;
+      sc_transport_wait(&spins);
+    }
+    offset += size;
+    spins = 0;
+  } while (offset < total);
+
+  return (int)total;
+}
+
+
+int sc_shm_recv(struct role_endpoint *ep, zmq_msg_t *frame, int flags)
+{
+  struct shm_chan *chan = (struct shm_chan *)ep->chan;
+  struct shm_frame *ahead;
+  int rc;
+  int spins = 0;
+
+  if (_attach(ep, flags) != 0) return -1;
+
+  if ((ahead = chan->ahead) != NULL) {
+    zmq_msg_move(frame, &ahead->msg);
+    zmq_msg_close(&ahead->msg);
+    chan->ahead = ahead->next;
+    if (chan->ahead == NULL) chan->ahead_tail = &chan->ahead;
+    free(ahead);
+    return (int)zmq_msg_size(frame);
+  }
+
+  while ((rc = _read(chan)) == 0) {
+    if (flags & ZMQ_DONTWAIT) {
+      errno = EAGAIN;
+      return -1;
+    }
+    sc_transport_wait(&spins);
+  }
+  if (rc < 0) return -1;
+
+  zmq_msg_move(frame, &chan->rx_msg);
+  zmq_msg_close(&chan->rx_msg);
+
+  return (int)zmq_msg_size(frame);
+}
+
+
+short sc_shm_poll(struct role_endpoint *ep, short events)
+{
+  struct shm_chan *chan = (struct shm_chan *)ep->chan;
+  short revents = 0;
+
+  if (_attach(ep, ZMQ_DONTWAIT) != 0) return 0;
+
+  // Only complete frames are ready (not padding or the start of a chunked frame),
+  // errors are left for the receive to report.
+  if ((events & SC_POLLIN) && (_read_ahead(chan) < 0 || chan->ahead != NULL)) {
+    revents |= SC_POLLIN;
+  }
+  if ((events & SC_POLLOUT) && _writable(chan->tx, 0)) {
+    revents |= SC_POLLOUT;
+  }
+
+  return revents;
+}
+
+
+void sc_shm_close(struct role_endpoint *ep)
+{
+  struct shm_chan *chan = (struct shm_chan *)ep->chan;
+  struct shm_frame *ahead;
+
+  if (chan == NULL) return;
+
+  if (chan->rx_active) zmq_msg_close(&chan->rx_msg);
+  while ((ahead = chan->ahead) != NULL) {
+    chan->ahead = ahead->next;
+    zmq_msg_close(&ahead->msg);
+    free(ahead);
+  }
+
+  // Either side removes the name (the other side gets ENOENT), so that
+  // a channel never attached to does not outlive the session.
+  if (chan->name[0] != '\0') shm_unlink(chan->name);
+  if (chan->region != NULL) {
+    munmap(chan->region, sizeof(struct shm_region));
+  }
+
+  free(chan);
+  ep->chan = NULL;
+}
+
+
+/**
+ * \brief Helper function to bind the socket of an endpoint and
+ * wait for the channel from the connecting side.
+ *
+ */
+static int _bind(struct role_endpoint *ep, void *ctx)
+{
+  if (sc_transport_zmq_bind(ep, ctx, ZMQ_PAIR) != 0) return -1;
+  return sc_shm_accept(ep);
+}
+
+
+/**
+ * \brief Helper function to connect the socket of an endpoint and
+ * create the channel (the socket only carries its name).
+ *
+ */
+static int _connect(struct role_endpoint *ep, void *ctx)
+{
+  if (sc_transport_zmq_connect(ep, ctx, ZMQ_PAIR) != 0) return -1;
+  return sc_shm_create(ep);
+}
+
+
+static int _close(struct role_endpoint *ep)
+{
+  sc_shm_close(ep);
+  return sc_transport_zmq_close(ep);
+}
+
+
+const struct sc_transport sc_transport_shm = {
+  "shm", SC_TRANSPORT_LOCAL,
+  _bind, _connect, sc_shm_send, sc_shm_recv, sc_shm_poll, NULL, _close
+};
@@ -0,0 +1,163 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * transport module.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <zmq.h>
+
+#include "sc/msg.h"
+#include "sc/session.h"
+#include "sc/shm.h"
+#include "sc/transport.h"
+#include "sc/types.h"
+
+#define SC_TRANSPORT_SPINS 1000 // Yields before sleeping while busy-polling
+
+// Transports selected by host prefix (ZeroMQ otherwise).
+static const struct sc_transport *_transports[] = { &sc_transport_shm, &sc_transport_inproc, &sc_transport_rawtcp };
+
+
+int sc_transport_zmq_bind(struct role_endpoint *ep, void *ctx, int type)
+{
+  if ((ep->ptr = zmq_socket(ctx, type)) == NULL) return -1;
+  return zmq_bind(ep->ptr, ep->uri);
+}
+
+
+int sc_transport_zmq_connect(struct role_endpoint *ep, void *ctx, int type)
+{
+  int rc;
+
+  if (ep->ptr == NULL && (ep->ptr = zmq_socket(ctx, type)) == NULL) return -1;
+
+  // An inproc peer in the same process may not have bound yet.
+  while ((rc = zmq_connect(ep->ptr, ep->uri)) != 0 && errno == ECONNREFUSED && strncmp(ep->uri, "inproc:", 7) == 0) {
+    sched_yield();
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to bind a PAIR socket.
+ *
+ */
+static int _zmq_bind(struct role_endpoint *ep, void *ctx)
+{
+  return sc_transport_zmq_bind(ep, ctx, ZMQ_PAIR);
+}
+
+
+/**
+ * \brief Helper function to connect a PAIR socket.
+ *
+ */
+static int _zmq_connect(struct role_endpoint *ep, void *ctx)
+{
+  return sc_transport_zmq_connect(ep, ctx, ZMQ_PAIR);
+}
+
+
+static int _zmq_send(struct role_endpoint *ep, zmq_msg_t *frame, int flags)
+{
+  return zmq_msg_send(ep->ptr, frame, flags);
+}
+
+
+static int _zmq_recv(struct role_endpoint *ep, zmq_msg_t *frame, int flags)
+{
+  return zmq_msg_recv(ep->ptr, frame, flags);
+}
+
+
+static int _zmq_pollitem(struct role_endpoint *ep, zmq_pollitem_t *item)
+{
+  if (ep->ptr == NULL) { // zmq_poll would watch fd 0 instead.
+    errno = ENOTCONN;
+    return -1;
+  }
+  item->socket = ep->ptr;
+  item->fd     = 0;
+
+  return 0;
+}
+
+
+static short _zmq_poll(struct role_endpoint *ep, short events)
+{
+  zmq_pollitem_t item;
+
+  if (_zmq_pollitem(ep, &item) != 0) return 0;
+  item.events  = ((events & SC_POLLIN) ? ZMQ_POLLIN : 0) | ((events & SC_POLLOUT) ? ZMQ_POLLOUT : 0);
+  item.revents = 0;
+  if (zmq_poll(&item, 1, 0) <= 0) return 0;
+
+  return ((item.revents & ZMQ_POLLIN) ? SC_POLLIN : 0) | ((item.revents & ZMQ_POLLOUT) ? SC_POLLOUT : 0);
+}
+
+
+int sc_transport_zmq_close(struct role_endpoint *ep)
+{
+  int linger = SC_LINGER_MS;
+  int rc;
+
+  if (ep->ptr == NULL) return 0;
+
+  if (zmq_setsockopt(ep->ptr, ZMQ_LINGER, &linger, sizeof(linger)) != 0) {
+    perror("zmq_setsockopt");
+  }
+
+  rc = zmq_close(ep->ptr);
+  ep->ptr = NULL;
+
+  return rc;
+}
+
+
+const struct sc_transport sc_transport_zmq = {
+  "zmq", SC_TRANSPORT_WAIT,
+  _zmq_bind, _zmq_connect, _zmq_send, _zmq_recv, _zmq_poll, _zmq_pollitem, sc_transport_zmq_close
+};
+
+
+// ZeroMQ hands zero-copy frames over as pointers within a context.
+const struct sc_transport sc_transport_inproc = {
+  "inproc", SC_TRANSPORT_WAIT | SC_TRANSPORT_NOCOPY | SC_TRANSPORT_LOCAL,
+  _zmq_bind, _zmq_connect, _zmq_send, _zmq_recv, _zmq_poll, _zmq_pollitem, sc_transport_zmq_close
+};
+
+
+const struct sc_transport *sc_transport_find(const char *host)
+{
+  unsigned int i;
+  size_t len;
+
+  for (i=0; i<sizeof(_transports)/sizeof(_transports[0]); ++i) {
+    len = strlen(_transports[i]->name);
+    if (strncmp(host, _transports[i]->name, len) == 0 && (host[len] == ':' || host[len] == '\0')) {
+      return _transports[i];
+    }
+  }
+
+  return &sc_transport_zmq;
+}
+
+
+void sc_transport_wait(int *spins)
+{
+  struct timespec ts = { 0, 20000 };
+
+  if ((*spins)++ < SC_TRANSPORT_SPINS) {
+    sched_yield();
+  } else {
+    nanosleep(&ts, NULL);
+  }
+}
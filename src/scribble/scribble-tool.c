@@ -15,11 +15,54 @@
 extern int yyparse(st_tree *tree);
 extern FILE *yyin;
 
+
+/**
+ * Print message labels (operators) of a node and its children
+ * as C preprocessor constants, skipping labels already printed.
+ *
+ * Returns the number of labels whose identifier is that of another label.
+ */
+static int print_labels(st_node *node, char ***printed, int *nprinted)
+{
+  int i;
+  int ncollision = 0;
+  if (node == NULL) return 0;
+
+  if (node->type == ST_NODE_SENDRECV || node->type == ST_NODE_SEND || node->type == ST_NODE_RECV) {
+    char *op = node->interaction->msgsig.op;
+    if (op != NULL && strlen(op) > 0) {
+      for (i=0; i<*nprinted; ++i) {
+        if (strcmp((*printed)[i], op) == 0) break;
+      }
+      if (i == *nprinted) {
+        for (i=0; i<*nprinted; ++i) {
+          if (st_node_msgsig_id((*printed)[i]) == st_node_msgsig_id(op)) {
+            fprintf(stderr, "Error: labels %s and %s have the same identifier %08x\n",
+                (*printed)[i], op, st_node_msgsig_id(op));
+            ncollision++;
+          }
+        }
+        *printed = (char **)realloc(*printed, sizeof(char *) * (*nprinted+1));
+        (*printed)[(*nprinted)++] = op;
+        printf("#define SC_LABEL_%s 0x%08xu\n", op, st_node_msgsig_id(op));
+      }
+    }
+  }
+
+  for (i=0; i<node->nchild; ++i) {
+    ncollision += print_labels(node->children[i], printed, nprinted);
+  }
+
+  return ncollision;
+}
+
+
 int main(int argc, char *argv[])
 {
   int option;
   int check = 0;
   int parse = 0;
+  int labels = 0;
   int show_usage = 0;
   int show_version = 0;
   int verbosity_level = 0;
@@ -34,6 +77,7 @@ int main(int argc, char *argv[])
       {"colour",  no_argument,       0,  0 },
       {"parse",   no_argument,       0, 's'},
       {"check",   no_argument,       0, 'c'},
+      {"labels",  no_argument,       0, 'l'},
       {"version", no_argument,       0, 'v'},
       {"verbose", no_argument,       0, 'V'},
       {"help",    no_argument,       0, 'h'},
@@ -41,7 +85,7 @@ int main(int argc, char *argv[])
     };
   
     int option_idx = 0;
-    option = getopt_long(argc, argv, "p:o:scvVh", long_options, &option_idx);
+    option = getopt_long(argc, argv, "p:o:sclvVh", long_options, &option_idx);
 
     if (option == -1) break;
 
@@ -65,6 +109,9 @@ int main(int argc, char *argv[])
       case 'c':
         check = 1;
         break;
+      case 'l':
+        labels = 1;
+        break;
       case 'v':
         show_version = 1;
         break;
@@ -86,7 +133,7 @@ int main(int argc, char *argv[])
   }
 
   if (show_usage) {
-    fprintf(stderr, "Usage: %s [--parse] [--project role] [--check] [-v] [-h] Scribble.spr\n", argv[0]);
+    fprintf(stderr, "Usage: %s [--parse] [--project role] [--check] [--labels] [-v] [-h] Scribble.spr\n", argv[0]);
     return EXIT_SUCCESS;
   }
 
@@ -126,6 +173,19 @@ int main(int argc, char *argv[])
     assert(0 /* Well-formedness checks unimplemented */);
   }
 
+  if (labels) {
+    if (verbosity_level > 0) fprintf(stderr, "Message labels of %s\n", scribble_file);
+    char **printed = NULL;
+    int nprinted = 0;
+    printf("/* Message labels of protocol %s (scribble-tool --labels) */\n", tree->info->name);
+    if (print_labels(tree->root, &printed, &nprinted) > 0) {
+      free(printed);
+      st_tree_free(tree);
+      return EXIT_FAILURE;
+    }
+    free(printed);
+  }
+
   if (project_role != NULL) {
     if (verbosity_level > 0) fprintf(stderr, "Projection of %s for %s\n", scribble_file, project_role);
     st_tree *projected_tree = scribble_project(tree, project_role);
@@ -9,6 +9,7 @@
 #include <sstream>
 #include <stack>
 #include <map>
+#include <vector>
 
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/DeclVisitor.h"
@@ -17,6 +18,8 @@
 #include "clang/Frontend/FrontendPluginRegistry.h"
 #include "clang/Frontend/CompilerInstance.h"
 
+#include "llvm/Support/Format.h"
+
 #include "st_node.h"
 #include "canonicalise.h"
 
@@ -52,6 +55,15 @@ namespace {
     std::stack< st_node * > appendto_node;
     std::map< std::string, std::string > varname2rolename;
 
+    // Message labels of the protocol by identifier (see st_node_msgsig_id).
+    std::map< unsigned int, std::string > label_ids_;
+    bool label_collision_;
+
+    // Receives from any role waiting for the rest of their group.
+    std::vector< std::string > any_roles_;
+    std::string any_payload_;
+    unsigned int any_count_;
+
     // Recursion counter.
     int recur_counter;
 
@@ -71,6 +83,9 @@ namespace {
         // Recursion label generation.
         recur_counter = 0;
 
+        any_count_ = 0;
+        label_collision_ = false;
+
         st_tree_init(tree_);
         st_tree_set_name(tree_, "_");
         tree_->info->myrole = strdup("__ROLE__");
@@ -89,6 +104,8 @@ namespace {
           BaseDeclVisitor::Visit(decl);
         }
 
+        flush_any_recv();
+
         // Scribble protocol.
         st_node_canonicalise(scribble_tree_->root);
 
@@ -100,7 +117,9 @@ namespace {
         // Do type checking (comparison)
         st_node_reset_markedflag(tree_->root);
         st_node_reset_markedflag(scribble_tree_->root);
-        if (st_node_compare_r(scribble_tree_->root, tree_->root)) {
+        if (label_collision_) {
+          diagId = context_->getDiagnostics().getCustomDiagID(DiagnosticsEngine::Error, "Type checking failed, message labels have the same identifier");
+        } else if (st_node_compare_r(scribble_tree_->root, tree_->root)) {
           diagId = context_->getDiagnostics().getCustomDiagID(DiagnosticsEngine::Note, "Type checking successful");
           llvm::outs() << "Type checking successful\n";
         } else {
@@ -184,6 +203,133 @@ namespace {
       }
 
 
+      //
+      // recv_*_any receives one message from each of its n roles in a
+      // run of n consecutive calls (sc_recv_any excludes the roles
+      // already received from), see st_node_append_recv_any.
+      //
+      void flush_any_recv() {
+        if (any_roles_.empty()) return;
+
+        std::vector< const char * > roles;
+        for (unsigned int i=0; i<any_roles_.size(); ++i) {
+          roles.push_back(any_roles_[i].c_str());
+        }
+        if (!st_node_append_recv_any(appendto_node.top(), &roles[0], roles.size(),
+                                     any_payload_.c_str(), any_count_)) {
+          llvm::errs() << "Error: " << any_count_ << " receive(s) from any of "
+                       << any_roles_.size() << " roles, expecting one from each role\n";
+        }
+
+        any_roles_.clear();
+        any_payload_.clear();
+        any_count_ = 0;
+      }
+
+
+      //
+      // Whether the (local) protocol has an interaction with rolename.
+      // _Others stands for these roles only: the connections to the
+      // rest are pruned and recv_*_any skips them (see sc_recv_any).
+      //
+      bool is_peer(st_node *node, const char *rolename) {
+        if (node == NULL) return false;
+        if (node->type == ST_NODE_SEND && node->interaction->to_type == ST_ROLE_NORMAL) {
+          for (int to_idx=0; to_idx<node->interaction->nto; ++to_idx) {
+            if (strcmp(node->interaction->to[to_idx], rolename) == 0) return true;
+          }
+        }
+        if (node->type == ST_NODE_RECV && node->interaction->from_type == ST_ROLE_NORMAL
+            && strcmp(node->interaction->from, rolename) == 0) {
+          return true;
+        }
+        for (int child=0; child<node->nchild; ++child) {
+          if (is_peer(node->children[child], rolename)) return true;
+        }
+        return false;
+      }
+
+
+      //
+      // Collect the message labels of the protocol by identifier, so
+      // that case SC_LABEL_x: can be told from its value. Two labels
+      // with the same identifier cannot be told apart at runtime.
+      //
+      void intern_labels(st_node *node) {
+        if (node == NULL) return;
+        if ((node->type == ST_NODE_SEND || node->type == ST_NODE_RECV || node->type == ST_NODE_SENDRECV)
+            && node->interaction->msgsig.op != NULL && strlen(node->interaction->msgsig.op) > 0) {
+          std::string op(node->interaction->msgsig.op);
+          unsigned int id = st_node_msgsig_id(op.c_str());
+          std::map< unsigned int, std::string >::iterator it = label_ids_.find(id);
+          if (it == label_ids_.end()) {
+            label_ids_[id] = op;
+          } else if (it->second != op) {
+            llvm::errs() << "Error: labels " << it->second << " and " << op
+                         << " have the same identifier " << llvm::format("%08x", id) << "\n";
+            label_collision_ = true;
+          }
+        }
+        for (int child=0; child<node->nchild; ++child) {
+          intern_labels(node->children[child]);
+        }
+      }
+
+
+      //
+      // Append a dummy receive of label op from __LOCAL__ to a branch
+      // of a choice (stands for has_label or case SC_LABEL_op:).
+      //
+      void append_label(st_node *branch_node, const std::string &op) {
+        std::string payload("__LABEL__");
+        std::string role = "__LOCAL__";
+
+        st_node *label_node = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_RECV);
+        label_node->interaction->from = (char *)calloc(sizeof(char), role.size()+1);
+        strcpy(label_node->interaction->from, role.c_str());
+        label_node->interaction->nto = 0;
+        label_node->interaction->to = NULL;
+        label_node->interaction->msgsig.op = (char *)calloc(sizeof(char), op.size()+1);
+        strcpy(label_node->interaction->msgsig.op, op.c_str());
+        label_node->interaction->msgsig.payload = (char *)calloc(sizeof(char), payload.size()+1);
+        strcpy(label_node->interaction->msgsig.payload, payload.c_str());
+
+        st_node_append(branch_node, label_node);
+      }
+
+
+      //
+      // Set the role at which a choice is made: the sender of the first
+      // receive of a branch, or this role if a branch starts with a send.
+      //
+      void set_choice_at(st_node *node) {
+        node->choice->at = NULL;
+        for (int i=0; i<node->nchild; ++i) { // Children of choice = code blocks
+          for (int j=0; j<node->children[i]->nchild; ++j) { // Children of code blocks = body of branches
+            if (node->children[i]->children[j]->type == ST_NODE_RECV) {
+              if (strcmp(node->children[i]->children[j]->interaction->from, "__LOCAL__") == 0) {
+                continue;
+              }
+
+              node->choice->at = (char *)calloc(sizeof(char), strlen(node->children[i]->children[j]->interaction->from)+1);
+              strcpy(node->choice->at, node->children[i]->children[j]->interaction->from);
+              break;
+            }
+            if (node->children[i]->children[j]->type == ST_NODE_SEND) {
+              node->choice->at = (char *)calloc(sizeof(char), strlen(tree_->info->myrole)+1);
+              strcpy(node->choice->at, tree_->info->myrole);
+              break;
+            }
+          }
+
+          // If choice at role is found in one of the code blocks, stop search
+          if (node->choice->at != NULL) {
+            break;
+          }
+        }
+      }
+
+
       /* Visitors------------------------------------------------------------ */
 
       // Generic visitor.
@@ -345,6 +491,8 @@ namespace {
                 return;
               }
 
+              intern_labels(scribble_tree_->root);
+
               tree_->root = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_ROOT);
               appendto_node.push(tree_->root);
 
@@ -417,6 +565,7 @@ namespace {
               strcpy(node->interaction->msgsig.payload, datatype.c_str());
 
               // Put new ST node in position (ie. child of previous_node).
+              flush_any_recv();
               st_node * previous_node = appendto_node.top();
               st_node_append(previous_node, node);
                       
@@ -424,6 +573,46 @@ namespace {
             }
             // ---------- End of Send -----------
             
+            // ---------- Receive from any ----------
+            if (func_name.find("recv_") != std::string::npos
+                && func_name.size() > 4
+                && func_name.compare(func_name.size() - 4, 4, "_any") == 0) {
+
+              // Extract the datatype (without the _any suffix).
+              datatype = func_name.substr(func_name.find("_") + 1,
+                                          func_name.size() - 4 - (func_name.find("_") + 1));
+
+              // Extract the roles (all role arguments).
+              std::vector< std::string > roles;
+              for (unsigned int arg_idx=0; arg_idx<callExpr->getNumArgs(); ++arg_idx) {
+                Expr *arg = callExpr->getArg(arg_idx);
+                if (arg->getType().getAsString() != "role *") continue;
+
+                role = get_rolename(arg);
+                if (role.compare("_Others") == 0) { // Group role = all connected roles
+                  for (int role_idx=0; role_idx<scribble_tree_->info->nrole; ++role_idx) {
+                    if (!is_peer(scribble_tree_->root, scribble_tree_->info->roles[role_idx])) continue;
+                    roles.push_back(scribble_tree_->info->roles[role_idx]);
+                  }
+                } else {
+                  roles.push_back(role);
+                }
+              }
+
+              if (any_roles_ != roles || any_payload_ != datatype) {
+                flush_any_recv();
+                any_roles_ = roles;
+                any_payload_ = datatype;
+              }
+              any_count_++;
+              if (any_count_ == any_roles_.size()) {
+                flush_any_recv();
+              }
+
+              return; // end of ST_NODE_RECV construction.
+            }
+            // ---------- End of Receive from any ----------
+
             // ---------- Receive/Recv ----------
             if (func_name.find("receive_") != std::string::npos  // Indirect recv
                 || func_name.find("recv_") != std::string::npos) { // Direct recv
@@ -445,6 +634,7 @@ namespace {
               strcpy(node->interaction->msgsig.payload, datatype.c_str());
 
               // Put new ST node in position (ie. child of previous_node).
+              flush_any_recv();
               st_node * previous_node = appendto_node.top();
               st_node_append(previous_node, node);
 
@@ -453,7 +643,8 @@ namespace {
             // ---------- End of Receive/Recv ----------
 
             // ---------- Receive label ----------
-            if (func_name.compare("probe_label") == 0) {
+            if (func_name.compare("probe_label") == 0
+                || func_name.compare("probe_label_id") == 0) {
 
               std::string payload("__LABEL__");
 
@@ -477,6 +668,7 @@ namespace {
               strcpy(node->interaction->msgsig.payload, payload.c_str());
 
               // Put new ST node in position (ie. child of previous_node).
+              flush_any_recv();
               st_node * previous_node = appendto_node.top();
               st_node_append(previous_node, node);
 
@@ -511,12 +703,16 @@ namespace {
           node->recur->label = (char *)calloc(sizeof(char), loopLabel.size()+1);
           strcpy(node->recur->label, loopLabel.c_str());
 
+          flush_any_recv();
+
           st_node *previous_node = appendto_node.top();
           st_node_append(previous_node, node);
           appendto_node.push(node);
 
           BaseStmtVisitor::Visit(whileStmt->getBody());
 
+          flush_any_recv();
+
           // Implicit continue at end of loop.
           st_node *node_end = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_CONTINUE);
           node_end->cont->label = (char *)calloc(sizeof(char), loopLabel.size()+1);
@@ -539,12 +735,16 @@ namespace {
           node->recur->label = (char *)calloc(sizeof(char), loopLabel.size()+1);
           strcpy(node->recur->label, loopLabel.c_str());
 
+          flush_any_recv();
+
           st_node *previous_node = appendto_node.top();
           st_node_append(previous_node, node);
           appendto_node.push(node);
 
           BaseStmtVisitor::Visit(forStmt->getBody());
 
+          flush_any_recv();
+
           // Implicit continue at end of loop.
           st_node *node_end = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_CONTINUE);
           node_end->cont->label = (char *)calloc(sizeof(char), loopLabel.size()+1);
@@ -567,12 +767,16 @@ namespace {
           node->recur->label = (char *)calloc(sizeof(char), loopLabel.size()+1);
           strcpy(node->recur->label, loopLabel.c_str());
 
+          flush_any_recv();
+
           st_node *previous_node = appendto_node.top();
           st_node_append(previous_node, node);
           appendto_node.push(node);
 
           BaseStmtVisitor::Visit(doStmt->getBody());
 
+          flush_any_recv();
+
           // Implicit continue at end of loop.
           st_node *node_end = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_CONTINUE);
           node_end->cont->label = (char *)calloc(sizeof(char), loopLabel.size()+1);
@@ -587,6 +791,7 @@ namespace {
 
         // Continue (within while-loop).
         if (isa<ContinueStmt>(stmt)) {
+          flush_any_recv();
           st_node *previous_node = appendto_node.top();
           std::stack< st_node * > node_parents(appendto_node);
 
@@ -612,6 +817,8 @@ namespace {
 
           st_node *node = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_CHOICE);
 
+          flush_any_recv();
+
           st_node *previous_node = appendto_node.top();
           st_node_append(previous_node, node);
           appendto_node.push(node);
@@ -625,9 +832,7 @@ namespace {
             if (isa<CallExpr>(ifStmt->getCond())) {
               if (CallExpr *CE = dyn_cast<CallExpr>(ifStmt->getCond())) {
                 if (CE->getDirectCallee()->getNameAsString().compare("has_label") == 0) {
-                  std::string payload("__LABEL__");
                   std::string op;
-                  std::string role = "__LOCAL__";
 
                   // Extract the label (second argument).
                   if (ImplicitCastExpr *ICE = dyn_cast<ImplicitCastExpr>(CE->getArg(1))) {
@@ -639,24 +844,14 @@ namespace {
                   }
 
                   // Append a dummy recv node
-                  st_node *label_node = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_RECV);
-                  label_node->interaction->from = (char *)calloc(sizeof(char), role.size()+1);
-                  strcpy(label_node->interaction->from, role.c_str());
-                  label_node->interaction->nto = 0;
-                  label_node->interaction->to = NULL;
-                  label_node->interaction->msgsig.op = (char *)calloc(sizeof(char), op.size()+1);
-                  strcpy(label_node->interaction->msgsig.op, op.c_str());
-                  label_node->interaction->msgsig.payload = (char *)calloc(sizeof(char), payload.size()+1);
-                  strcpy(label_node->interaction->msgsig.payload, payload.c_str());
-
-                  // Put new ST node in position (ie. child of previous_node).
-                  st_node_append(then_node, label_node);
+                  append_label(then_node, op);
 
                 }
               }
             }
 
             BaseStmtVisitor::Visit(ifStmt->getThen());
+            flush_any_recv();
             appendto_node.pop();
           }
 
@@ -666,37 +861,86 @@ namespace {
             st_node_append(node, else_node);
             appendto_node.push(else_node);
             BaseStmtVisitor::Visit(ifStmt->getElse());
+            flush_any_recv();
             appendto_node.pop();
           }
 
           appendto_node.pop();
 
-          node->choice->at = NULL;
-          for (int i=0; i<node->nchild; ++i) { // Children of choice = code blocks
-            for (int j=0; j<node->children[i]->nchild; ++j) { // Children of code blocks = body of then/else
-              if (node->children[i]->children[j]->type == ST_NODE_RECV) {
-                if (strcmp(node->children[i]->children[j]->interaction->from, "__LOCAL__") == 0) {
-                  continue;
-                }
+          set_choice_at(node);
 
-                node->choice->at = (char *)calloc(sizeof(char), strlen(node->children[i]->children[j]->interaction->from)+1);
-                strcpy(node->choice->at, node->children[i]->children[j]->interaction->from);
-                break;
-              }
-              if (node->children[i]->children[j]->type == ST_NODE_SEND) {
-                node->choice->at = (char *)calloc(sizeof(char), strlen(tree_->info->myrole)+1);
-                strcpy(node->choice->at, tree_->info->myrole);
-                break;
+          return;
+        }
+
+
+        // Switch statement on a label (case SC_LABEL_x:).
+        if (isa<SwitchStmt>(stmt)) {
+          SwitchStmt *switchStmt = cast<SwitchStmt>(stmt);
+          CompoundStmt *body = dyn_cast_or_null<CompoundStmt>(switchStmt->getBody());
+
+          // Branches of the switch: labels of the cases (none for
+          // default:) and the statements up to the next case.
+          std::vector< std::vector< std::string > > branch_labels;
+          std::vector< std::vector< Stmt * > > branch_stmts;
+          bool label_switch = false;
+
+          if (body != NULL) {
+            for (CompoundStmt::body_iterator
+                 iter = body->body_begin(), iter_end = body->body_end();
+                 iter != iter_end; ++iter) {
+              Stmt *child = *iter;
+              if (isa<CaseStmt>(child) || isa<DefaultStmt>(child)) {
+                branch_labels.push_back(std::vector< std::string >());
+                branch_stmts.push_back(std::vector< Stmt * >());
+                while (SwitchCase *SC = dyn_cast<SwitchCase>(child)) { // case A: case B: ...
+                  if (CaseStmt *CS = dyn_cast<CaseStmt>(SC)) {
+                    llvm::APSInt value;
+                    if (CS->getLHS()->EvaluateAsInt(value, *context_)
+                        && label_ids_.count(value.getZExtValue()) > 0) {
+                      branch_labels.back().push_back(label_ids_[value.getZExtValue()]);
+                      label_switch = true;
+                    }
+                  }
+                  child = SC->getSubStmt();
+                }
               }
+              if (branch_stmts.empty() || child == NULL || isa<BreakStmt>(child)) continue;
+              branch_stmts.back().push_back(child);
             }
+          }
 
-            // If choice at role is found in one of the code blocks, stop search
-            if (node->choice->at != NULL) {
-              break;
+          if (label_switch) {
+            st_node *node = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_CHOICE);
+
+            flush_any_recv();
+
+            st_node *previous_node = appendto_node.top();
+            st_node_append(previous_node, node);
+            appendto_node.push(node);
+
+            for (unsigned int branch=0; branch<branch_stmts.size(); ++branch) {
+              // One code block per label (default: is one without a label).
+              unsigned int nlabel = branch_labels[branch].size();
+              for (unsigned int label_idx=0; label_idx<nlabel || (nlabel==0 && label_idx==0); ++label_idx) {
+                st_node *case_node = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_ROOT);
+                st_node_append(node, case_node);
+                appendto_node.push(case_node);
+
+                if (nlabel > 0) append_label(case_node, branch_labels[branch][label_idx]);
+                for (unsigned int stmt_idx=0; stmt_idx<branch_stmts[branch].size(); ++stmt_idx) {
+                  BaseStmtVisitor::Visit(branch_stmts[branch][stmt_idx]);
+                }
+                flush_any_recv();
+                appendto_node.pop();
+              }
             }
-          }
 
-          return;
+            appendto_node.pop();
+
+            set_choice_at(node);
+
+            return;
+          }
         }
 
 
@@ -0,0 +1,254 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "connmgr.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+char *roles[] = { "Master", "Worker1", "Worker2", "Worker3" };
+char *hosts[] = { "host0", "host1" };
+
+char binfile[] = "/tmp/test_connmgr-XXXXXX";
+char badfile[] = "/tmp/test_connmgr-bad-XXXXXX";
+
+int setup_connmgrsuite(void)
+{
+  int fd;
+
+  if ((fd = mkstemp(binfile)) < 0) return -1;
+  close(fd);
+  if ((fd = mkstemp(badfile)) < 0) return -1;
+  close(fd);
+
+  return 0;
+}
+
+
+int teardown_connmgrsuite(void)
+{
+  unlink(binfile);
+  unlink(badfile);
+  return 0;
+}
+
+
+/**
+ * Whether two connection records are the same.
+ */
+int same_conn(const conn_rec *a, const conn_rec *b)
+{
+  return a->type == b->type && a->port == b->port
+      && strcmp(a->from, b->from) == 0 && strcmp(a->to, b->to) == 0 && strcmp(a->host, b->host) == 0;
+}
+
+
+/**
+ * Whether the records of a role read from a mapping are those written:
+ * the point-to-point connections of the role, then all broadcast ones.
+ */
+int same_rows(const conn_rec conns[], int nconns, const char *role, const conn_rec rows[], int nrows)
+{
+  int conn_idx, row_idx = 0;
+  int pass;
+
+  for (pass=0; pass<2; ++pass) {
+    for (conn_idx=0; conn_idx<nconns; ++conn_idx) {
+      if ((conns[conn_idx].type == CONNMGR_TYPE_P2P) != (pass == 0)) continue;
+      if (pass == 0 && strcmp(conns[conn_idx].from, role) != 0 && strcmp(conns[conn_idx].to, role) != 0) continue;
+      if (row_idx == nrows || !same_conn(&conns[conn_idx], &rows[row_idx])) return 0;
+      row_idx++;
+    }
+  }
+
+  return row_idx == nrows;
+}
+
+
+/**
+ * Copy of the binary configuration in badfile, cut to size bytes,
+ * with the 32-bit word at offset off (if any) replaced by value.
+ */
+void write_bad(size_t size, long off, uint32_t value)
+{
+  FILE *fp;
+  char *buf;
+  size_t len;
+
+  CU_ASSERT_FATAL(NULL != (fp = fopen(binfile, "rb")));
+  buf = (char *)calloc(1, size + sizeof(uint32_t));
+  len = fread(buf, 1, size, fp);
+  fclose(fp);
+  if (off >= 0) memcpy(buf + off, &value, sizeof(uint32_t));
+
+  CU_ASSERT_FATAL(NULL != (fp = fopen(badfile, "wb")));
+  CU_ASSERT(len == fwrite(buf, 1, len, fp));
+  fclose(fp);
+  free(buf);
+}
+
+
+void test_bin_roundtrip(void)
+{
+  traffic_edge traffic[] = { { 0, 1, 1.0 }, { 0, 2, 1.0 }, { 0, 3, 1.0 } }; // Master-Workers
+  conn_rec *conns, *rows, *links;
+  host_map *role_hosts;
+  connmgr_arena *strings = NULL;
+  conn_config config;
+  int nconns, nrows, nlinks, role_idx, flags;
+
+  for (flags=0; flags<=CONNMGR_PRUNE; flags+=CONNMGR_PRUNE) {
+    nconns = connmgr_init(&conns, &role_hosts, roles, 4, hosts, 2, 6666, traffic, 3, flags, &strings);
+    CU_ASSERT(nconns == ((flags & CONNMGR_PRUNE) ? 3 + 4 : 6 + 4));
+    CU_ASSERT(0 == connmgr_write_bin(binfile, conns, nconns, role_hosts, 4));
+
+    CU_ASSERT_FATAL(0 == connmgr_map(binfile, &config));
+    CU_ASSERT(config.header->nroles == 4);
+    CU_ASSERT(config.header->nconns == (uint32_t)nconns);
+
+    for (role_idx=0; role_idx<4; ++role_idx) {
+      nrows = connmgr_map_rows(&config, roles[role_idx], &rows);
+      CU_ASSERT(same_rows(conns, nconns, roles[role_idx], rows, nrows));
+      free(rows);
+    }
+
+    // Unknown roles have the broadcast rows only.
+    nrows = connmgr_map_rows(&config, "Nobody", &rows);
+    CU_ASSERT(nrows == 4);
+    CU_ASSERT(same_rows(conns, nconns, "Nobody", rows, nrows));
+    free(rows);
+
+    nlinks = connmgr_map_links(&config, &links);
+    if (flags & CONNMGR_PRUNE) {
+      CU_ASSERT(nlinks == 3);
+      CU_ASSERT(same_rows(conns, nlinks, "Master", links, nlinks));
+    } else { // Every pair of roles connected.
+      CU_ASSERT(nlinks == 0);
+      CU_ASSERT(links == NULL);
+    }
+    free(links);
+
+    connmgr_unmap(&config);
+    CU_ASSERT(config.addr == NULL);
+    free(conns);
+    free(role_hosts);
+  }
+
+  connmgr_arena_free(strings);
+}
+
+
+void test_bin_rejected(void)
+{
+  conn_rec *conns;
+  host_map *role_hosts;
+  connmgr_arena *strings = NULL;
+  conn_config config;
+  connmgr_bin_header header;
+  FILE *fp;
+  int nconns;
+
+  nconns = connmgr_init(&conns, &role_hosts, roles, 4, hosts, 2, 6666, NULL, 0, 0, &strings);
+  CU_ASSERT_FATAL(0 == connmgr_write_bin(binfile, conns, nconns, role_hosts, 4));
+  free(conns);
+  free(role_hosts);
+  connmgr_arena_free(strings);
+
+  CU_ASSERT_FATAL(NULL != (fp = fopen(binfile, "rb")));
+  CU_ASSERT_FATAL(1 == fread(&header, sizeof(header), 1, fp));
+  fclose(fp);
+
+  // Missing file.
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map("/nonexistent/test_connmgr.bin", &config));
+  CU_ASSERT(errno == ENOENT);
+
+  // Truncated files.
+  write_bad(sizeof(header) - 1, -1, 0);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+  CU_ASSERT(config.addr == NULL);
+
+  write_bad(header.size - 1, -1, 0);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  write_bad(header.strings_off, -1, 0);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  // Corrupt files.
+  write_bad(header.size, offsetof(connmgr_bin_header, magic), 0);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  write_bad(header.size, offsetof(connmgr_bin_header, version), CONNMGR_BIN_VERSION + 1);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  write_bad(header.size, offsetof(connmgr_bin_header, nconns), header.nconns + 1);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  write_bad(header.size, offsetof(connmgr_bin_header, nlinks), header.nconns + 1);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  write_bad(header.size, offsetof(connmgr_bin_header, strings_off), header.size + 1);
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  write_bad(header.size, header.index_off, header.nconns); // Rows of the first role past the second's
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  write_bad(header.size, header.size - sizeof(uint32_t), 0xffffffff); // Unterminated strings
+  errno = 0;
+  CU_ASSERT(-1 == connmgr_map(badfile, &config));
+  CU_ASSERT(errno == EINVAL);
+
+  // The unmodified copy is accepted.
+  write_bad(header.size, -1, 0);
+  CU_ASSERT(0 == connmgr_map(badfile, &config));
+  connmgr_unmap(&config);
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite connmgrsuite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  connmgrsuite = CU_add_suite("Session C connection manager", setup_connmgrsuite, teardown_connmgrsuite);
+
+  if (NULL == connmgrsuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ((NULL == CU_add_test(connmgrsuite, "Binary configuration round trip",      &test_bin_roundtrip)) ||
+      (NULL == CU_add_test(connmgrsuite, "Truncated and corrupt configurations", &test_bin_rejected))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}
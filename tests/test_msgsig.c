@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "st_node.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+int setup_msgsigsuite(void)
+{
+  return 0;
+}
+
+
+int teardown_msgsigsuite(void)
+{
+  return 0;
+}
+
+
+void test_msgsig_id_stable(void)
+{
+  // Identifiers are compiled into programs (scribble-tool --labels) and
+  // derived by every endpoint, so they must not change.
+  CU_ASSERT(0x811c9dc5u == st_node_msgsig_id(""));
+  CU_ASSERT(0xe40c292cu == st_node_msgsig_id("a"));
+  CU_ASSERT(0x9eccf29du == st_node_msgsig_id("Label"));
+  CU_ASSERT(st_node_msgsig_id("Label") == st_node_msgsig_id("Label"));
+  CU_ASSERT(st_node_msgsig_id("Label") != st_node_msgsig_id("label"));
+}
+
+
+void test_msgsig_id_nonzero(void)
+{
+  // The FNV-1a hash of "qzs0UD" is 0, which is reserved for
+  // unlabelled messages.
+  CU_ASSERT(0 != st_node_msgsig_id("qzs0UD"));
+  CU_ASSERT(st_node_msgsig_id("qzs0UD") != st_node_msgsig_id(""));
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite msgsigsuite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  msgsigsuite = CU_add_suite("Session C message labels", setup_msgsigsuite, teardown_msgsigsuite);
+
+  if (NULL == msgsigsuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ((NULL == CU_add_test(msgsigsuite, "Stable label identifiers",   &test_msgsig_id_stable)) ||
+      (NULL == CU_add_test(msgsigsuite, "Non-zero label identifiers", &test_msgsig_id_nonzero))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}
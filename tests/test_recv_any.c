@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "st_node.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+int setup_recvanysuite(void)
+{
+  return 0;
+}
+
+
+int teardown_recvanysuite(void)
+{
+  return 0;
+}
+
+
+/**
+ * Local protocol of the master of examples/montecarlopi:
+ * one int from each worker, repeated nrun times.
+ */
+static st_node *master_protocol(int nrun)
+{
+  st_node *root = st_node_init(malloc(sizeof(st_node)), ST_NODE_ROOT);
+  st_node *tmp;
+  int i;
+
+  for (i=0; i<2*nrun; ++i) {
+    tmp = st_node_init(malloc(sizeof(st_node)), ST_NODE_RECV);
+    tmp->interaction->from = (i % 2 == 0) ? "Worker0" : "Worker1";
+    tmp->interaction->nto = 0;
+    tmp->interaction->to = NULL;
+    tmp->interaction->msgsig.op = NULL;
+    tmp->interaction->msgsig.payload = "int";
+    st_node_append(root, tmp);
+  }
+
+  return root;
+}
+
+
+void test_recv_any_complete_run(void)
+{
+  const char *workers[] = { "Worker0", "Worker1" };
+  st_node *root = st_node_init(malloc(sizeof(st_node)), ST_NODE_ROOT);
+  st_node *protocol = master_protocol(2);
+
+  // recv_int_any(&inside, &from, 2, W0, W1) twice per iteration.
+  CU_ASSERT(1 == st_node_append_recv_any(root, workers, 2, "int", 2));
+  CU_ASSERT(1 == st_node_append_recv_any(root, workers, 2, "int", 2));
+  CU_ASSERT(4 == root->nchild);
+
+  CU_ASSERT(1 == st_node_compare_r(root, protocol));
+
+  st_node_free(root);
+  st_node_free(protocol);
+}
+
+
+void test_recv_any_incomplete_run(void)
+{
+  const char *workers[] = { "Worker0", "Worker1" };
+  st_node *root = st_node_init(malloc(sizeof(st_node)), ST_NODE_ROOT);
+  st_node *protocol = master_protocol(1);
+
+  // A single recv_int_any(&inside, &from, 2, W0, W1) can receive from
+  // either worker, it must not stand for a receive from Worker0.
+  CU_ASSERT(0 == st_node_append_recv_any(root, workers, 2, "int", 1));
+  CU_ASSERT(1 == root->nchild);
+  CU_ASSERT(0 == st_node_compare_r(root, protocol));
+
+  st_node_free(root);
+  st_node_free(protocol);
+}
+
+
+void test_recv_any_overlong_run(void)
+{
+  const char *workers[] = { "Worker0", "Worker1" };
+  st_node *root = st_node_init(malloc(sizeof(st_node)), ST_NODE_ROOT);
+  st_node *protocol = master_protocol(2);
+
+  // Three receives cannot be one from each of two workers.
+  CU_ASSERT(0 == st_node_append_recv_any(root, workers, 2, "int", 3));
+  CU_ASSERT(0 == st_node_compare_r(root, protocol));
+
+  st_node_free(root);
+  st_node_free(protocol);
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite recvanysuite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  recvanysuite = CU_add_suite("Session C receive from any role", setup_recvanysuite, teardown_recvanysuite);
+
+  if (NULL == recvanysuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ((NULL == CU_add_test(recvanysuite, "Complete run",   &test_recv_any_complete_run)) ||
+      (NULL == CU_add_test(recvanysuite, "Incomplete run", &test_recv_any_incomplete_run)) ||
+      (NULL == CU_add_test(recvanysuite, "Overlong run",   &test_recv_any_overlong_run))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}